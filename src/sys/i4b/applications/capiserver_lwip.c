@@ -54,22 +54,14 @@ SYSPOOL_GROW(zone_clust, 4);
 
 #define	CAPI_MAKE_IOCTL
 #include <i4b/include/capi20.h>
-
-#define	CAPISERVER_HDR_SIZE 4		/* bytes */
-
-/* define supported commands */
-enum {
-	CAPISERVER_CMD_CAPI_MSG,
-	CAPISERVER_CMD_CAPI_REGISTER,
-	CAPISERVER_CMD_CAPI_MANUFACTURER,
-	CAPISERVER_CMD_CAPI_VERSION,
-	CAPISERVER_CMD_CAPI_SERIAL,
-	CAPISERVER_CMD_CAPI_PROFILE,
-	CAPISERVER_CMD_CAPI_START,
-};
+#include <i4b/include/i4b_capiserver.h>
 
 #define	CAPISERVER_BUF_MAX (2048 + 256)
 
+/* no compression, to save memory */
+#define	CAPISERVER_FEATURES \
+	(CAPISERVER_FEATURE_MULTI | CAPISERVER_FEATURE_REQID)
+
 extern struct cdev *capi_dev;
 
 struct capiconn {
@@ -78,6 +70,7 @@ struct capiconn {
 	struct netbuf *rxbuf;
 	uint8_t *curr_recv_data;
 	uint16_t curr_recv_len;
+	uint32_t features;
 	uint8_t	buffer[CAPISERVER_BUF_MAX] __aligned(4);
 };
 
@@ -172,17 +165,32 @@ capiserver_read(struct capiconn *cc, void *buf, uint16_t len)
 
 static int
 capiserver_ioctl(struct capiconn *cc, uint32_t cmd, uint32_t ioctl_cmd,
-    void *buffer, ssize_t length)
+    uint8_t *buffer, ssize_t length)
 {
-	uint8_t header[CAPISERVER_HDR_SIZE] __aligned(4);
+	uint8_t header[CAPISERVER_HDR_SIZE + CAPISERVER_REQID_SIZE] __aligned(4);
+	uint16_t hlen = CAPISERVER_HDR_SIZE;
 	int err;
 
+	if (CAPISERVER_CMD_HAS_REQID(cmd)) {
+		if ((cc->features & CAPISERVER_FEATURE_REQID) == 0)
+			return (0);	/* ignore */
+		if (length < CAPISERVER_REQID_SIZE) {
+			err = EINVAL;
+			goto error;
+		}
+		/* keep the request ID for the answer */
+		memcpy(header + CAPISERVER_HDR_SIZE, buffer,
+		    CAPISERVER_REQID_SIZE);
+		hlen += CAPISERVER_REQID_SIZE;
+		buffer += CAPISERVER_REQID_SIZE;
+		length -= CAPISERVER_REQID_SIZE;
+	}
 	if (length != IOCPARM_LEN(ioctl_cmd)) {
 		err = EINVAL;
 		goto error;
 	}
 	if (ioctl_cmd == CAPI_REGISTER_REQ) {
-		struct capi_register_req *req = buffer;
+		struct capi_register_req *req = (void *)buffer;
 
 		CAPI_FWD(req->max_logical_connections);
 		CAPI_FWD(req->max_b_data_blocks);
@@ -193,7 +201,7 @@ capiserver_ioctl(struct capiconn *cc, uint32_t cmd, uint32_t ioctl_cmd,
 		    ioctl_cmd == CAPI_GET_VERSION_REQ ||
 		    ioctl_cmd == CAPI_GET_SERIAL_REQ ||
 	    ioctl_cmd == CAPI_GET_PROFILE_REQ) {
-		uint32_t *pcontroller = buffer;
+		uint32_t *pcontroller = (void *)buffer;
 
 		CAPI_FWD(*pcontroller);
 	}
@@ -201,7 +209,7 @@ capiserver_ioctl(struct capiconn *cc, uint32_t cmd, uint32_t ioctl_cmd,
 		goto error;
 
 	if (ioctl_cmd == CAPI_REGISTER_REQ) {
-		struct capi_register_req *req = buffer;
+		struct capi_register_req *req = (void *)buffer;
 
 		CAPI_REV(req->max_logical_connections);
 		CAPI_REV(req->max_b_data_blocks);
@@ -212,23 +220,24 @@ capiserver_ioctl(struct capiconn *cc, uint32_t cmd, uint32_t ioctl_cmd,
 		    ioctl_cmd == CAPI_GET_VERSION_REQ ||
 		    ioctl_cmd == CAPI_GET_SERIAL_REQ ||
 	    ioctl_cmd == CAPI_GET_PROFILE_REQ) {
-		uint32_t *pcontroller = buffer;
+		uint32_t *pcontroller = (void *)buffer;
 
 		CAPI_REV(*pcontroller);
 	}
-	header[0] = length & 0xFF;
-	header[1] = length >> 8;
+	header[0] = (length + hlen - CAPISERVER_HDR_SIZE) & 0xFF;
+	header[1] = (length + hlen - CAPISERVER_HDR_SIZE) >> 8;
 	header[2] = cmd;
 	header[3] = 0;
 
-	if (capiserver_write(cc, header, sizeof(header), NETCONN_COPY | NETCONN_MORE) != sizeof(header))
+	/* the request ID, if any, follows the header */
+	if (capiserver_write(cc, header, hlen, NETCONN_COPY | NETCONN_MORE) != hlen)
 		return (-1);
 	if (capiserver_write(cc, buffer, length, NETCONN_COPY) != length)
 		return (-1);
 	return (0);
 
 error:
-	header[0] = 0;
+	header[0] = hlen - CAPISERVER_HDR_SIZE;
 	header[1] = 0;
 	header[2] = cmd;
 	if (err < 256)
@@ -236,11 +245,71 @@ error:
 	else
 		header[3] = EINVAL;
 
-	if (capiserver_write(cc, header, sizeof(header), NETCONN_COPY) != sizeof(header))
+	if (capiserver_write(cc, header, hlen, NETCONN_COPY) != hlen)
 		return (-1);
 	return (0);
 }
 
+static int
+capiserver_hello(struct capiconn *cc, uint8_t *buffer, ssize_t length)
+{
+	uint8_t header[CAPISERVER_HDR_SIZE] __aligned(4);
+	struct capiserver_hello hello;
+
+	if (length < (ssize_t)sizeof(hello))
+		return (0);		/* ignore */
+
+	memcpy(&hello, buffer, sizeof(hello));
+
+	if (le32toh(hello.version) >= CAPISERVER_VERSION_2) {
+		cc->features = le32toh(hello.features) & CAPISERVER_FEATURES;
+		hello.version = htole32(CAPISERVER_VERSION_2);
+	} else {
+		cc->features = 0;
+		hello.version = htole32(CAPISERVER_VERSION_1);
+	}
+	hello.features = htole32(cc->features);
+
+	header[0] = sizeof(hello);
+	header[1] = 0;
+	header[2] = CAPISERVER_CMD_HELLO;
+	header[3] = 0;
+
+	if (capiserver_write(cc, header, sizeof(header), NETCONN_COPY | NETCONN_MORE) != sizeof(header))
+		return (-1);
+	if (capiserver_write(cc, &hello, sizeof(hello), NETCONN_COPY) != sizeof(hello))
+		return (-1);
+	return (0);
+}
+
+/*
+ * Write the CAPI messages of a CAPI_MULTI frame, one by one, so
+ * that the frame does not need to fit into the buffer.
+ */
+static int
+capiserver_multi(struct capiconn *cc, ssize_t length)
+{
+	uint8_t header[CAPISERVER_MULTI_HDR_SIZE];
+	uint16_t len;
+
+	while (length >= CAPISERVER_MULTI_HDR_SIZE) {
+		if (capiserver_read(cc, header, sizeof(header)) != sizeof(header))
+			return (-1);
+		length -= sizeof(header);
+
+		len = header[0] | (header[1] << 8);
+		if (len > length || len > CAPISERVER_BUF_MAX)
+			return (-1);
+		if (capiserver_read(cc, cc->buffer, len) != len)
+			return (-1);
+		length -= len;
+
+		if (cdev_write(cc->file, cc->buffer, len) != len)
+			return (-1);
+	}
+	return (length != 0 ? -1 : 0);
+}
+
 static void
 capiserver(struct capiconn *cc)
 {
@@ -272,6 +341,12 @@ capiserver(struct capiconn *cc)
 		cmd = header[2];
 
 		netconn_set_recvtimeout(cc->conn, 0);
+		if (cmd == CAPISERVER_CMD_CAPI_MULTI &&
+		    (cc->features & CAPISERVER_FEATURE_MULTI)) {
+			if (capiserver_multi(cc, length))
+				goto done;
+			continue;
+		}
 		if (length > CAPISERVER_BUF_MAX) {
 			/* dump all data */
 			if (capiserver_read(cc, NULL, length) != length)
@@ -287,29 +362,39 @@ capiserver(struct capiconn *cc)
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_REGISTER:
+		case CAPISERVER_CMD_CAPI_REGISTER_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_REGISTER_REQ, cc->buffer, length))
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_MANUFACTURER:
+		case CAPISERVER_CMD_CAPI_MANUFACTURER_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_GET_MANUFACTURER_REQ, cc->buffer, length))
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_VERSION:
+		case CAPISERVER_CMD_CAPI_VERSION_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_GET_VERSION_REQ, cc->buffer, length))
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_SERIAL:
+		case CAPISERVER_CMD_CAPI_SERIAL_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_GET_SERIAL_REQ, cc->buffer, length))
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_PROFILE:
+		case CAPISERVER_CMD_CAPI_PROFILE_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_GET_PROFILE_REQ, cc->buffer, length))
 				goto done;
 			break;
 		case CAPISERVER_CMD_CAPI_START:
+		case CAPISERVER_CMD_CAPI_START_ID:
 			if (capiserver_ioctl(cc, cmd, CAPI_START_D_CHANNEL_REQ, cc->buffer, length))
 				goto done;
 			break;
+		case CAPISERVER_CMD_HELLO:
+			if (capiserver_hello(cc, cc->buffer, length))
+				goto done;
+			break;
 		default:
 			break;
 		}
@@ -350,6 +435,7 @@ capithread(void *arg)
 				int nb = 1;
 
 				cdev_ioctl(cc->file, FIONBIO, (void *)&nb);
+				cc->features = 0;
 				netconn_set_sendtimeout(cc->conn, 4000 /* ms */ );
 				capiserver(cc);
 				cdev_close(cc->file);
@@ -106,12 +106,18 @@ i4bctlioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct thread
 #if DO_I4B_DEBUG
 	i4b_debug_t *dbg = (void *)data;
 	i4b_ec_debug_t *ec_dbg = (void *)data;
+	i4b_poll_debug_t *poll_dbg = (void *)data;
+	i4b_fifo_debug_t *fifo_dbg = (void *)data;
+	i4b_mbuf_debug_t *mbuf_dbg = (void *)data;
 	i4b_controller_t *cntl = 0;
 	int error = 0;
 
 	/* lookup cntl in general */
 	if ((IOCPARM_LEN(cmd) == sizeof(*dbg)) ||
-	    (IOCPARM_LEN(cmd) == sizeof(*ec_dbg)))
+	    (IOCPARM_LEN(cmd) == sizeof(*ec_dbg)) ||
+	    (IOCPARM_LEN(cmd) == sizeof(*poll_dbg)) ||
+	    (IOCPARM_LEN(cmd) == sizeof(*fifo_dbg)) ||
+	    (IOCPARM_LEN(cmd) == sizeof(*mbuf_dbg)))
 	{
 		cntl = CNTL_FIND(dbg->unit);
 
@@ -217,6 +223,49 @@ i4bctlioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct thread
 	    ec_dbg->npoints = 0;
 	    goto L1_command;
 
+	case I4B_CTL_GET_POLLSTAT:
+	    cmd = CMR_GET_POLLSTAT;
+	    poll_dbg->hz = hz;
+	    poll_dbg->poll_delay = 0;
+	    poll_dbg->poll_delay_max = 0;
+	    bzero(&poll_dbg->pollstat, sizeof(poll_dbg->pollstat));
+	    goto L1_command;
+
+	case I4B_CTL_CLR_POLLSTAT:
+	    cmd = CMR_CLR_POLLSTAT;
+	    goto L1_command;
+
+	case I4B_CTL_GET_FIFOSTAT:
+	    cmd = CMR_GET_FIFOSTAT;
+	    bzero(&fifo_dbg->rx, sizeof(fifo_dbg->rx));
+	    bzero(&fifo_dbg->tx, sizeof(fifo_dbg->tx));
+	    goto L1_command;
+
+	case I4B_CTL_CLR_FIFOSTAT:
+	    cmd = CMR_CLR_FIFOSTAT;
+	    goto L1_command;
+
+	    /* the mbuf pool belongs to
+	     * the controller and not
+	     * to the lower layers:
+	     */
+	case I4B_CTL_GET_MBUFSTAT:
+	    mbuf_dbg->count = cntl->mbuf_pool.count;
+	    mbuf_dbg->count_max = I4B_MBUF_POOL_MAX;
+	    mbuf_dbg->unused = 0;
+	    mbuf_dbg->hits = cntl->mbuf_pool.hits;
+	    mbuf_dbg->misses = cntl->mbuf_pool.misses;
+	    mbuf_dbg->recycled = cntl->mbuf_pool.recycled;
+	    mbuf_dbg->dropped = cntl->mbuf_pool.dropped;
+	    break;
+
+	case I4B_CTL_CLR_MBUFSTAT:
+	    cntl->mbuf_pool.hits = 0;
+	    cntl->mbuf_pool.misses = 0;
+	    cntl->mbuf_pool.recycled = 0;
+	    cntl->mbuf_pool.dropped = 0;
+	    break;
+
 	L1_command:
 
 	    /* forward IOCTL to lower layers */
@@ -43,6 +43,7 @@
 #include <sys/mbuf.h>
 #include <sys/socket.h>
 #include <sys/lock.h>
+#include <sys/sx.h>
 
 #include <net/if.h>
 #endif
@@ -95,6 +96,16 @@ typedef struct {
 	uint16_t		tone_duration;
 	struct selinfo		selp1;		/* select / poll */
 
+	/* B-channel data is passed through rings, so that
+	 * read and write do not need the controller lock,
+	 * except for sleeping and starting layer 1:
+	 */
+	struct i4b_mbuf_ring	rx_ring;	/* layer 1 -> read */
+	struct i4b_mbuf_ring	tx_ring;	/* write -> layer 1 */
+	struct sx		rx_sx;	/* serializes readers */
+	struct sx		tx_sx;	/* serializes writers */
+	volatile uint32_t	rx_flush; /* drain "rx_ring" before next read */
+
 	/* used by ``/dev/i4bteld'' device */
 
 	uint8_t		last_status;	/* last status from dialresponse */
@@ -119,13 +130,13 @@ typedef struct {
 static tel_sc_t tel_sc[NI4BTEL];
 
 static struct mbuf *
-i4b_tel_tone(tel_sc_t *sc)
+i4b_tel_tone(tel_sc_t *sc, struct fifo_translator *f)
 {
 	struct mbuf *m;
 	uint32_t len;
 	uint8_t *ptr;
 
-	m = i4b_getmbuf(BCH_MAX_DATALEN, M_NOWAIT);
+	m = i4b_mbuf_pool_get(f->mbuf_pool, BCH_MAX_DATALEN);
 
 	if(m == NULL)
 	{
@@ -286,11 +297,11 @@ i4b_tel_close(struct cdev *dev, int flag, int fmt, struct thread *td)
 	FIFO_TRANSLATOR_ACCESS(f,sc->sc_fifo_translator,
 	{
 		/* connected */
-		while(!_IF_QEMPTY(&f->tx_queue))
+		while(!I4B_MBUF_RING_EMPTY(&sc->tx_ring))
 		{
 			sc->state |= ST_WRWAIT_EMPTY;
 
-			FIFO_TRANSLATOR_SLEEP(f,&f->tx_queue,
+			FIFO_TRANSLATOR_SLEEP(f,&sc->tx_ring,
 					      (PSOCK|PCATCH), "wtcl", 0, error);
 		}
 
@@ -408,11 +419,8 @@ i4b_tel_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct threa
 		break;
 	
 	  case I4B_TEL_EMPTYINPUTQUEUE:
-		if(f)
-		{
-		  /* connected */
-		  _IF_DRAIN(&f->rx_queue);
-		}
+		/* the reader owns "rx_ring" */
+		atomic_store_rel_32(&sc->rx_flush, 1);
 		break;
 
 	  case I4B_TEL_VR_REQ:
@@ -424,7 +432,6 @@ i4b_tel_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct threa
 		{
 			struct i4b_tel_tones *tt = (void *)data;
 			enum { _connected_code = 1 };
-			struct mbuf *m;
 			__typeof(f->refcount) 
 			  refcount = f->refcount;
 
@@ -443,17 +450,10 @@ i4b_tel_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct threa
 
 			sc->state |= ST_TONE;
 
-			m = i4b_tel_tone(sc);
-
-			if(m)
-			{
-				_IF_ENQUEUE(&f->tx_queue, m);
-				L1_FIFO_START(f);
-			}
-			else
-			{
-				error = ENOMEM;
-			}
+			/* "tel_get_mbuf()" will generate the
+			 * tones when "tx_ring" is empty
+			 */
+			L1_FIFO_START(f);
 		}
 		else
 		{
@@ -497,26 +497,43 @@ i4b_tel_read(struct cdev *dev, struct uio *uio, int ioflag)
 	struct mbuf *m;
 	int error = 0;
 
-	m = 0;
+	error = sx_xlock_sig(&sc->rx_sx);
+	if(error)
+	{
+		return(error);
+	}
 
-	FIFO_TRANSLATOR_ACCESS(f,sc->sc_fifo_translator,
+	if(atomic_readandclear_32(&sc->rx_flush))
+	{
+		i4b_mbuf_ring_drain(&sc->rx_ring);
+	}
+
+	/* no locking is needed as long as
+	 * there is data in the ring
+	 */
+	m = i4b_mbuf_ring_dequeue(&sc->rx_ring);
+
+	if(m == NULL)
 	{
+	  FIFO_TRANSLATOR_ACCESS(f,sc->sc_fifo_translator,
+	  {
 		  /* connected */
 
-		  while(_IF_QEMPTY(&f->rx_queue))
+		  while((m = i4b_mbuf_ring_dequeue(&sc->rx_ring)) == NULL)
 		  {
 			sc->state |= ST_RDWAIT_DATA;
 
-			FIFO_TRANSLATOR_SLEEP(f,&f->rx_queue,(PSOCK|PCATCH),
+			FIFO_TRANSLATOR_SLEEP(f,&sc->rx_ring,(PSOCK|PCATCH),
 					      "rtel",0,error);
 		  }
-	
-		  _IF_DEQUEUE(&f->rx_queue, m);
-	},
-	{
-	  /* not connected */
-	});
-		
+	  },
+	  {
+		  /* not connected */
+	  });
+	}
+
+	sx_xunlock(&sc->rx_sx);
+
 	if(m && m->m_len > 0)
 	{
 			/* convert data */
@@ -623,29 +640,53 @@ i4b_tel_write(struct cdev *dev, struct uio * uio, int ioflag)
 				 BSUBPROT_MUTED : sc->rd.audio_input_bsubprot,
 				 sc->rd.audio_output_bsubprot);
 
-	    FIFO_TRANSLATOR_ACCESS(f,sc->sc_fifo_translator,
+	    error = sx_xlock_sig(&sc->tx_sx);
+	  }
+
+	  if(!error)
+	  {
+	    /* no locking is needed as long as layer 1
+	     * is transmitting from the ring and the tone
+	     * generator is off
+	     */
+	    if((sc->sc_fifo_translator != NULL) &&
+	       (!(sc->state & ST_TONE)) &&
+	       (i4b_mbuf_ring_enqueue(&sc->tx_ring, m) == 0))
 	    {
+		m = 0;
+	    }
+
+	    if(m || i4b_mbuf_ring_idle(&sc->tx_ring))
+	    {
+	      FIFO_TRANSLATOR_ACCESS(f,sc->sc_fifo_translator,
+	      {
 		/* connected */
 
 		sc->state &= ~ST_TONE;
 
-		while(_IF_QFULL(&f->tx_queue))
+		while(m)
 		{
+		  if(i4b_mbuf_ring_enqueue(&sc->tx_ring, m) == 0)
+		  {
+		    m = 0;
+		    break;
+		  }
+
 		  sc->state |= ST_WRWAIT_EMPTY;
 
-		  FIFO_TRANSLATOR_SLEEP(f,&f->tx_queue,
+		  FIFO_TRANSLATOR_SLEEP(f,&sc->tx_ring,
 					(PSOCK|PCATCH),"wtel",0,error);
 		}
 
-		_IF_ENQUEUE(&f->tx_queue, m);
-		m = 0;
-
 		L1_FIFO_START(f);
-	    },
-	    {
+	      },
+	      {
 		/* not connected */
 		error = EIO;
-	    });
+	      });
+	    }
+
+	    sx_xunlock(&sc->tx_sx);
 	  }
 	}
 	else
@@ -719,13 +760,18 @@ i4b_tel_poll(struct cdev *dev, int events, struct thread *td)
 	{
 	    /* connected */
 
-	    if(!_IF_QFULL(&f->tx_queue))
+	    if(!I4B_MBUF_RING_FULL(&sc->tx_ring))
 	    {
 	      NDBGL4(L4_TELDBG, "%s, POLLOUT", devtoname(dev));
 	      revents |= (events & (POLLOUT|POLLWRNORM));
 	    }
+	    else
+	    {
+	      /* "tel_get_mbuf()" will do the selwakeup */
+	      sc->state |= ST_WRWAIT_EMPTY;
+	    }
 		
-	    if(!_IF_QEMPTY(&f->rx_queue))
+	    if(!I4B_MBUF_RING_EMPTY(&sc->rx_ring))
 	    {
 	      NDBGL4(L4_TELDBG, "%s, POLLIN", devtoname(dev));
 	      revents |= (events & (POLLIN|POLLRDNORM));
@@ -834,21 +880,36 @@ static void
 tel_put_mbuf(struct fifo_translator *f, struct mbuf *m)
 {
 	tel_sc_t *sc = f->L5_sc;
+	uint8_t was_empty;
 
 	if(!i4b_l1_bchan_tel_silence(m->m_data, m->m_len))
 	{
 	  tel_activity(sc);
 	}
 
-	_IF_HANDOFF(&f->rx_queue, m, NULL);
-	
+	/* the reader can only empty the ring,
+	 * so "i4b_tel_poll()" must have seen an
+	 * empty ring, if it is waiting:
+	 */
+	was_empty = I4B_MBUF_RING_EMPTY(&sc->rx_ring);
+
+	if(i4b_mbuf_ring_enqueue(&sc->rx_ring, m))
+	{
+		/* reader is too slow */
+		i4b_mbuf_pool_put(f->mbuf_pool, m);
+		return;
+	}
+
 	if(sc->state & ST_RDWAIT_DATA)
 	{
 		sc->state &= ~ST_RDWAIT_DATA;
-		wakeup(&f->rx_queue);
+		wakeup(&sc->rx_ring);
 	}
 
-	selwakeup(&sc->selp1);
+	if(was_empty)
+	{
+		selwakeup(&sc->selp1);
+	}
 	return;
 }
 
@@ -864,22 +925,23 @@ tel_get_mbuf(struct fifo_translator *f)
 
 	tel_sc_t *sc = f->L5_sc;
 
-	_IF_DEQUEUE(&f->tx_queue, m);
+	m = i4b_mbuf_ring_dequeue(&sc->tx_ring);
 
-	if(!m)
+	if((!m) && (sc->state & ST_TONE))
 	{
-	  if(sc->state & ST_TONE)
-	  {
-	    m = i4b_tel_tone(sc);
-	  }
-	  else
-	  {
-	    if(sc->state & ST_WRWAIT_EMPTY)
-	    {
-		sc->state &= ~ST_WRWAIT_EMPTY;
-		wakeup(&f->tx_queue);
-	    }
-	  }
+	    m = i4b_tel_tone(sc, f);
+	}
+
+	/* wake up the writer when the ring
+	 * is half empty, and not for every
+	 * mbuf:
+	 */
+	if((sc->state & ST_WRWAIT_EMPTY) &&
+	   (I4B_MBUF_RING_COUNT(&sc->tx_ring) <= (I4B_MBUF_RING_MAX / 2)))
+	{
+	    sc->state &= ~ST_WRWAIT_EMPTY;
+	    wakeup(&sc->tx_ring);
+	    selwakeup(&sc->selp1);
 	}
 
 	if(m)
@@ -889,10 +951,6 @@ tel_get_mbuf(struct fifo_translator *f)
 	    tel_activity(sc);
 	  }
 	}
-	else
-	{
-	  selwakeup(&sc->selp1);
-	}
 
 	return m;
 }
@@ -940,6 +998,14 @@ tel_setup_ft(i4b_controller_t *cntl, fifo_translator_t *f,
 	  f->L5_GET_MBUF     = tel_get_mbuf;
 	  sc->cdp = cd;
 
+	  /* layer 1 is stopped, so the
+	   * transmit ring can be drained
+	   * here, while the receive ring
+	   * is drained by the reader:
+	   */
+	  i4b_mbuf_ring_drain(&sc->tx_ring);
+	  atomic_store_rel_32(&sc->rx_flush, 1);
+
 	  sc->rd.audio_output_bsubprot = pp->protocol_4;
 	  sc->wr.audio_input_bsubprot = pp->protocol_4;
 
@@ -958,16 +1024,19 @@ tel_setup_ft(i4b_controller_t *cntl, fifo_translator_t *f,
 
 	  sc->cdp = NULL;
 	
+	  i4b_mbuf_ring_drain(&sc->tx_ring);
+
 	  if(sc->state & ST_RDWAIT_DATA)
 	  {
 		sc->state &= ~ST_RDWAIT_DATA;
-		wakeup(&f->rx_queue);
+		wakeup(&sc->rx_ring);
 	  }
 
 	  if(sc->state & ST_WRWAIT_EMPTY)
 	  {
 		sc->state &= ~ST_WRWAIT_EMPTY;
-		wakeup(&f->tx_queue);
+		wakeup(&sc->tx_ring);
+		selwakeup(&sc->selp1);
 	  }
 
 	  if(sc->state & ST_TONE)
@@ -1026,6 +1095,9 @@ i4b_tel_attach(void *dummy)
 	{
 		sc->unit = i;
 
+		sx_init(&sc->rx_sx, "i4btel_rx");
+		sx_init(&sc->tx_sx, "i4btel_tx");
+
 		/* normal i4btel device */
 		dev = make_dev(&i4b_tel_cdevsw, i,
 			       UID_ROOT, GID_WHEEL,
@@ -147,6 +147,7 @@ i4b_l1_trace_ind(i4b_trace_hdr_t *hdr, struct mbuf *m1)
 	struct i4b_trace_softc *sc;
 	struct mbuf *m2;
 	struct mbuf *m3;
+	uint32_t len;
 
 	if((hdr->unit < 0) ||
 	   (hdr->unit >= I4B_MAX_CONTROLLERS))
@@ -160,13 +161,14 @@ i4b_l1_trace_ind(i4b_trace_hdr_t *hdr, struct mbuf *m1)
 	 * is preferred !
 	 */
 	sc = &i4b_trace_softc[hdr->unit];
-	m2 = i4b_getmbuf(m1->m_len, M_NOWAIT);
+	len = m_length(m1, NULL);
+	m2 = i4b_getmbuf(len, M_NOWAIT);
 	m3 = i4b_getmbuf(sizeof(*hdr), M_NOWAIT);
 
 	/* setup header */
 
 	hdr->trunc = 0;
-	hdr->length = m_length(m1, NULL) + sizeof(*hdr);
+	hdr->length = len + sizeof(*hdr);
 
 	if(m2 && m3 && (!_IF_QFULL(&sc->sc_queue)) && 
 	   (sc->sc_flags & ST_OPEN))
@@ -175,7 +177,8 @@ i4b_l1_trace_ind(i4b_trace_hdr_t *hdr, struct mbuf *m1)
 
 	    m3->m_next = m2;
 	    bcopy(hdr, m3->m_data, sizeof(*hdr));
-	    bcopy(m1->m_data, m2->m_data, m1->m_len);
+	    /* "m1" can be a chain of mbufs */
+	    m_copydata(m1, 0, len, m2->m_data);
 
 	    _IF_ENQUEUE(&sc->sc_queue, m3);
 	    m2 = NULL;
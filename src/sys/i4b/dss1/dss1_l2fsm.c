@@ -1607,6 +1607,9 @@ dss1_setup_ft(i4b_controller_t *cntl, fifo_translator_t *f,
 	  /* set all channels free */
 	  BZERO(&cntl->N_channel_utilization);
 
+	  /* the call reference hash refers to the call-descriptors */
+	  BZERO(&cntl->N_cr_hash);
+
 	  /**/
 	  BZERO(sc);
 	}
@@ -1046,7 +1046,7 @@ n_allocate_cd(struct i4b_controller *cntl, void *pipe, u_int crval,
     cd->channel_id = CHAN_ANY;
     cd->channel_bprot = BPROT_NONE;
 
-    cd->cr = crval;
+    cd_set_cr(cd, crval);
 
     cd->dst_telno_ptr = &(cd->dst_telno[0]);
 
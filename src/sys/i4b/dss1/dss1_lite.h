@@ -253,6 +253,7 @@ struct dss1_lite_fifo {
 	struct fifo_translator ft[1];
 #ifndef HAVE_NO_ECHO_CANCEL
 	struct i4b_echo_cancel echo_cancel[1];
+	struct i4b_echo_cancel_part echo_cancel_part[1];
 #endif
 	struct mbuf *m_rx_curr;
 	struct mbuf *m_tx_curr;
@@ -273,6 +274,9 @@ struct dss1_lite {
 	struct dss1_lite_call_desc dl_cd[DL_NCALL];
 	struct dss1_lite_ifq dl_outq;
 	struct dss1_lite_fifo dl_fifo[DL_NCHAN];
+#ifndef HAVE_NO_ECHO_CANCEL
+	struct i4b_echo_cancel_scratch dl_ec_scratch[1];
+#endif
 	i4b_trace_hdr_t dl_trace_hdr;
 
 	struct dss1_lite_call_desc *dl_active_call_desc;
@@ -317,12 +321,12 @@ uint8_t	dss1_lite_r_key_event(struct dss1_lite *);
 uint8_t	dss1_lite_dtmf_event(struct dss1_lite *, const char *);
 void	dss1_lite_process(struct dss1_lite *);
 void	dss1_lite_trace_info(struct dss1_lite *pdl, struct dss1_lite_fifo *f, const char *desc);
-void	dss1_lite_l5_put_sample(struct dss1_lite *pdl, struct dss1_lite_fifo *f, int32_t sample);
+void	dss1_lite_l5_put_samples(struct dss1_lite *pdl, struct dss1_lite_fifo *f, const int16_t *ptr, uint16_t len);
 void	dss1_lite_l5_put_sample_complete(struct dss1_lite *pdl, struct dss1_lite_fifo *f);
 void	dss1_lite_l5_get_sample_complete(struct dss1_lite *pdl, struct dss1_lite_fifo *f);
 void	dss1_lite_l5_put_mbuf(struct dss1_lite *, struct dss1_lite_fifo *, struct mbuf *);
 struct mbuf *dss1_lite_l5_get_new_mbuf(struct dss1_lite *, struct dss1_lite_fifo *);
-int16_t	dss1_lite_l5_get_sample(struct dss1_lite *pdl, struct dss1_lite_fifo *f);
+void	dss1_lite_l5_get_samples(struct dss1_lite *pdl, struct dss1_lite_fifo *f, int16_t *ptr, uint16_t len);
 struct mbuf *dss1_lite_l5_get_mbuf(struct dss1_lite *, struct dss1_lite_fifo *);
 uint8_t	dss1_lite_attach(struct dss1_lite *pdl, device_t dev, struct i4b_controller *ctrl, const struct dss1_lite_methods *mtod);
 void	dss1_lite_detach(struct dss1_lite *pdl);
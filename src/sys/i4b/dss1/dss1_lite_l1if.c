@@ -311,43 +311,63 @@ dss1_lite_trace_info(struct dss1_lite *pdl,
 }
 
 /*---------------------------------------------------------------------------*
- *	put sample to layer 5
+ *	put samples to layer 5
  *---------------------------------------------------------------------------*/
 void
-dss1_lite_l5_put_sample(struct dss1_lite *pdl,
-    struct dss1_lite_fifo *f, int32_t sample)
+dss1_lite_l5_put_samples(struct dss1_lite *pdl,
+    struct dss1_lite_fifo *f, const int16_t *ptr, uint16_t len)
 {
-	uint8_t temp;
+	i4b_convert_rev_t *convert_rev;
+	uint8_t *dst;
+	uint16_t delta;
+	uint16_t x;
+
+	if (len == 0)
+		return;
 
-	f->m_tx_last_sample = sample;
+	f->m_tx_last_sample = ptr[len - 1];
 
 	if (f->prot_curr.protocol_1 == P_DISABLE)
 		return;
 
-	while (f->m_tx_curr_rem == 0) {
-		if (f->m_tx_curr != NULL) {
-			dss1_lite_l5_put_mbuf(pdl, f, f->m_tx_curr);
+	if (f->prot_curr.protocol_4 == BSUBPROT_G711_ALAW)
+		convert_rev = i4b_signed_to_alaw;
+	else
+		convert_rev = i4b_signed_to_ulaw;
+
+	while (len != 0) {
+
+		while (f->m_tx_curr_rem == 0) {
+			if (f->m_tx_curr != NULL) {
+				dss1_lite_l5_put_mbuf(pdl, f, f->m_tx_curr);
+			}
+			f->m_tx_curr = dss1_lite_l5_get_new_mbuf(pdl, f);
+			if (f->m_tx_curr == NULL)
+				return;
+			f->m_tx_curr_ptr = mtod(f->m_tx_curr, uint8_t *);
+			f->m_tx_curr_rem = f->m_tx_curr->m_len;
 		}
-		f->m_tx_curr = dss1_lite_l5_get_new_mbuf(pdl, f);
-		if (f->m_tx_curr == NULL)
-			return;
-		f->m_tx_curr_ptr = mtod(f->m_tx_curr, uint8_t *);
-		f->m_tx_curr_rem = f->m_tx_curr->m_len;
-	}
 
-	/* XXX optimise */
+		/* process as many samples as fit into the current mbuf */
 
-	if (f->prot_curr.protocol_4 == BSUBPROT_G711_ALAW) {
-		temp = i4b_signed_to_alaw(sample);
-	} else {
-		temp = i4b_signed_to_ulaw(sample);
-	}
+		delta = f->m_tx_curr_rem;
+		if (delta > len)
+			delta = len;
+
+		dst = f->m_tx_curr_ptr;
+
+		for (x = 0; x != delta; x++)
+			dst[x] = convert_rev(ptr[x]);
 #ifndef HAVE_NO_ECHO_CANCEL
-	if (f->prot_curr.u.transp.echo_cancel_enable)
-		i4b_echo_cancel_merge(f->echo_cancel, &temp, 1);
+		if (f->prot_curr.u.transp.echo_cancel_enable)
+			i4b_echo_cancel_merge(f->echo_cancel, dst, delta);
 #endif
-	*(f->m_tx_curr_ptr)++ = temp;
-	f->m_tx_curr_rem--;
+		f->m_tx_curr_ptr += delta;
+		f->m_tx_curr_rem -= delta;
+
+		ptr += delta;
+		len -= delta;
+	}
 }
 
 void
@@ -427,44 +447,66 @@ dss1_lite_l5_get_new_mbuf(struct dss1_lite *pdl, struct dss1_lite_fifo *f)
 }
 
 /*---------------------------------------------------------------------------*
- *	get sample from layer 5
+ *	get samples from layer 5
  *---------------------------------------------------------------------------*/
-int16_t
-dss1_lite_l5_get_sample(struct dss1_lite *pdl, struct dss1_lite_fifo *f)
+void
+dss1_lite_l5_get_samples(struct dss1_lite *pdl,
+    struct dss1_lite_fifo *f, int16_t *ptr, uint16_t len)
 {
-	int16_t retval;
-	uint8_t temp;
+	const int16_t *convert_fwd;
+	uint8_t *src;
+	uint16_t delta;
+	uint16_t x;
 
 	if (f->prot_curr.protocol_1 == P_DISABLE)
-		return (f->m_rx_last_sample);
+		goto repeat_last;
+
+	if (f->prot_curr.protocol_4 == BSUBPROT_G711_ALAW)
+		convert_fwd = i4b_alaw_to_signed;
+	else
+		convert_fwd = i4b_ulaw_to_signed;
 
-	while (f->m_rx_curr_rem == 0) {
-		if (f->m_rx_curr != NULL) {
-			f->m_rx_curr = m_free(f->m_rx_curr);
+	while (len != 0) {
+
+		while (f->m_rx_curr_rem == 0) {
+			if (f->m_rx_curr != NULL) {
+				f->m_rx_curr = m_free(f->m_rx_curr);
+			}
+			if (f->m_rx_curr == NULL)
+				f->m_rx_curr = dss1_lite_l5_get_mbuf(pdl, f);
+			if (f->m_rx_curr == NULL)
+				goto repeat_last;
+			f->m_rx_curr_ptr = mtod(f->m_rx_curr, uint8_t *);
+			f->m_rx_curr_rem = f->m_rx_curr->m_len;
 		}
-		if (f->m_rx_curr == NULL)
-			f->m_rx_curr = dss1_lite_l5_get_mbuf(pdl, f);
-		if (f->m_rx_curr == NULL)
-			return (f->m_rx_last_sample);
-		f->m_rx_curr_ptr = mtod(f->m_rx_curr, uint8_t *);
-		f->m_rx_curr_rem = f->m_rx_curr->m_len;
-	}
 
-	temp = *(f->m_rx_curr_ptr)++;
-	f->m_rx_curr_rem--;
+		/* process as many samples as the current mbuf holds */
 
-	/* XXX optimise */
+		delta = f->m_rx_curr_rem;
+		if (delta > len)
+			delta = len;
+
+		src = f->m_rx_curr_ptr;
+
+		f->m_rx_curr_ptr += delta;
+		f->m_rx_curr_rem -= delta;
 #ifndef HAVE_NO_ECHO_CANCEL
-	if (f->prot_curr.u.transp.echo_cancel_enable)
-		i4b_echo_cancel_feed(f->echo_cancel, &temp, 1);
+		if (f->prot_curr.u.transp.echo_cancel_enable)
+			i4b_echo_cancel_feed(f->echo_cancel, src, delta);
 #endif
-	if (f->prot_curr.protocol_4 == BSUBPROT_G711_ALAW) {
-		retval = i4b_alaw_to_signed[temp];
-	} else {
-		retval = i4b_ulaw_to_signed[temp];
+		for (x = 0; x != delta; x++)
+			ptr[x] = convert_fwd[src[x]];
+
+		f->m_rx_last_sample = ptr[delta - 1];
+
+		ptr += delta;
+		len -= delta;
 	}
-	f->m_rx_last_sample = retval;
-	return (retval);
+	return;
+
+repeat_last:
+	while (len--)
+		*ptr++ = (int16_t)f->m_rx_last_sample;
 }
 
 void
@@ -554,7 +596,11 @@ dss1_lite_l1_setup(fifo_translator_t *ft, struct i4b_protocol *p)
 
 	} else if (p->protocol_1 != P_DISABLE) {
 #ifndef HAVE_NO_ECHO_CANCEL
-		i4b_echo_cancel_init(f->echo_cancel, 0, f->prot_curr.protocol_4);
+		i4b_echo_cancel_init(f->echo_cancel, pdl->dl_ec_scratch,
+		    0, f->prot_curr.protocol_4);
+		i4b_echo_cancel_set_mode(f->echo_cancel,
+		    f->prot_curr.u.transp.echo_cancel_mode,
+		    f->echo_cancel_part);
 #endif
 		/* init DTMF detector and generator */
 		i4b_dtmf_init_rx(ft, f->prot_curr.protocol_4);
@@ -0,0 +1,164 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *---------------------------------------------------------------------------
+ *
+ *	i4b_capi_ioctl.h - I4B extensions to the /dev/capi20 interface
+ *	--------------------------------------------------------------
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef _I4B_CAPI_IOCTL_H_
+#define _I4B_CAPI_IOCTL_H_
+
+/*---------------------------------------------------------------------------*
+ *	enable or disable batched read and write
+ *
+ * When enabled, a single read() or write() transfers any number of
+ * CAPI messages. Each message is preceded by a 16-bit little endian
+ * length, which covers the CAPI message and any DATA_B3 payload
+ * following it, but not the length field itself. read() returns as
+ * many complete messages as fit into the buffer, but always at least
+ * one. If the next message does not fit, read() fails with EMSGSIZE.
+ * write() processes the messages in order, and stops at the first
+ * message that fails.
+ *---------------------------------------------------------------------------*/
+#define	I4B_CAPI_BATCH_HDR_SIZE	2	/* bytes */
+
+#define	I4B_CAPI_SET_BATCH	_IOW('B', 1, uint32_t)	/* 0 = off, 1 = on */
+#define	I4B_CAPI_GET_BATCH	_IOR('B', 2, uint32_t)
+
+/*---------------------------------------------------------------------------*
+ *	shared memory for DATA_B3 payloads
+ *
+ * I4B_CAPI_SHM_SETUP allocates a memory region for the B-channel
+ * data of an application, which is then mapped using mmap() at
+ * offset zero. CAPI_REGISTER_REQ must be done first. The number of
+ * slots per direction is "max_logical_connections" multiplied by
+ * "max_b_data_blocks", rounded up to a power of two, and the slot
+ * size is "max_b_data_len". The region cannot be resized or freed
+ * until the application is closed.
+ *
+ * Receive: The kernel copies the payload of each DATA_B3_IND into
+ * the slot selected by "rx_head", fills out the descriptor having
+ * the same index and then increments "rx_head". The DATA_B3_IND is
+ * not passed through read(), and no DATA_B3_RESP is needed. The
+ * application consumes the slot selected by "rx_tail" and then
+ * increments "rx_tail". When the ring is full, frames are dropped
+ * and "rx_dropped" is incremented. poll() reports POLLRDBAND and
+ * the EVFILT_READ filter of kqueue() triggers while the ring is not
+ * empty. The "data" field of the kevent is the number of messages
+ * queued for read() plus the number of used receive slots.
+ *
+ * Transmit: The application copies the payload into a free
+ * transmit slot and writes a DATA_B3_REQ without payload, where
+ * the Data field is the offset of the slot from the start of the
+ * region. The payload is copied out of the slot by write(), so the
+ * slot can be reused as soon as write() returns. The DATA_B3_CONF
+ * is not needed for that.
+ *
+ * All other CAPI messages still use read() and write().
+ *---------------------------------------------------------------------------*/
+#define	I4B_CAPI_SHM_MAGIC	0x49344253	/* "I4BS" */
+#define	I4B_CAPI_SHM_SLOT_MAX	1024		/* slots per direction */
+
+struct i4b_capi_shm_desc {
+	uint32_t dwCid;			/* NCCI */
+	uint16_t wLen;			/* bytes of data in slot */
+	uint16_t wFlags;		/* DATA_B3_IND flags */
+	uint16_t wHandle;
+	uint16_t wUnused;
+	uint32_t dwUnused;
+};
+
+struct i4b_capi_shm_header {
+	uint32_t magic;
+	uint32_t size;			/* bytes, whole region */
+	uint32_t slot_count;		/* per direction */
+	uint32_t slot_size;		/* bytes */
+	uint32_t rx_desc_offset;	/* bytes, from start of region */
+	uint32_t rx_slot_offset;	/* bytes, from start of region */
+	uint32_t tx_slot_offset;	/* bytes, from start of region */
+	uint32_t unused_0;
+
+	volatile uint32_t rx_head;	/* written by the kernel */
+	volatile uint32_t rx_tail;	/* written by the application */
+	volatile uint32_t rx_dropped;	/* written by the kernel */
+	uint32_t unused_1[5];
+};
+
+struct i4b_capi_shm_setup {
+	uint32_t size;			/* bytes, to pass to mmap() */
+	uint32_t slot_count;
+	uint32_t slot_size;
+	uint32_t unused;
+};
+
+#define	I4B_CAPI_SHM_SETUP	_IOR('B', 3, struct i4b_capi_shm_setup)
+
+/*---------------------------------------------------------------------------*
+ *	coalescing of DATA_B3 indications and confirmations
+ *
+ * "rx_delay" enables coalescing of received transparent B-channel
+ * data. Consecutive blocks are joined into a single DATA_B3_IND of
+ * up to "max_b_data_len" bytes, but are held back no longer than
+ * "rx_delay" milliseconds after the first block. The delay is
+ * checked when the next block is received, which on a connected
+ * transparent B-channel happens at a steady rate. HDLC frames are
+ * never joined.
+ *
+ * "conf_max" enables batching of DATA_B3_CONF messages. Up to
+ * "conf_max" confirmations are held back and then queued
+ * together. "conf_max" is limited to half of "max_b_data_blocks",
+ * so that the application has time to refill the transmit window.
+ * Confirmations are never held back when there is no more data to
+ * send.
+ *
+ * The settings apply to connections established after the
+ * IOCTL, and should be set after CAPI_REGISTER_REQ.
+ *---------------------------------------------------------------------------*/
+#define	I4B_CAPI_RX_DELAY_MAX	100	/* ms */
+
+struct i4b_capi_coalesce {
+	uint32_t rx_delay;		/* ms, 0 = off */
+	uint32_t conf_max;		/* messages, 0 = off */
+};
+
+#define	I4B_CAPI_SET_COALESCE	_IOW('B', 4, struct i4b_capi_coalesce)
+#define	I4B_CAPI_GET_COALESCE	_IOR('B', 5, struct i4b_capi_coalesce)
+
+/*---------------------------------------------------------------------------*
+ *	echo canceller mode
+ *
+ * Selects the echo canceller engine used when echo cancellation is
+ * enabled through the CAPI facility, I4B_ECHO_CANCEL_MODE_BLOCK or
+ * I4B_ECHO_CANCEL_MODE_PART. The partitioned mode has a lower delay
+ * and needs more memory, and falls back to the block mode when that
+ * memory is not available. The setting applies to connections
+ * established after the IOCTL.
+ *---------------------------------------------------------------------------*/
+#define	I4B_CAPI_SET_EC_MODE	_IOW('B', 6, uint32_t)
+#define	I4B_CAPI_GET_EC_MODE	_IOR('B', 7, uint32_t)
+
+#endif /* _I4B_CAPI_IOCTL_H_ */
@@ -0,0 +1,129 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *---------------------------------------------------------------------------
+ *
+ *	i4b_capiserver.h - CAPI over TCP protocol
+ *	-----------------------------------------
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef _I4B_CAPISERVER_H_
+#define	_I4B_CAPISERVER_H_
+
+/*---------------------------------------------------------------------------*
+ *	frame format
+ *
+ * Each frame starts with a 4 byte header: the 16-bit little endian
+ * length of the data following the header, the command and an error
+ * code, which is only used in answers. All multi-byte values are
+ * little endian. The server silently ignores unknown commands.
+ *---------------------------------------------------------------------------*/
+#define	CAPISERVER_HDR_SIZE 4		/* bytes */
+#define	CAPISERVER_FRAME_MAX 0xFFFF	/* bytes, excluding header */
+
+/* define supported commands */
+enum {
+	CAPISERVER_CMD_CAPI_MSG,
+	CAPISERVER_CMD_CAPI_REGISTER,
+	CAPISERVER_CMD_CAPI_MANUFACTURER,
+	CAPISERVER_CMD_CAPI_VERSION,
+	CAPISERVER_CMD_CAPI_SERIAL,
+	CAPISERVER_CMD_CAPI_PROFILE,
+	CAPISERVER_CMD_CAPI_START,
+	/* protocol version 2 */
+	CAPISERVER_CMD_HELLO,
+	CAPISERVER_CMD_CAPI_MULTI,
+	CAPISERVER_CMD_CAPI_DEFLATE,
+	CAPISERVER_CMD_CAPI_REGISTER_ID,
+	CAPISERVER_CMD_CAPI_MANUFACTURER_ID,
+	CAPISERVER_CMD_CAPI_VERSION_ID,
+	CAPISERVER_CMD_CAPI_SERIAL_ID,
+	CAPISERVER_CMD_CAPI_PROFILE_ID,
+	CAPISERVER_CMD_CAPI_START_ID,
+};
+
+#define	CAPISERVER_CMD_HAS_REQID(cmd) \
+	((cmd) >= CAPISERVER_CMD_CAPI_REGISTER_ID && \
+	(cmd) <= CAPISERVER_CMD_CAPI_START_ID)
+
+/*---------------------------------------------------------------------------*
+ *	protocol version 2
+ *
+ * The client selects protocol version 2 by sending a HELLO frame
+ * containing a "struct capiserver_hello" with the highest version
+ * and the features it supports. The server answers with a HELLO
+ * frame containing the version and the features to use from then
+ * on, which is a subset of the requested ones. A server which only
+ * knows version 1 ignores the HELLO frame and all the other
+ * commands of version 2.
+ *
+ * The commands of version 1 are never changed by version 2, and
+ * may be sent right after the HELLO frame, without waiting for the
+ * answer. If the first answer received is not a HELLO frame,
+ * version 1 is in use. The client must not send any command of
+ * version 2, other than HELLO, before it has received the HELLO
+ * answer, and only for the features selected by the server. The
+ * server does not use any feature before it has sent the HELLO
+ * answer.
+ *
+ * CAPISERVER_FEATURE_MULTI: the CAPI_MULTI frame carries any
+ * number of CAPI messages, each preceded by its 16-bit length, in
+ * both directions. The server may still send single CAPI_MSG
+ * frames.
+ *
+ * CAPISERVER_FEATURE_REQID: the CAPI_REGISTER_ID up to and
+ * including the CAPI_START_ID requests are the same as the
+ * requests of version 1 without the "_ID" suffix, except that
+ * they start with a 32-bit request ID chosen by the client. The ID
+ * is copied to the start of the answer, also when the request
+ * fails. Requests are processed in order, so several of them may
+ * be sent without waiting for the answers.
+ *
+ * CAPISERVER_FEATURE_DEFLATE: the CAPI_DEFLATE frame carries one
+ * DATA_B3 message, with the B-channel data following the message
+ * replaced by its 16-bit length and the data compressed using
+ * zlib. Compression is only used when the result is smaller.
+ *---------------------------------------------------------------------------*/
+#define	CAPISERVER_VERSION_1	1
+#define	CAPISERVER_VERSION_2	2
+
+#define	CAPISERVER_FEATURE_MULTI	0x0001
+#define	CAPISERVER_FEATURE_REQID	0x0002
+#define	CAPISERVER_FEATURE_DEFLATE	0x0004
+
+#define	CAPISERVER_REQID_SIZE	4	/* bytes */
+#define	CAPISERVER_MULTI_HDR_SIZE 2	/* bytes */
+
+/* the CAPI message header, needed to find DATA_B3 messages */
+#define	CAPISERVER_CAPI_HDR_SIZE 8	/* bytes */
+#define	CAPISERVER_CAPI_CMD_OFFSET 4	/* byte offset of the command */
+#define	CAPISERVER_CAPI_DATA_B3	0x86
+
+struct capiserver_hello {
+	uint32_t version;
+	uint32_t features;
+};
+
+#endif /* _I4B_CAPISERVER_H_ */
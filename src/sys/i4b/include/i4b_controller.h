@@ -67,15 +67,13 @@ struct mbuf;
 /*---------------------------------------------------------------------------*
  *	definition of DTMF detector
  *---------------------------------------------------------------------------*/
-#define	I4B_DTMF_N_FREQ 18		/* must be even */
+#define	I4B_DTMF_N_FREQ 18		/* units */
 #define	I4B_DTMF_N_SAMPLES 102		/* 12.75ms */
 #define	I4B_DTMF_N_DIGITS 32		/* units, max */
+#define	I4B_DTMF_N_BATCH 4		/* channels per detector pass, max */
 
 struct i4b_dtmf_info_rx {
-	int32_t	w0[I4B_DTMF_N_FREQ];
-	int32_t	w1[I4B_DTMF_N_FREQ];
-
-	uint8_t buffer[I4B_DTMF_N_SAMPLES];
+	uint8_t buffer[2 * I4B_DTMF_N_SAMPLES];
 	uint8_t count;
 	uint8_t code;
 	uint8_t code_count;
@@ -99,6 +97,55 @@ struct i4b_dtmf_info_tx {
 	uint8_t unused;
 };
 
+/*---------------------------------------------------------------------------*
+ *	mbuf pool definition
+ *
+ * Frame sized mbufs with a cluster, that are freed by layer 1 after
+ * transmission, are kept here and reused for the next receive
+ * allocation, instead of going through the system allocator. The
+ * pool is protected by the controller lock.
+ *---------------------------------------------------------------------------*/
+struct i4b_mbuf_pool {
+	struct mtx *mtx;
+	struct mbuf *free;		/* linked by "m_nextpkt" */
+	uint16_t count;			/* mbufs on the free list */
+
+	uint64_t hits;			/* allocations from the pool */
+	uint64_t misses;		/* allocations from the system */
+	uint64_t recycled;		/* mbufs put on the free list */
+	uint64_t dropped;		/* mbufs given back to the system */
+};
+
+/*---------------------------------------------------------------------------*
+ *	mbuf ring definition
+ *
+ * Single producer, single consumer ring of mbufs. Only the producer
+ * writes "head" and only the consumer writes "tail", so that mbufs
+ * can be passed between layer 1, which runs under the controller
+ * lock, and a layer 5 user, which does not take the controller
+ * lock. The producer and the consumer side must each be serialized
+ * by the caller.
+ *---------------------------------------------------------------------------*/
+struct i4b_mbuf_ring {
+	volatile uint32_t head;		/* next slot to fill */
+	volatile uint32_t tail;		/* next slot to empty */
+	volatile uint32_t idle;		/* set when consumer found
+					 * the ring empty
+					 */
+	uint32_t full;			/* enqueue found the ring full */
+	struct mbuf *ring[I4B_MBUF_RING_MAX];
+};
+
+#define	I4B_MBUF_RING_COUNT(r)			\
+  (atomic_load_acq_32(&(r)->head) -		\
+   atomic_load_acq_32(&(r)->tail))
+
+#define	I4B_MBUF_RING_EMPTY(r)			\
+  (I4B_MBUF_RING_COUNT(r) == 0)
+
+#define	I4B_MBUF_RING_FULL(r)			\
+  (I4B_MBUF_RING_COUNT(r) >= I4B_MBUF_RING_MAX)
+
 /*---------------------------------------------------------------------------*
  *	fifo-translator definition
  *---------------------------------------------------------------------------*/
@@ -164,6 +211,9 @@ typedef struct fifo_translator {
 	uint32_t refcount;
 	struct mtx *mtx;
 
+	/* mbuf pool of the controller */
+	struct i4b_mbuf_pool *mbuf_pool;
+
 	struct _ifqueue tx_queue;
 	struct _ifqueue rx_queue;
 
@@ -331,6 +381,8 @@ typedef struct i4b_controller {
 	struct mtx L1_lock_data;
 	struct mtx *L1_lock_ptr;
 
+	struct i4b_mbuf_pool mbuf_pool;	/* drained on reset */
+
 	uint8_t dummy_zero_start[0];
 
 	uint8_t allocated:1;		/* set if controller is allocated */
@@ -417,6 +469,9 @@ GET_BIT((cntl)->N_channel_utilization,channel)	\
 	struct call_desc *N_call_desc_start;
 	struct call_desc *N_call_desc_end;
 
+	/* call descriptors by call reference, see "cd_set_cr()" */
+	struct call_desc *N_cr_hash[I4B_CR_HASH_MAX];
+
 #define	CD_FOREACH(cd,cntl)			\
   for((cd) = (cntl)->N_call_desc_start;		\
       (cd) < (cntl)->N_call_desc_end;		\
@@ -509,6 +564,14 @@ enum {
 	/* DTMF detection */
 	CMR_ENABLE_DTMF_DETECT,
 	CMR_DISABLE_DTMF_DETECT,
+
+	/* poll statistics */
+	CMR_GET_POLLSTAT,
+	CMR_CLR_POLLSTAT,
+
+	/* FIFO statistics */
+	CMR_GET_FIFOSTAT,
+	CMR_CLR_FIFOSTAT,
 };
 
 typedef uint32_t L1_auto_activate_t;
@@ -549,12 +612,17 @@ extern void i4b_dtmf_generate(struct fifo_translator *ft, struct mbuf **pp_m);
 extern uint16_t i4b_sqrt_32(uint32_t a);
 
 extern void i4b_dtmf_detect(struct fifo_translator *ft, uint8_t *data_ptr, uint16_t data_len);
+extern void i4b_dtmf_collect(struct fifo_translator *ft, uint8_t *data_ptr, uint16_t data_len);
+extern void i4b_dtmf_detect_pending(struct fifo_translator *ft);
+extern void i4b_dtmf_detect_batch(struct fifo_translator **ftp, uint16_t num);
 
 /* prototypes from i4b_echo_cancel.c */
 
 #define	I4B_ECHO_CANCEL_P_PRE	   (13 - I4B_ECHO_CANCEL_P_COMPLEX)
 #define	I4B_ECHO_CANCEL_N_PRE      (1 << I4B_ECHO_CANCEL_P_PRE)
-#define	I4B_ECHO_CANCEL_P_COMPLEX  (10)	/* bits */
+#ifndef I4B_ECHO_CANCEL_P_COMPLEX
+#define	I4B_ECHO_CANCEL_P_COMPLEX  (10)	/* bits, 8..11 */
+#endif
 #define	I4B_ECHO_CANCEL_N_COMPLEX  (1 << I4B_ECHO_CANCEL_P_COMPLEX)
 #define	I4B_ECHO_CANCEL_N_TAPS     (I4B_ECHO_CANCEL_N_COMPLEX / 2)
 #define	I4B_ECHO_CANCEL_SAMPLE_MAX (0x7FC0)	/* units */
@@ -566,6 +634,13 @@ extern void i4b_dtmf_detect(struct fifo_translator *ft, uint8_t *data_ptr, uint1
 				I4B_ECHO_CANCEL_T_MAX)	/* samples */
 #define	I4B_ECHO_CANCEL_W_SUB      (1)	/* units */
 
+/* partitioned mode, see "i4b_echo_cancel_set_mode()": */
+#define	I4B_ECHO_CANCEL_P_PART     (6)	/* bits */
+#define	I4B_ECHO_CANCEL_N_PART     (1 << I4B_ECHO_CANCEL_P_PART)	/* samples */
+#define	I4B_ECHO_CANCEL_N_PART_COMPLEX (2 * I4B_ECHO_CANCEL_N_PART)
+#define	I4B_ECHO_CANCEL_K_PART     (I4B_ECHO_CANCEL_N_TAPS / \
+				    I4B_ECHO_CANCEL_N_PART)	/* partitions */
+
 /* coefficient decimal point in time domain: */
 #define	I4B_ECHO_CANCEL_P_HR_DP  (2*I4B_ECHO_CANCEL_P_COMPLEX)
 #define	I4B_ECHO_CANCEL_N_HR_DP  (1 << I4B_ECHO_CANCEL_P_HR_DP)
@@ -575,12 +650,36 @@ struct i4b_complex {
 	int32_t	y;
 };
 
+/*
+ * The FFT scratch buffer can be shared by all echo cancellers
+ * that are never run at the same time, for example all channels
+ * of a controller, protected by the same mutex.
+ */
+struct i4b_echo_cancel_scratch {
+	struct i4b_complex buf_EC[I4B_ECHO_CANCEL_N_COMPLEX];
+};
+
+/*
+ * The delay line of the partitioned mode is only needed while that
+ * mode is selected, see "i4b_echo_cancel_set_mode()".
+ */
+struct i4b_echo_cancel_part {
+	struct i4b_complex buf_XP[I4B_ECHO_CANCEL_K_PART - 1]
+	[I4B_ECHO_CANCEL_N_PART + 1];
+};
+
 struct i4b_echo_cancel {
 
 	uint8_t	zero_start[0];
 
-	struct i4b_complex buf_HC[I4B_ECHO_CANCEL_N_COMPLEX];	/* background echo
-								 * filter */
+	union {
+		/* background echo filter, folded */
+		struct i4b_complex buf_HC[I4B_ECHO_CANCEL_N_TAPS + 1];
+
+		/* filter tail partitions, in partitioned mode */
+		struct i4b_complex buf_HP[I4B_ECHO_CANCEL_K_PART - 1]
+		[I4B_ECHO_CANCEL_N_PART + 1];
+	}	u;
 
 	int32_t	buf_HR[I4B_ECHO_CANCEL_W_SUB][I4B_ECHO_CANCEL_N_TAPS];
 	int32_t	buf_E0[I4B_ECHO_CANCEL_N_TAPS];
@@ -594,11 +693,13 @@ struct i4b_echo_cancel {
 
 	uint8_t	adapt;
 	uint8_t	active;
+	uint8_t	offset_p;		/* newest entry in part->buf_XP[] */
 
 	uint8_t	zero_end[0];
 
-	struct i4b_complex buf_EC[I4B_ECHO_CANCEL_N_COMPLEX];
-	struct i4b_complex buf_XC[I4B_ECHO_CANCEL_N_COMPLEX];
+	struct i4b_complex *buf_EC;	/* shared scratch buffer */
+	struct i4b_echo_cancel_part *part; /* partitioned mode only */
+	struct i4b_complex buf_XC[I4B_ECHO_CANCEL_N_TAPS + 1];	/* folded */
 
 	int32_t	low_pass_1;
 	int32_t	low_pass_2;
@@ -612,23 +713,28 @@ struct i4b_echo_cancel {
 
 	uint16_t pre_delay;		/* pre delay length in sample units */
 	uint16_t offset_e;		/* input echo offset for ring buffer 3 */
+	uint16_t phase;			/* block phase in sample units */
 
 	uint16_t rx_time;
 	uint16_t tx_time;
 
 	int16_t	offset_adjust;
 
-	/* copy of transmitted data */
+	/* copy of transmitted data, the upper half mirrors the lower half */
 	int16_t	buf_X0[2 * I4B_ECHO_CANCEL_F_SIZE];
 
 	uint8_t	is_ulaw;
 	uint8_t	last_byte;
+	uint8_t	mode;			/* I4B_ECHO_CANCEL_MODE_XXX */
 };
 
-extern void i4b_echo_cancel_init(struct i4b_echo_cancel *ec, uint16_t pre_delay, uint8_t sub_bprot);
+extern void i4b_echo_cancel_init(struct i4b_echo_cancel *ec, struct i4b_echo_cancel_scratch *scratch, uint16_t pre_delay, uint8_t sub_bprot);
+extern void i4b_echo_cancel_set_phase(struct i4b_echo_cancel *ec, uint16_t phase);
+extern void i4b_echo_cancel_set_mode(struct i4b_echo_cancel *ec, uint8_t mode, struct i4b_echo_cancel_part *part);
 extern void i4b_echo_cancel_update_feeder(struct i4b_echo_cancel *ec, uint16_t tx_time);
 extern void i4b_echo_cancel_feed(struct i4b_echo_cancel *ec, uint8_t *ptr, uint16_t len);
 extern void i4b_echo_cancel_update_merger(struct i4b_echo_cancel *ec, uint16_t rx_time);
 extern void i4b_echo_cancel_merge(struct i4b_echo_cancel *ec, uint8_t *read_ptr, uint16_t read_len);
+extern uint8_t i4b_echo_cancel_precompute(struct i4b_echo_cancel *ec);
 
 #endif					/* _I4B_CONTROLLER_H_ */
@@ -335,4 +335,80 @@ typedef struct {
 
 #define I4B_CTL_GET_EC_FIR_FILTER   _IOWR('C',26, i4b_ec_debug_t)
 
+/*---------------------------------------------------------------------------*
+ *	I4B poll statistics IOCTL structure
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+	uint64_t interrupts;	 /* hardware interrupts */
+	uint64_t polls;		 /* poll timer expirations */
+	uint64_t wakeups;	 /* interrupt handler runs */
+	uint64_t fifo_runs;	 /* FIFO programs called */
+	uint64_t fifo_loops;	 /* FIFO programs that looped */
+	uint64_t quota_exceeded; /* FIFO loop quota exhausted */
+} pollstat_t;
+
+typedef struct {
+	uint32_t unit;
+	uint32_t hz;		 /* ticks per second */
+	uint32_t poll_delay;	 /* current poll delay in ticks */
+	uint32_t poll_delay_max; /* maximum poll delay in ticks */
+	pollstat_t pollstat;
+} i4b_poll_debug_t;
+
+#define I4B_CTL_GET_POLLSTAT        _IOWR('C',27, i4b_poll_debug_t)
+#define I4B_CTL_CLR_POLLSTAT        _IOW ('C',28, i4b_poll_debug_t)
+
+/*---------------------------------------------------------------------------*
+ *	I4B FIFO statistics IOCTL structure
+ *
+ *	Histogram bucket zero counts zero values. Bucket "n" counts
+ *	values from 2**(n-1) inclusive to 2**n exclusive. The last
+ *	bucket also counts all larger values. Service intervals are
+ *	counted in units of 125us, which is one byte at 8kHz.
+ *---------------------------------------------------------------------------*/
+
+#define I4B_FIFOSTAT_HIST_MAX 16
+
+typedef struct {
+	uint32_t services;	 /* FIFO program runs */
+	uint32_t bytes;		 /* bytes transferred */
+	uint32_t overruns;	 /* receive overruns (RFO) */
+	uint32_t underruns;	 /* transmit underruns (XDU) */
+	uint32_t quota_exceeded; /* FIFO loop quota exhausted */
+	uint32_t interval_max;	 /* longest interval between services in us */
+	uint32_t unused0;
+	uint32_t unused1;
+	uint32_t interval_hist[I4B_FIFOSTAT_HIST_MAX];
+	uint32_t bytes_hist[I4B_FIFOSTAT_HIST_MAX]; /* bytes per service */
+} fifostat_t;
+
+typedef struct {
+	uint32_t unit;
+	uint32_t chan;
+	fifostat_t rx;
+	fifostat_t tx;
+} i4b_fifo_debug_t;
+
+#define I4B_CTL_GET_FIFOSTAT        _IOWR('C',29, i4b_fifo_debug_t)
+#define I4B_CTL_CLR_FIFOSTAT        _IOW ('C',30, i4b_fifo_debug_t)
+
+/*---------------------------------------------------------------------------*
+ *	I4B mbuf pool statistics IOCTL structure
+ *---------------------------------------------------------------------------*/
+
+typedef struct {
+	uint32_t unit;
+	uint32_t count;		/* mbufs currently in the pool */
+	uint32_t count_max;	/* pool size limit */
+	uint32_t unused;
+	uint64_t hits;		/* allocations served from the pool */
+	uint64_t misses;	/* allocations passed to the system */
+	uint64_t recycled;	/* mbufs returned to the pool */
+	uint64_t dropped;	/* mbufs passed to the system */
+} i4b_mbuf_debug_t;
+
+#define I4B_CTL_GET_MBUFSTAT        _IOWR('C',31, i4b_mbuf_debug_t)
+#define I4B_CTL_CLR_MBUFSTAT        _IOW ('C',32, i4b_mbuf_debug_t)
+
 #endif /* _I4B_DEBUG_H_ */
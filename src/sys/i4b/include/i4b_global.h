@@ -121,6 +121,13 @@ extern void i4b_accounting_timeout(struct i4b_accounting *sc);
 #endif
 
 struct mbuf *i4b_getmbuf( int, int );
+struct mbuf *i4b_mbuf_pool_get(struct i4b_mbuf_pool *pool, int len);
+void i4b_mbuf_pool_put(struct i4b_mbuf_pool *pool, struct mbuf *m);
+void i4b_mbuf_pool_drain(struct i4b_mbuf_pool *pool);
+int i4b_mbuf_ring_enqueue(struct i4b_mbuf_ring *r, struct mbuf *m);
+struct mbuf *i4b_mbuf_ring_dequeue(struct i4b_mbuf_ring *r);
+uint8_t i4b_mbuf_ring_idle(struct i4b_mbuf_ring *r);
+void i4b_mbuf_ring_drain(struct i4b_mbuf_ring *r);
 
 /*---------------------------------------------------------------------------*
  *	I4B-line-interconnect structure
@@ -161,6 +168,7 @@ typedef struct call_desc {
 	void *  pipe;			/* ISDN controller pipe */
 
 	uint32_t cr;			/* call reference value	*/
+	struct call_desc *cr_hash_next;	/* see "cd_set_cr()" */
 
 	int	channel_id;		/* channel id value cannot be 
 					 * changed when channel is allocated
@@ -176,6 +184,13 @@ typedef struct call_desc {
 
 	uint16_t curr_max_packet_size;  /* used by CAPI */
 	uint16_t new_max_packet_size;   /* used by CAPI */
+
+	struct mbuf *capi_rx_pending;	/* used by CAPI, coalesced data */
+	uint32_t capi_rx_ticks;		/* used by CAPI, start of coalescing */
+	uint32_t capi_rx_delay;		/* used by CAPI, ticks, 0 = off */
+	uint16_t capi_rx_len;		/* used by CAPI, bytes pending */
+	uint16_t capi_conf_max;		/* used by CAPI, 0 = off */
+	struct _ifqueue capi_conf_queue; /* used by CAPI, deferred confirms */
 	
 	cause_t	cause_in;		/* cause value from remote */
 	cause_t	cause_out;		/* cause value to remote */
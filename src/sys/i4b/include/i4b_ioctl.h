@@ -191,6 +191,9 @@ struct i4b_protocol {
         struct {
 	    uint8_t  echo_cancel_enable;
 	    uint8_t  dtmf_detect_enable;
+	    uint8_t  echo_cancel_mode;
+#define I4B_ECHO_CANCEL_MODE_BLOCK 0 /* whole blocks of N_TAPS samples */
+#define I4B_ECHO_CANCEL_MODE_PART  1 /* partitions of N_PART samples */
 	} transp;
     } u;
 };
@@ -77,12 +77,15 @@
  *---------------------------------------------------------------------------*/
 #define	BCH_MAX_DATALEN	2048		/* max length of a B channel frame */
 #define	DCH_MAX_DATALEN  264		/* max length of a D channel frame */
+#define	I4B_MBUF_POOL_MAX 32		/* max recycled mbufs per controller */
+#define	I4B_MBUF_RING_MAX 64		/* mbufs per ring, power of two */
 
 /*---------------------------------------------------------------------------*
  *	call descriptor id (cdid) definitions
  *---------------------------------------------------------------------------*/
 #define	CDID_REF_MAX    0x100		/* exclusive */
 #define	CDID_MAX        (CDID_REF_MAX * I4B_MAX_CONTROLLERS)	/* exclusive */
+#define	I4B_CR_HASH_MAX 16		/* call reference hash buckets, power of two */
 
 /*---------------------------------------------------------------------------*
  *	driver count definitions
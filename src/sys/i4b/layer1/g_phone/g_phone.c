@@ -292,6 +292,8 @@ g_phone_isoc_read_callback(struct usb_xfer *xfer, usb_error_t error)
 	uint16_t i;
 	uint16_t j;
 	uint16_t k;
+	uint16_t n;
+	int16_t temp;
 
 	switch (USB_GET_STATE(xfer)) {
 	case USB_ST_TRANSFERRED:
@@ -300,21 +302,28 @@ g_phone_isoc_read_callback(struct usb_xfer *xfer, usb_error_t error)
 
 		buf = usbd_xfer_get_priv(xfer);
 
+		temp = f->m_tx_last_sample;
+		n = 0;
+
 		for (i = 0; i != G_PHONE_MINFRAMES; i++) {
 
 			k = usbd_xfer_frame_len(xfer, i) & -2UL;
 
 			for (j = 0; j < k; j += 2) {
-				dss1_lite_l5_put_sample(&sc->sc_dl, f, (int16_t)UGETW(buf + j));
+				temp = UGETW(buf + j);
+				sc->sc_samples[n++] = temp;
 			}
 
+			/* repeat last sample for short frames */
 			for (; j < G_PHONE_BPF; j += 2) {
-				dss1_lite_l5_put_sample(&sc->sc_dl, f, (int16_t)f->m_tx_last_sample);
+				sc->sc_samples[n++] = temp;
 			}
 
 			buf += G_PHONE_BPF;
 		}
 
+		dss1_lite_l5_put_samples(&sc->sc_dl, f, sc->sc_samples, n);
+
 		dss1_lite_l5_put_sample_complete(&sc->sc_dl, f);
 
 		if (sc->sc_hook_off == 0 && f->m_tx_last_sample != 0)
@@ -353,7 +362,6 @@ g_phone_isoc_write_callback(struct usb_xfer *xfer, usb_error_t error)
 	struct dss1_lite_fifo *f = &sc->sc_dl.dl_fifo[sc->sc_dl.dl_audio_channel];
 	uint8_t *buf;
 	uint16_t i;
-	uint16_t temp;
 	uint16_t timestamp = (usbd_xfer_get_timestamp(xfer) * 8) + (G_PHONE_MINFRAMES * 8 * 2);
 
 	switch (USB_GET_STATE(xfer)) {
@@ -362,9 +370,11 @@ g_phone_isoc_write_callback(struct usb_xfer *xfer, usb_error_t error)
 tr_setup:
 		buf = usbd_xfer_get_priv(xfer);
 
+		dss1_lite_l5_get_samples(&sc->sc_dl, f,
+		    sc->sc_samples, G_PHONE_BUFSIZE / 2);
+
 		for (i = 0; i != G_PHONE_BUFSIZE; i += 2) {
-			temp = dss1_lite_l5_get_sample(&sc->sc_dl, f);
-			USETW(buf + i, temp);
+			USETW(buf + i, sc->sc_samples[i / 2]);
 		}
 
 		dss1_lite_l5_get_sample_complete(&sc->sc_dl, f);
@@ -71,6 +71,7 @@ struct g_phone_softc {
 	struct usb_xfer *sc_xfer[G_PHONE_XFER_MAX];
 
 	uint8_t	sc_buffer[G_PHONE_BUFSIZE * 4];
+	int16_t	sc_samples[G_PHONE_BUFSIZE / 2];	/* protected by sc_pmtx */
 
 	uint8_t	sc_command_data[G_PHONE_PKT_LEN];
 	uint8_t	sc_mute_setting[1];
@@ -3249,12 +3249,193 @@ i4b_sine_to_signed[8000] = {
     -205,   -180,   -154,   -128,   -102,    -77,    -51,    -25, 
 };
 
+/* NOTE: table index and value are bit-reversed */
+
+static const uint8_t __i4b_alaw_to_ulaw[0x100] = {
+  0x94, 0x95, 0x46, 0x47, 0x50, 0x51, 0x12, 0x13, 
+  0x9c, 0x9d, 0x2e, 0x2f, 0x58, 0x59, 0x6a, 0x6b, 
+  0x84, 0x85, 0xba, 0xbb, 0x40, 0x41, 0x02, 0x03, 
+  0x8c, 0x8d, 0x56, 0x57, 0x48, 0x49, 0xf2, 0xf3, 
+  0xb4, 0xb5, 0x66, 0x67, 0x70, 0x71, 0x32, 0x33, 
+  0xbc, 0xbd, 0x3e, 0x3f, 0x78, 0x79, 0x5a, 0x5b, 
+  0xa4, 0xa5, 0xfa, 0xfb, 0x60, 0x61, 0x22, 0x23, 
+  0xac, 0xad, 0x76, 0x77, 0x68, 0x69, 0x4a, 0x4b, 
+  0xe4, 0xe5, 0x06, 0x07, 0x10, 0x11, 0x62, 0x63, 
+  0xec, 0xed, 0x0e, 0x0f, 0x18, 0x19, 0x2a, 0x2b, 
+  0xf8, 0xf9, 0x3a, 0x3b, 0x00, 0x01, 0xfc, 0xfd, 
+  0xf4, 0xf5, 0x16, 0x17, 0x08, 0x09, 0x72, 0x73, 
+  0xd4, 0xd5, 0x26, 0x27, 0x30, 0x31, 0x52, 0x53, 
+  0xdc, 0xdd, 0x1e, 0x1f, 0x38, 0x39, 0x1a, 0x1b, 
+  0xc4, 0xc5, 0x7a, 0x7b, 0x20, 0x21, 0x42, 0x43, 
+  0xcc, 0xcd, 0x36, 0x37, 0x28, 0x29, 0x0a, 0x0b, 
+  0x54, 0x55, 0xc6, 0xc7, 0xd0, 0xd1, 0x92, 0x93, 
+  0x5c, 0x5d, 0x6e, 0x6f, 0xd8, 0xd9, 0xea, 0xeb, 
+  0x44, 0x45, 0xba, 0xbb, 0xc0, 0xc1, 0x82, 0x83, 
+  0x4c, 0x4d, 0xd6, 0xd7, 0xc8, 0xc9, 0xf2, 0xf3, 
+  0x74, 0x75, 0xe6, 0xe7, 0xf0, 0xf1, 0xb2, 0xb3, 
+  0x7c, 0x7d, 0x7e, 0x7f, 0xf8, 0xf9, 0xda, 0xdb, 
+  0x64, 0x65, 0xfa, 0xfb, 0xe0, 0xe1, 0xa2, 0xa3, 
+  0x6c, 0x6d, 0xf6, 0xf7, 0xe8, 0xe9, 0xca, 0xcb, 
+  0x14, 0x15, 0x86, 0x87, 0x90, 0x91, 0xe2, 0xe3, 
+  0x1c, 0x1d, 0x4e, 0x4f, 0x98, 0x99, 0xaa, 0xab, 
+  0x04, 0x05, 0x3a, 0x3b, 0x80, 0x81, 0xfc, 0xfd, 
+  0x0c, 0x0d, 0x96, 0x97, 0x88, 0x89, 0x72, 0x73, 
+  0x34, 0x35, 0xa6, 0xa7, 0xb0, 0xb1, 0xd2, 0xd3, 
+  0x3c, 0x3d, 0x5e, 0x5f, 0xb8, 0xb9, 0x9a, 0x9b, 
+  0x24, 0x25, 0x7a, 0x7b, 0xa0, 0xa1, 0xc2, 0xc3, 
+  0x2c, 0x2d, 0xb6, 0xb7, 0xa8, 0xa9, 0x8a, 0x8b, 
+};
+
+/* NOTE: table index and value are bit-reversed */
+
+static const uint8_t __i4b_ulaw_to_alaw[0x100] = {
+  0x54, 0x55, 0x16, 0x17, 0xd0, 0xd1, 0x42, 0x43, 
+  0x5c, 0x5d, 0x7e, 0x7f, 0xd8, 0xd9, 0x4a, 0x4b, 
+  0x44, 0x45, 0x06, 0x07, 0xc0, 0xc1, 0x5a, 0x5b, 
+  0x4c, 0x4d, 0x6e, 0x6f, 0xc8, 0xc9, 0x6a, 0x6b, 
+  0x74, 0x75, 0x36, 0x37, 0xf0, 0xf1, 0x62, 0x63, 
+  0x7c, 0x7d, 0x4e, 0x4f, 0xf8, 0xf9, 0x0a, 0x0b, 
+  0x64, 0x65, 0x26, 0x27, 0xe0, 0xe1, 0x7a, 0x7b, 
+  0x6c, 0x6d, 0xd2, 0xd3, 0xe8, 0xe9, 0x2a, 0x2b, 
+  0x14, 0x15, 0x76, 0x77, 0x90, 0x91, 0x02, 0x03, 
+  0x1c, 0x1d, 0x3e, 0x3f, 0x98, 0x99, 0xca, 0xcb, 
+  0x04, 0x05, 0x66, 0x67, 0x80, 0x81, 0x1a, 0x1b, 
+  0x0c, 0x0d, 0x2e, 0x2f, 0x88, 0x89, 0xea, 0xeb, 
+  0x34, 0x35, 0x46, 0x47, 0xb0, 0xb1, 0x22, 0x23, 
+  0x3c, 0x3d, 0x0e, 0x0f, 0xb8, 0xb9, 0x8a, 0x8b, 
+  0x24, 0x25, 0xde, 0xdf, 0xa0, 0xa1, 0x3a, 0x3b, 
+  0x2c, 0x2d, 0xf2, 0xf3, 0xa8, 0xa9, 0xaa, 0xab, 
+  0xd4, 0xd5, 0x96, 0x97, 0x10, 0x11, 0xc2, 0xc3, 
+  0xdc, 0xdd, 0xfe, 0xff, 0x18, 0x19, 0xca, 0x4b, 
+  0xc4, 0xc5, 0x86, 0x87, 0x00, 0x01, 0xda, 0xdb, 
+  0xcc, 0xcd, 0xee, 0xef, 0x08, 0x09, 0xea, 0x6b, 
+  0xf4, 0xf5, 0xb6, 0xb7, 0x30, 0x31, 0xe2, 0xe3, 
+  0xfc, 0xfd, 0xce, 0xcf, 0x38, 0x39, 0x8a, 0x0b, 
+  0xe4, 0xe5, 0xa6, 0xa7, 0x20, 0x21, 0xfa, 0xfb, 
+  0xec, 0xed, 0x92, 0x93, 0x28, 0x29, 0xaa, 0x2b, 
+  0x94, 0x95, 0xf6, 0xf7, 0x70, 0x71, 0x82, 0x83, 
+  0x9c, 0x9d, 0xbe, 0xbf, 0x78, 0x79, 0x0a, 0xcb, 
+  0x84, 0x85, 0xe6, 0xe7, 0x60, 0x61, 0x9a, 0x9b, 
+  0x8c, 0x8d, 0xae, 0xaf, 0x68, 0x69, 0x2a, 0xeb, 
+  0xb4, 0xb5, 0xc6, 0xc7, 0x40, 0x41, 0xa2, 0xa3, 
+  0xbc, 0xbd, 0x8e, 0x8f, 0x48, 0x49, 0x6a, 0x8b, 
+  0xa4, 0xa5, 0x9e, 0x9f, 0x58, 0x59, 0xba, 0xbb, 
+  0xac, 0xad, 0xb2, 0xb3, 0xd6, 0xd7, 0xab, 0xab, 
+};
+
+/*---------------------------------------------------------------------------*
+ * i4b_convert_sample - convert a single sample
+ *---------------------------------------------------------------------------*/
+static __inline uint8_t
+i4b_convert_sample(uint8_t sample, int32_t factor, int32_t divisor,
+		   uint8_t in_bsubprot, uint8_t out_bsubprot)
+{
+    int32_t temp;
+
+    switch(in_bsubprot) {
+    case BSUBPROT_SIGNED_8BIT:
+        temp = ((int8_t)sample) * 256;
+	break;
+
+    case BSUBPROT_G711_ULAW:
+        temp = i4b_ulaw_to_signed[sample];
+	break;
+
+    case BSUBPROT_PLAIN_ULAW:
+        temp = i4b_ulaw_to_signed[i4b_reverse_bits[sample]];
+	break;
+
+    case BSUBPROT_G711_ALAW:
+        temp = i4b_alaw_to_signed[sample];
+	break;
+
+    case BSUBPROT_PLAIN_ALAW:
+        temp = i4b_alaw_to_signed[i4b_reverse_bits[sample]];
+	break;
+
+    default:
+        temp = 0;
+	break;
+    }
+
+    if (factor != divisor) {
+        /* amplify or attenuate the sound */
+        temp *= factor;
+	temp /= divisor;
+    }
+
+    switch(out_bsubprot) {
+    case BSUBPROT_SIGNED_8BIT:
+        if (temp > 0x7FFF) {
+	    temp = 0x7FFF;
+	}
+	if (temp < -0x7FFF) {
+	    temp = -0x7FFF;
+	}
+	return ((uint8_t)(int8_t)(temp / 256));
+
+    case BSUBPROT_G711_ULAW:
+        return i4b_signed_to_ulaw(temp);
+
+    case BSUBPROT_PLAIN_ULAW:
+        return i4b_reverse_bits[i4b_signed_to_ulaw(temp)];
+
+    case BSUBPROT_G711_ALAW:
+        return i4b_signed_to_alaw(temp);
+
+    case BSUBPROT_PLAIN_ALAW:
+        return i4b_reverse_bits[i4b_signed_to_alaw(temp)];
+
+    default:
+        return 0xFF;
+    }
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_convert_table - convert samples using a 256-entry lookup table
+ *---------------------------------------------------------------------------*/
+static void
+i4b_convert_table(uint8_t *ptr, uint32_t len, const uint8_t *table)
+{
+    while (len >= 4) {
+        ptr[0] = table[ptr[0]];
+	ptr[1] = table[ptr[1]];
+	ptr[2] = table[ptr[2]];
+	ptr[3] = table[ptr[3]];
+	ptr += 4;
+	len -= 4;
+    }
+    while (len--) {
+        *ptr = table[*ptr];
+	ptr++;
+    }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_convert_bsubprot - convert samples from one B-channel subprotocol
+ *                        to another, optionally applying a gain
+ *
+ * Every output sample only depends on the input byte, so any
+ * combination of subprotocols and gain reduces to a 256-entry lookup
+ * table. The common conversions without gain use static tables. For
+ * the other combinations a table is built on the stack, when the
+ * buffer is long enough to amortize that.
+ *
+ * NOTE: There is no vectorized version. Byte lookups would need
+ * gather instructions, and this function is called for a few hundred
+ * bytes at a time from the 8 kHz B-channel paths, where saving and
+ * restoring the FPU state, like the echo canceller does, would cost
+ * more than it gains. The plain C version also works on all
+ * architectures.
+ *---------------------------------------------------------------------------*/
 void
 i4b_convert_bsubprot(uint8_t *ptr, uint32_t len, 
 		     int32_t factor, int32_t divisor,
 		     uint8_t in_bsubprot, uint8_t out_bsubprot)
 {
-    int32_t temp;
+    uint8_t table[0x100];
+    uint16_t x;
 
     if (factor == divisor) {
 
@@ -3275,82 +3456,42 @@ i4b_convert_bsubprot(uint8_t *ptr, uint32_t len,
 	    ((out_bsubprot == BSUBPROT_G711_ALAW) &&
 	     (in_bsubprot == BSUBPROT_PLAIN_ALAW)))
 	{
-	    /* optimize */
-
-	  while (len--) {
-	      *ptr = i4b_reverse_bits[*ptr];
-	      ptr++;
-	  }
-	  return;
+	    i4b_convert_table(ptr, len, i4b_reverse_bits);
+	    return;
 	}
-    }
-
-    while (len--) {
-
-        switch(in_bsubprot) {
-	case BSUBPROT_SIGNED_8BIT:
-	    temp = ((int8_t)*ptr) * 256;
-	    break;
-
-	case BSUBPROT_G711_ULAW:
-	    temp = i4b_ulaw_to_signed[*ptr];
-	    break;
 
-	case BSUBPROT_PLAIN_ULAW:
-	    temp = i4b_ulaw_to_signed[i4b_reverse_bits[*ptr]];
-	    break;
-
-	case BSUBPROT_G711_ALAW:
-	    temp = i4b_alaw_to_signed[*ptr];
-	    break;
-
-	case BSUBPROT_PLAIN_ALAW:
-	    temp = i4b_alaw_to_signed[i4b_reverse_bits[*ptr]];
-	    break;
-
-	default:
-	    temp = 0;
-	    break;
+	if ((in_bsubprot == BSUBPROT_G711_ALAW) &&
+	    (out_bsubprot == BSUBPROT_G711_ULAW))
+	{
+	    i4b_convert_table(ptr, len, __i4b_alaw_to_ulaw);
+	    return;
 	}
 
-	if (factor != divisor) {
-	    /* amplify or attenuate the sound */
-	    temp *= factor;
-	    temp /= divisor;
+	if ((in_bsubprot == BSUBPROT_G711_ULAW) &&
+	    (out_bsubprot == BSUBPROT_G711_ALAW))
+	{
+	    i4b_convert_table(ptr, len, __i4b_ulaw_to_alaw);
+	    return;
 	}
+    }
 
-	switch(out_bsubprot) {
-	case BSUBPROT_SIGNED_8BIT:
-	    if (temp > 0x7FFF) {
-	        temp = 0x7FFF;
-	    }
-	    if (temp < -0x7FFF) {
-	        temp = -0x7FFF;
-	    }
-	    *((int8_t *)ptr) = temp / 256;
-	    break;
-
-	case BSUBPROT_G711_ULAW:
-	    *ptr = i4b_signed_to_ulaw(temp);
-	    break;
-
-	case BSUBPROT_PLAIN_ULAW:
-	    *ptr = i4b_reverse_bits[i4b_signed_to_ulaw(temp)];
-	    break;
-
-	case BSUBPROT_G711_ALAW:
-	    *ptr = i4b_signed_to_alaw(temp);
-	    break;
+    if (len < sizeof(table)) {
 
-	case BSUBPROT_PLAIN_ALAW:
-	    *ptr = i4b_reverse_bits[i4b_signed_to_alaw(temp)];
-	    break;
+        /* short buffer - convert the samples directly */
 
-	default:
-	    *ptr = 0xFF;
-	    break;
+        while (len--) {
+	    *ptr = i4b_convert_sample(*ptr, factor, divisor,
+				      in_bsubprot, out_bsubprot);
+	    ptr++;
 	}
-	ptr++;
+	return;
     }
+
+    for (x = 0; x != sizeof(table); x++) {
+        table[x] = i4b_convert_sample(x, factor, divisor,
+				      in_bsubprot, out_bsubprot);
+    }
+
+    i4b_convert_table(ptr, len, table);
     return;
 }
@@ -42,6 +42,9 @@
 #include <i4b/include/i4b_trace.h>
 #include <i4b/include/i4b_global.h>
 
+#define I32(x) ((int32_t)(x))
+#define L64(x) ((int64_t)(int32_t)(x))
+
 /*
  * K[] = 2.0 * cos ( 2.0 * pi() * f / 8000.0 ) * 16384
  */
@@ -336,228 +339,380 @@ i4b_sqrt_32(uint32_t a) {
     return b;
 }
 
-void
-i4b_dtmf_detect(struct fifo_translator *ft, 
-		uint8_t *data_ptr, uint16_t data_len)
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_goertzel - compute the level of all DTMF and FAX tones
+ *
+ * input:
+ *   convert_fwd: A-law or u-law to signed conversion table, per block
+ *   buffer: I4B_DTMF_N_SAMPLES samples, per block
+ *   num: number of blocks, at most I4B_DTMF_N_BATCH
+ *
+ * output:
+ *   level: I4B_DTMF_N_FREQ tone levels, normalized by the AGC, per block
+ *
+ * All the Goertzel filters of all the blocks are run side by side in
+ * a single pass over the samples, so that the inner loop has no
+ * dependencies between the frequencies and the blocks. The blocks
+ * normally come from different channels. The filters are linear, so
+ * instead of normalizing every input sample, the resulting levels are
+ * normalized at the end. The filter feedback is computed using a
+ * single 64-bit product and shift.
+ *---------------------------------------------------------------------------*/
+static void
+i4b_dtmf_goertzel(const int16_t * const *convert_fwd,
+		  uint8_t * const *buffer,
+		  int32_t (*level)[I4B_DTMF_N_FREQ], uint8_t num)
 {
-    int32_t w2[I4B_DTMF_N_FREQ];
-    int32_t max_gain;
+    int32_t w0[I4B_DTMF_N_BATCH][I4B_DTMF_N_FREQ];
+    int32_t w1[I4B_DTMF_N_BATCH][I4B_DTMF_N_FREQ];
+    int32_t max_gain[I4B_DTMF_N_BATCH];
+    int32_t w2;
     int32_t sample;
-    int32_t max0;
-    int32_t max1;
-    int32_t max2;
     uint16_t x;
-    uint16_t delta;
-    uint32_t found;
     uint32_t n;
-    uint8_t temp;
-    uint8_t code;
+    uint8_t b;
 
-    /* sanity check */
-    if (ft->L5_PUT_DTMF == NULL)
-	return;
+    /* reset detectors */
+    for (b = 0; b != num; b++) {
+	for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
+	    w0[b][n] = 0;
+	    w1[b][n] = 0;
+	}
+	max_gain[b] = 0x1000;
+    }
 
-    while (1) {
-	delta = I4B_DTMF_N_SAMPLES - ft->dtmf_rx.count;
-	if (delta > data_len)
-		delta = data_len;
-	memcpy(ft->dtmf_rx.buffer + ft->dtmf_rx.count, data_ptr, delta);
-	data_ptr += delta;
-	data_len -= delta;
-	ft->dtmf_rx.count += delta;
+    for (x = 0; x != I4B_DTMF_N_SAMPLES; x++) {
 
-	if (ft->dtmf_rx.count != I4B_DTMF_N_SAMPLES)
-		break;
+	for (b = 0; b != num; b++) {
 
-	/* reset detector */
-	bzero(ft->dtmf_rx.w1, sizeof(ft->dtmf_rx.w1));
-	bzero(ft->dtmf_rx.w0, sizeof(ft->dtmf_rx.w0));
-	ft->dtmf_rx.count = 0;
-
-	/* compute AGC */
-	max_gain = 0x1000;
-
-	for (x = 0; x != I4B_DTMF_N_SAMPLES; x++) {
-		sample = ((ft->dtmf_rx.bsubprot == BSUBPROT_G711_ALAW) ?
-		    i4b_alaw_to_signed[ft->dtmf_rx.buffer[x]] :
-		    i4b_ulaw_to_signed[ft->dtmf_rx.buffer[x]]);
-		if (sample < 0)
-			sample = -sample;
-		if (sample > max_gain) {
-			if (sample > 0x7FFF)
-				sample = 0x7FFF;
-			max_gain = sample;
-		}
-	}
+	    sample = convert_fwd[b][buffer[b][x]];
 
-	for (x = 0; x != I4B_DTMF_N_SAMPLES; x++) {
-		sample = ((ft->dtmf_rx.bsubprot == BSUBPROT_G711_ALAW) ?
-		    i4b_alaw_to_signed[ft->dtmf_rx.buffer[x]] :
-		    i4b_ulaw_to_signed[ft->dtmf_rx.buffer[x]]);
+	    /* compute Goertzel filters */
 
-		/* normalize input data */
+	    for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
+		w2 = I32((L64(K[n]) * L64(w1[b][n])) >> 14) -
+		    w0[b][n] + sample;
+		w0[b][n] = w1[b][n];
+		w1[b][n] = w2;
+	    }
 
-		sample = ((sample * 0x8000) - sample) / max_gain;
+	    /* compute AGC */
 
-		if (sample > 0x7FFF)
-			sample = 0x7FFF;
-		else if (sample < -0x7FFF)
-			sample = -0x7FFF;
+	    if (sample < 0)
+		sample = -sample;
+	    if (sample > max_gain[b])
+		max_gain[b] = sample;
+	}
+    }
 
-		/* compute Goertzel filters */
+    for (b = 0; b != num; b++) {
 
-		for (n = 0; n < I4B_DTMF_N_FREQ; n += 2) {
+	if (max_gain[b] > 0x7FFF)
+	    max_gain[b] = 0x7FFF;
 
-			/* partial loop unrolling */
+	for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
 
-			w2[n] = (((K[n] * (ft->dtmf_rx.w1[n] / (1<<7))) / (1<<7)) - 
-			    (ft->dtmf_rx.w0[n]) + sample);
+	    w0[b][n] /= (1<<7);
+	    w1[b][n] /= (1<<7);
 
-			ft->dtmf_rx.w0[n] = ft->dtmf_rx.w1[n];
-			ft->dtmf_rx.w1[n] = w2[n];
+	    level[b][n] = i4b_sqrt_32
+	      ((w0[b][n] * w0[b][n]) + (w1[b][n] * w1[b][n]) -
+	       (((K[n] * w0[b][n]) / (1<<7)) * (w1[b][n] / (1<<7))));
 
-			w2[n+1] = (((K[n+1] * (ft->dtmf_rx.w1[n+1] / (1<<7))) / (1<<7)) - 
-			    (ft->dtmf_rx.w0[n+1]) + sample);
+	    /* normalize output data */
 
-			ft->dtmf_rx.w0[n+1] = ft->dtmf_rx.w1[n+1];
-			ft->dtmf_rx.w1[n+1] = w2[n+1];
-		}
+	    level[b][n] = ((level[b][n] * 0x8000) - level[b][n]) /
+		max_gain[b];
 	}
+    }
+    return;
+}
 
-	found = 0;
-	max2 = 0;
-	max1 = 0;
-	max0 = 0;
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_decide - classify the tone levels of one block and report
+ *                   new DTMF digits and FAX tones to layer 5
+ *---------------------------------------------------------------------------*/
+static void
+i4b_dtmf_decide(struct fifo_translator *ft, const int32_t *w2)
+{
+    int32_t max0;
+    int32_t max1;
+    int32_t max2;
+    uint32_t found;
+    uint32_t n;
+    uint8_t temp;
+    uint8_t code;
 
-	for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
+    found = 0;
+    max2 = 0;
+    max1 = 0;
+    max0 = 0;
 
-		ft->dtmf_rx.w0[n] /= (1<<7);
-		ft->dtmf_rx.w1[n] /= (1<<7);
-
-		w2[n] = i4b_sqrt_32
-		  ((ft->dtmf_rx.w0[n]*ft->dtmf_rx.w0[n]) + 
-		   (ft->dtmf_rx.w1[n]*ft->dtmf_rx.w1[n]) -
-		   (((K[n] * ft->dtmf_rx.w0[n]) / (1<<7)) * 
-		    (ft->dtmf_rx.w1[n] / (1<<7))));
-
-		/* compute the three highest values */
-
-		if (max0 < w2[n]) {
-		    max2 = max1;
-		    max1 = max0;
-		    max0 = w2[n];
-		} else if (max1 < w2[n]) {
-		    max2 = max1;
-		    max1 = w2[n];
-		} else if (max2 < w2[n]) {
-		    max2 = w2[n];
-		}
+    for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
+
+	/* compute the three highest values */
+
+	if (max0 < w2[n]) {
+	    max2 = max1;
+	    max1 = max0;
+	    max0 = w2[n];
+	} else if (max1 < w2[n]) {
+	    max2 = max1;
+	    max1 = w2[n];
+	} else if (max2 < w2[n]) {
+	    max2 = w2[n];
 	}
+    }
 
-	if ((max0 >= 5000) && (max1 >= (max0 / 2)) && (max2 < (max0 / 2))) {
+    if ((max0 >= 5000) && (max1 >= (max0 / 2)) && (max2 < (max0 / 2))) {
 
-		/* multi tone */
+	/* multi tone */
 
-		for (n = 0; n < I4B_DTMF_N_FREQ; n++) {
-			found |= (w2[n] >= max1) << n;
-		}
+	for (n = 0; n < I4B_DTMF_N_FREQ; n++) {
+	    found |= (w2[n] >= max1) << n;
+	}
 
-	} else if ((max0 >= 10000) && (max1 < (max0 / 2))) {
+    } else if ((max0 >= 10000) && (max1 < (max0 / 2))) {
 
-		/* single tone */
+	/* single tone */
 
-		for (n = 0; n < I4B_DTMF_N_FREQ; n++) {
-			found |= (w2[n] == max0) << n;
-		}
+	for (n = 0; n < I4B_DTMF_N_FREQ; n++) {
+	    found |= (w2[n] == max0) << n;
 	}
+    }
 
-	if (found) {
-		for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
-			I4B_DBG(1, L1_DTMF_MSG, "tone[%d]=%d max=%d,%d,%d",
-				n, w2[n], max0, max1, max2);
-		}
+    if (found) {
+	for (n = 0; n != I4B_DTMF_N_FREQ; n++) {
+	    I4B_DBG(1, L1_DTMF_MSG, "tone[%d]=%d max=%d,%d,%d",
+		n, w2[n], max0, max1, max2);
 	}
+    }
 
-	if (found == (1<<16)) {
-		if (ft->dtmf_rx.detected_fax_or_modem) {
-			code = 0;
-			goto done;
-		} else {
-			/* fax tone 1.1 kHz */
-			code = 'X';
-		}
-	} else if (found == (1<<17)) {
-		if (ft->dtmf_rx.detected_fax_or_modem) {
-			code = 0;
-			goto done;
-		} else {
-			/* fax tone 2.1 kHz */
-			code = 'Y';
-		}
+    if (found == (1<<16)) {
+	if (ft->dtmf_rx.detected_fax_or_modem) {
+	    code = 0;
+	    goto done;
 	} else {
-		/* DTMF tone */
-		temp = (found & 0xF);
-
-		if (temp == 1) {
-			code = 0;
-		} else if (temp == 2) {
-			code = 1;
-		} else if (temp == 4) {
-			code = 2;
-		} else if (temp == 8) {
-			code = 3;
-		} else {
-			code = 0;
-			goto done;
-		}
+	    /* fax tone 1.1 kHz */
+	    code = 'X';
+	}
+    } else if (found == (1<<17)) {
+	if (ft->dtmf_rx.detected_fax_or_modem) {
+	    code = 0;
+	    goto done;
+	} else {
+	    /* fax tone 2.1 kHz */
+	    code = 'Y';
+	}
+    } else {
+	/* DTMF tone */
+	temp = (found & 0xF);
+
+	if (temp == 1) {
+	    code = 0;
+	} else if (temp == 2) {
+	    code = 1;
+	} else if (temp == 4) {
+	    code = 2;
+	} else if (temp == 8) {
+	    code = 3;
+	} else {
+	    code = 0;
+	    goto done;
+	}
 
-		if (found & 0xFFFFFF00) {
-			code = 0;
-			goto done;
-		}
+	if (found & 0xFFFFFF00) {
+	    code = 0;
+	    goto done;
+	}
 
-		temp = ((found >> 4) & 0xF);
-
-		if (temp == 1) {
-			code |= 0x0;
-		} else if (temp == 2) {
-			code |= 0x4;
-		} else if (temp == 4) {
-			code |= 0x8;
-		} else if (temp == 8) {
-			code |= 0xC;
-		} else {
-			code = 0;
-			goto done;
-		}
-		code = code_to_ascii[code];
+	temp = ((found >> 4) & 0xF);
+
+	if (temp == 1) {
+	    code |= 0x0;
+	} else if (temp == 2) {
+	    code |= 0x4;
+	} else if (temp == 4) {
+	    code |= 0x8;
+	} else if (temp == 8) {
+	    code |= 0xC;
+	} else {
+	    code = 0;
+	    goto done;
 	}
+	code = code_to_ascii[code];
+    }
 done:
-	if (code == 0 && ft->dtmf_rx.no_code_count < 2) {
-		/* JITTER case */
-		code = ft->dtmf_rx.code;
-		ft->dtmf_rx.no_code_count++;
-	} else {
-		/* non-JITTER case */
-		ft->dtmf_rx.no_code_count = 0;
+    if (code == 0 && ft->dtmf_rx.no_code_count < 2) {
+	/* JITTER case */
+	code = ft->dtmf_rx.code;
+	ft->dtmf_rx.no_code_count++;
+    } else {
+	/* non-JITTER case */
+	ft->dtmf_rx.no_code_count = 0;
+    }
+    if (code != ft->dtmf_rx.code) {
+	ft->dtmf_rx.code = code;
+	ft->dtmf_rx.code_count = 0;
+    }
+    if ((code == 'X') || (code == 'Y')) {
+	if (ft->dtmf_rx.code_count == 14) {
+	    L5_PUT_DTMF(ft, &code, 1);
+	    ft->dtmf_rx.detected_fax_or_modem = 1;
 	}
-	if (code != ft->dtmf_rx.code) {
-		ft->dtmf_rx.code = code;
-		ft->dtmf_rx.code_count = 0;
+	if (ft->dtmf_rx.code_count != 255)
+	    ft->dtmf_rx.code_count++;
+    } else if (code != 0) {
+	if (ft->dtmf_rx.code_count == 1) {
+	    L5_PUT_DTMF(ft, &code, 1);
 	}
-	if ((code == 'X') || (code == 'Y')) {
-		if (ft->dtmf_rx.code_count == 14) {
-			L5_PUT_DTMF(ft, &code, 1);
-			ft->dtmf_rx.detected_fax_or_modem = 1;
-		}
-		if (ft->dtmf_rx.code_count != 255)
-			ft->dtmf_rx.code_count++;
-	} else if (code != 0) {
-		if (ft->dtmf_rx.code_count == 1) {
-			L5_PUT_DTMF(ft, &code, 1);
-		}
-		if (ft->dtmf_rx.code_count != 255)
-			ft->dtmf_rx.code_count++;
+	if (ft->dtmf_rx.code_count != 255)
+	    ft->dtmf_rx.code_count++;
+    }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_collect - append received samples to the DTMF buffer
+ *
+ * The samples are only buffered here. The detection is done later by
+ * "i4b_dtmf_detect_batch()", typically after all the FIFOs of a
+ * controller have been serviced. If the buffer overflows before
+ * that, the complete blocks are processed at once.
+ *---------------------------------------------------------------------------*/
+void
+i4b_dtmf_collect(struct fifo_translator *ft,
+		 uint8_t *data_ptr, uint16_t data_len)
+{
+    uint16_t delta;
+
+    /* sanity check */
+    if (ft->L5_PUT_DTMF == NULL)
+	return;
+
+    while (1) {
+	delta = sizeof(ft->dtmf_rx.buffer) - ft->dtmf_rx.count;
+	if (delta > data_len)
+		delta = data_len;
+	memcpy(ft->dtmf_rx.buffer + ft->dtmf_rx.count, data_ptr, delta);
+	data_ptr += delta;
+	data_len -= delta;
+	ft->dtmf_rx.count += delta;
+
+	if (ft->dtmf_rx.count != sizeof(ft->dtmf_rx.buffer))
+		break;
+
+	i4b_dtmf_detect_pending(ft);
+    }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_detect_blocks - run the DTMF detector on the first complete
+ * block of up to I4B_DTMF_N_BATCH channels and consume that block
+ *---------------------------------------------------------------------------*/
+static void
+i4b_dtmf_detect_blocks(struct fifo_translator **ftp, uint8_t num)
+{
+    const int16_t *convert_fwd[I4B_DTMF_N_BATCH];
+    uint8_t *buffer[I4B_DTMF_N_BATCH];
+    int32_t level[I4B_DTMF_N_BATCH][I4B_DTMF_N_FREQ];
+    struct fifo_translator *ft;
+    uint8_t b;
+
+    for (b = 0; b != num; b++) {
+	ft = ftp[b];
+	convert_fwd[b] = ((ft->dtmf_rx.bsubprot == BSUBPROT_G711_ALAW) ?
+	    i4b_alaw_to_signed : i4b_ulaw_to_signed);
+	buffer[b] = ft->dtmf_rx.buffer;
+    }
+
+    i4b_dtmf_goertzel(convert_fwd, buffer, level, num);
+
+    for (b = 0; b != num; b++) {
+	ft = ftp[b];
+
+	i4b_dtmf_decide(ft, level[b]);
+
+	/* keep the remaining samples */
+	ft->dtmf_rx.count -= I4B_DTMF_N_SAMPLES;
+	if (ft->dtmf_rx.count != 0) {
+	    memmove(ft->dtmf_rx.buffer,
+		ft->dtmf_rx.buffer + I4B_DTMF_N_SAMPLES,
+		ft->dtmf_rx.count);
 	}
     }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_detect_batch - run the DTMF detector on all complete
+ * blocks collected by "i4b_dtmf_collect()" for the given channels
+ *
+ * The blocks of the different channels are processed together, by
+ * up to I4B_DTMF_N_BATCH blocks per pass over the samples.
+ *---------------------------------------------------------------------------*/
+void
+i4b_dtmf_detect_batch(struct fifo_translator **ftp, uint16_t num)
+{
+    struct fifo_translator *batch[I4B_DTMF_N_BATCH];
+    struct fifo_translator *ft;
+    uint16_t n;
+    uint8_t b;
+    uint8_t more;
+
+    do {
+	more = 0;
+	b = 0;
+
+	for (n = 0; n != num; n++) {
+	    ft = ftp[n];
+
+	    if (ft->dtmf_rx.count < I4B_DTMF_N_SAMPLES)
+		continue;
+
+	    /* sanity check */
+	    if (ft->L5_PUT_DTMF == NULL) {
+		ft->dtmf_rx.count = 0;
+		continue;
+	    }
+
+	    batch[b++] = ft;
+
+	    if (b == I4B_DTMF_N_BATCH) {
+		i4b_dtmf_detect_blocks(batch, b);
+		b = 0;
+		more = 1;
+	    }
+	}
+
+	if (b != 0) {
+	    i4b_dtmf_detect_blocks(batch, b);
+	    more = 1;
+	}
+
+	/* the buffer can hold more than one block */
+
+    } while (more);
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_dtmf_detect_pending - run the DTMF detector on all complete
+ * blocks collected by "i4b_dtmf_collect()" for a single channel
+ *---------------------------------------------------------------------------*/
+void
+i4b_dtmf_detect_pending(struct fifo_translator *ft)
+{
+    i4b_dtmf_detect_batch(&ft, 1);
+    return;
+}
+
+void
+i4b_dtmf_detect(struct fifo_translator *ft, 
+		uint8_t *data_ptr, uint16_t data_len)
+{
+    i4b_dtmf_collect(ft, data_ptr, data_len);
+    i4b_dtmf_detect_pending(ft);
+    return;
 }
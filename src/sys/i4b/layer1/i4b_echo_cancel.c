@@ -39,6 +39,13 @@
 #include <sys/socket.h>
 #include <sys/kernel.h>
 #include <net/if.h>
+#ifdef I4B_ECHO_CANCEL_SIMD
+#if defined(__amd64__) || defined(__i386__)
+#include <machine/cpufunc.h>
+#include <machine/md_var.h>
+#include <machine/specialreg.h>
+#endif
+#endif
 #endif
 
 #include <i4b/include/i4b_debug.h>
@@ -46,6 +53,12 @@
 #include <i4b/include/i4b_trace.h>
 #include <i4b/include/i4b_global.h>
 
+#include <i4b/layer1/i4b_echo_cancel.h>
+
+#if (I4B_ECHO_CANCEL_P_COMPLEX < 8) || (I4B_ECHO_CANCEL_P_COMPLEX > 11)
+#error "Unsupported FFT size!"
+#endif
+
 #define I32(x) ((int32_t)(x))
 #define L64(x) ((int64_t)(int32_t)(x))
 #define U64(x) ((uint64_t)(x))
@@ -62,16 +75,72 @@ struct i4b_echo_cancel_stats {
 static void
 i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse);
 
+static void
+i4b_echo_cancel_coeffs_reset(struct i4b_echo_cancel *ec);
+
+static i4b_echo_cancel_radix4_cr_t i4b_echo_cancel_radix4_cr;
+
+/* currently selected implementation of the radix-4 FFT passes */
+static i4b_echo_cancel_radix4_cr_t *i4b_echo_cancel_radix4_cr_p =
+    &i4b_echo_cancel_radix4_cr;
+
+#ifdef I4B_ECHO_CANCEL_SIMD
+
+/* name of the vectorized FFT passes in use, if any */
+const char *i4b_echo_cancel_simd_name;
+
+/*
+ * Check that the CPU supports AVX2 and that the OS saves the
+ * state. The global include file may provide its own check.
+ */
+#if (defined(__amd64__) || defined(__i386__)) && \
+    !defined(I4B_ECHO_CANCEL_HAVE_AVX2)
+#define	I4B_ECHO_CANCEL_XCR0_AVX \
+    (XFEATURE_ENABLED_SSE | XFEATURE_ENABLED_AVX)
+#define	I4B_ECHO_CANCEL_HAVE_AVX2() \
+    ((cpu_feature2 & CPUID2_OSXSAVE) && \
+     (cpu_stdext_feature & CPUID_STDEXT_AVX2) && \
+     ((rxcr(0) & I4B_ECHO_CANCEL_XCR0_AVX) == I4B_ECHO_CANCEL_XCR0_AVX))
+#endif
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_simd_setup - select vectorized FFT passes, if supported
+ *---------------------------------------------------------------------------*/
+static void
+i4b_echo_cancel_simd_setup(void *arg)
+{
+#if defined(__amd64__) || defined(__i386__)
+    if (I4B_ECHO_CANCEL_HAVE_AVX2()) {
+	i4b_echo_cancel_radix4_cr_p = &i4b_echo_cancel_radix4_cr_avx2;
+	i4b_echo_cancel_simd_name = "AVX2";
+    }
+#elif defined(__aarch64__)
+    i4b_echo_cancel_radix4_cr_p = &i4b_echo_cancel_radix4_cr_neon;
+    i4b_echo_cancel_simd_name = "NEON";
+#endif
+    if (bootverbose && (i4b_echo_cancel_simd_name != NULL)) {
+	printf("i4b: Echo canceller is using %s.\n",
+	    i4b_echo_cancel_simd_name);
+    }
+    return;
+}
+SYSINIT(i4b_echo_cancel_simd_setup, SI_SUB_DRIVERS, SI_ORDER_FIRST,
+    i4b_echo_cancel_simd_setup, NULL);
+#endif
+
 /*---------------------------------------------------------------------------*
  * i4b_echo_cancel_init - initialize echo canceller
  *---------------------------------------------------------------------------*/
 void
 i4b_echo_cancel_init(struct i4b_echo_cancel *ec, 
+		     struct i4b_echo_cancel_scratch *scratch,
 		     uint16_t pre_delay,
 		     uint8_t sub_bprot)
 {
     bzero(ec, sizeof(*ec));
 
+    ec->buf_EC = scratch->buf_EC;
+
     ec->last_byte = 0xFF;
 
     ec->noise_rem = 1;
@@ -80,6 +149,8 @@ i4b_echo_cancel_init(struct i4b_echo_cancel *ec,
 
     ec->is_ulaw = (sub_bprot != BSUBPROT_G711_ALAW);
 
+    ec->mode = I4B_ECHO_CANCEL_MODE_BLOCK;
+
     ec->offset_x = I4B_ECHO_CANCEL_N_TAPS;
 
     ec->offset_e = (4*I4B_ECHO_CANCEL_N_TAPS);
@@ -91,6 +162,92 @@ i4b_echo_cancel_init(struct i4b_echo_cancel *ec,
     return;
 }
 
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_reset_offsets - reset block offsets
+ *
+ * In partitioned mode the part of the phase that is smaller than a
+ * partition shifts the echo partitions, and the rest shifts the
+ * filter adaption, which is still done in whole blocks.
+ *---------------------------------------------------------------------------*/
+static void
+i4b_echo_cancel_reset_offsets(struct i4b_echo_cancel *ec)
+{
+    uint16_t sub;
+
+    if (ec->mode == I4B_ECHO_CANCEL_MODE_PART) {
+
+	sub = (ec->phase % I4B_ECHO_CANCEL_N_PART);
+
+	ec->offset_x = (I4B_ECHO_CANCEL_N_PART - sub);
+	ec->offset_e = (4*I4B_ECHO_CANCEL_N_TAPS) - (ec->phase - sub);
+
+    } else {
+
+	ec->offset_x = (I4B_ECHO_CANCEL_N_TAPS - ec->phase);
+	ec->offset_e = (4*I4B_ECHO_CANCEL_N_TAPS);
+    }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_set_phase - set block phase of echo canceller
+ *
+ * input:
+ *   phase: number of samples to shift the first echo block by
+ *
+ * NOTE: When many echo cancellers are serviced from the same
+ * interrupt, like on a PRI controller, giving each channel a
+ * different phase spreads the block computations evenly in time,
+ * instead of running all of them in the same interrupt. This
+ * function must be called right after "i4b_echo_cancel_init()".
+ *---------------------------------------------------------------------------*/
+void
+i4b_echo_cancel_set_phase(struct i4b_echo_cancel *ec, uint16_t phase)
+{
+    ec->phase = (phase % I4B_ECHO_CANCEL_N_TAPS);
+
+    i4b_echo_cancel_reset_offsets(ec);
+
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_set_mode - select echo canceller engine
+ *
+ * input:
+ *   mode: I4B_ECHO_CANCEL_MODE_BLOCK or I4B_ECHO_CANCEL_MODE_PART
+ *   part: delay line storage for partitioned mode, or NULL
+ *
+ * In block mode the echo is estimated for up to N_TAPS samples at a
+ * time, using two N_COMPLEX point FFTs. In partitioned mode the echo
+ * is estimated for N_PART samples at a time. The first partition of
+ * the filter is applied in the time domain, and the remaining
+ * partitions are applied in the "sine/cosine" domain, using a delay
+ * line of small FFTs. The filter length and the filter adaption are
+ * the same in both modes.
+ *
+ * NOTE: Block mode is used when no delay line storage is given.
+ *
+ * NOTE: Changing the mode resets the filter coefficients.
+ *---------------------------------------------------------------------------*/
+void
+i4b_echo_cancel_set_mode(struct i4b_echo_cancel *ec, uint8_t mode,
+			 struct i4b_echo_cancel_part *part)
+{
+    if ((mode != I4B_ECHO_CANCEL_MODE_PART) || (part == NULL)) {
+	mode = I4B_ECHO_CANCEL_MODE_BLOCK;
+	part = NULL;
+    }
+
+    ec->part = part;
+
+    if (ec->mode != mode) {
+	ec->mode = mode;
+	i4b_echo_cancel_coeffs_reset(ec);
+    }
+    return;
+}
+
 /*---------------------------------------------------------------------------*
  * i4b_echo_cancel_noise - a perceptual white noise generator
  *---------------------------------------------------------------------------*/
@@ -480,14 +637,189 @@ i4b_echo_cancel_coeffs_reset(struct i4b_echo_cancel *ec)
 
     bzero(ec->zero_start, ec->zero_end - ec->zero_start);
 
-    ec->offset_x = I4B_ECHO_CANCEL_N_TAPS;
-    ec->offset_e = (4*I4B_ECHO_CANCEL_N_TAPS);
+    if (ec->part != NULL)
+	bzero(ec->part, sizeof(*(ec->part)));
+
+    i4b_echo_cancel_reset_offsets(ec);
 
     /* initial muting should only activate once */
     if (ec->mute_count != 0)
 	ec->mute_count = 0xFFFFU;
 }
 
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_fold - fold the "sine/cosine" domain version of a real
+ *                        signal into its lower half
+ *
+ * The FFT of a real signal is symmetric. Only the sums and differences
+ * of the mirrored bins are used by the echo canceller, so they are
+ * stored instead of the full spectrum, which saves half the memory.
+ *---------------------------------------------------------------------------*/
+static void
+i4b_echo_cancel_fold(struct i4b_complex *dst, const struct i4b_complex *src)
+{
+    uint16_t i;
+    uint16_t j;
+
+    for (i = 1; i != I4B_ECHO_CANCEL_N_TAPS; i++) {
+
+	j = I4B_ECHO_CANCEL_N_COMPLEX-i;
+
+	dst[i].x = (src[i].x + src[j].x);
+	dst[i].y = (src[i].y - src[j].y);
+    }
+
+    /* handle phase-less components */
+
+    dst[0].x = src[0].x;
+    dst[0].y = 0;
+
+    dst[I4B_ECHO_CANCEL_N_TAPS].x = src[I4B_ECHO_CANCEL_N_TAPS].x;
+    dst[I4B_ECHO_CANCEL_N_TAPS].y = 0;
+
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_fft_part - radix-2 FFT used by the partitioned mode
+ *
+ * input:
+ *   inverse: 0: forward transform
+ *            1: inverse transform, without scaling
+ *---------------------------------------------------------------------------*/
+#if (I4B_ECHO_CANCEL_N_PART_COMPLEX != 0x80)
+#error "Please update the partition FFT table!"
+#endif
+
+static void
+i4b_echo_cancel_fft_part(struct i4b_complex *data, uint8_t inverse)
+{
+    /* exp(-2*pi*i*k/N_PART_COMPLEX) * (1 << 30) */
+    static const struct i4b_complex table[I4B_ECHO_CANCEL_N_PART] = {
+	{ 0x40000000,  0x00000000 }, { 0x3fec43c7, -0x0323ecbe }, { 0x3fb11b48, -0x0645e9af },
+	{ 0x3f4eaafe, -0x09640837 }, { 0x3ec52fa0, -0x0c7c5c1e }, { 0x3e14fdf7, -0x0f8cfcbe },
+	{ 0x3d3e82ae, -0x1294062f }, { 0x3c42420a, -0x158f9a76 }, { 0x3b20d79e, -0x187de2a7 },
+	{ 0x39daf5e8, -0x1b5d100a }, { 0x387165e3, -0x1e2b5d38 }, { 0x36e5068a, -0x20e70f32 },
+	{ 0x3536cc52, -0x238e7673 }, { 0x3367c090, -0x261feffa }, { 0x317900d6, -0x2899e64a },
+	{ 0x2f6bbe45, -0x2afad269 }, { 0x2d413ccd, -0x2d413ccd }, { 0x2afad269, -0x2f6bbe45 },
+	{ 0x2899e64a, -0x317900d6 }, { 0x261feffa, -0x3367c090 }, { 0x238e7673, -0x3536cc52 },
+	{ 0x20e70f32, -0x36e5068a }, { 0x1e2b5d38, -0x387165e3 }, { 0x1b5d100a, -0x39daf5e8 },
+	{ 0x187de2a7, -0x3b20d79e }, { 0x158f9a76, -0x3c42420a }, { 0x1294062f, -0x3d3e82ae },
+	{ 0x0f8cfcbe, -0x3e14fdf7 }, { 0x0c7c5c1e, -0x3ec52fa0 }, { 0x09640837, -0x3f4eaafe },
+	{ 0x0645e9af, -0x3fb11b48 }, { 0x0323ecbe, -0x3fec43c7 }, { 0x00000000, -0x40000000 },
+	{-0x0323ecbe, -0x3fec43c7 }, {-0x0645e9af, -0x3fb11b48 }, {-0x09640837, -0x3f4eaafe },
+	{-0x0c7c5c1e, -0x3ec52fa0 }, {-0x0f8cfcbe, -0x3e14fdf7 }, {-0x1294062f, -0x3d3e82ae },
+	{-0x158f9a76, -0x3c42420a }, {-0x187de2a7, -0x3b20d79e }, {-0x1b5d100a, -0x39daf5e8 },
+	{-0x1e2b5d38, -0x387165e3 }, {-0x20e70f32, -0x36e5068a }, {-0x238e7673, -0x3536cc52 },
+	{-0x261feffa, -0x3367c090 }, {-0x2899e64a, -0x317900d6 }, {-0x2afad269, -0x2f6bbe45 },
+	{-0x2d413ccd, -0x2d413ccd }, {-0x2f6bbe45, -0x2afad269 }, {-0x317900d6, -0x2899e64a },
+	{-0x3367c090, -0x261feffa }, {-0x3536cc52, -0x238e7673 }, {-0x36e5068a, -0x20e70f32 },
+	{-0x387165e3, -0x1e2b5d38 }, {-0x39daf5e8, -0x1b5d100a }, {-0x3b20d79e, -0x187de2a7 },
+	{-0x3c42420a, -0x158f9a76 }, {-0x3d3e82ae, -0x1294062f }, {-0x3e14fdf7, -0x0f8cfcbe },
+	{-0x3ec52fa0, -0x0c7c5c1e }, {-0x3f4eaafe, -0x09640837 }, {-0x3fb11b48, -0x0645e9af },
+	{-0x3fec43c7, -0x0323ecbe },
+    };
+
+    struct i4b_complex *pa;
+    struct i4b_complex *pb;
+
+    int32_t t;
+    int32_t tx;
+    int32_t ty;
+    int32_t wy;
+
+    uint16_t half;
+    uint16_t step;
+    uint16_t i;
+    uint16_t j;
+    uint16_t k;
+
+    /* in-place index bit-reversal */
+
+    for (i = 0; i != I4B_ECHO_CANCEL_N_PART_COMPLEX; i++) {
+
+	for (j = 0, k = 0; k != (I4B_ECHO_CANCEL_P_PART+1); k++) {
+	    j |= ((i >> k) & 1) << (I4B_ECHO_CANCEL_P_PART - k);
+	}
+
+	if (j > i) {
+	    t = data[i].x;
+	    data[i].x = data[j].x;
+	    data[j].x = t;
+
+	    t = data[i].y;
+	    data[i].y = data[j].y;
+	    data[j].y = t;
+	}
+    }
+
+    /* butterflies */
+
+    step = I4B_ECHO_CANCEL_N_PART;
+
+    for (half = 1; half != I4B_ECHO_CANCEL_N_PART_COMPLEX; half *= 2) {
+
+	for (i = 0; i != I4B_ECHO_CANCEL_N_PART_COMPLEX; i += (2 * half)) {
+
+	    pa = data + i;
+	    pb = data + i + half;
+
+	    for (j = 0; j != half; j++) {
+
+		wy = table[j * step].y;
+
+		if (inverse)
+		    wy = -wy;
+
+		tx = MUL_SHIFT30(table[j * step].x, pb->x) -
+		     MUL_SHIFT30(wy, pb->y);
+		ty = MUL_SHIFT30(table[j * step].x, pb->y) +
+		     MUL_SHIFT30(wy, pb->x);
+
+		pb->x = pa->x - tx;
+		pb->y = pa->y - ty;
+		pa->x += tx;
+		pa->y += ty;
+
+		pa++;
+		pb++;
+	    }
+	}
+	step /= 2;
+    }
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_load_part_h - compute the "sine/cosine" domain
+ *                               version of the filter tail partitions
+ *---------------------------------------------------------------------------*/
+static void
+i4b_echo_cancel_load_part_h(struct i4b_echo_cancel *ec)
+{
+    int32_t *pc;
+
+    uint16_t k;
+    uint16_t n;
+
+    for (k = 0; k != (I4B_ECHO_CANCEL_K_PART - 1); k++) {
+
+	bzero(ec->buf_EC, I4B_ECHO_CANCEL_N_PART_COMPLEX *
+	      sizeof(ec->buf_EC[0]));
+
+	pc = ec->buf_HR[0] + ((k + 1) * I4B_ECHO_CANCEL_N_PART);
+
+	for (n = 0; n != I4B_ECHO_CANCEL_N_PART; n++) {
+	    ec->buf_EC[n].x = pc[n];
+	}
+
+	i4b_echo_cancel_fft_part(ec->buf_EC, 0);
+
+	bcopy(ec->buf_EC, ec->u.buf_HP[k], sizeof(ec->u.buf_HP[k]));
+    }
+    return;
+}
+
 static void
 i4b_echo_cancel_load_complex_x(struct i4b_echo_cancel *ec,
 	uint16_t max_samples)
@@ -499,10 +831,10 @@ i4b_echo_cancel_load_complex_x(struct i4b_echo_cancel *ec,
 
     /* load buf_XC[] */
 
-    bzero(ec->buf_XC, sizeof(ec->buf_XC));
+    bzero(ec->buf_EC, I4B_ECHO_CANCEL_N_COMPLEX * sizeof(ec->buf_EC[0]));
 
-    pa = ec->buf_XC;
-    pa_end = ec->buf_XC + I4B_ECHO_CANCEL_N_TAPS;
+    pa = ec->buf_EC;
+    pa_end = ec->buf_EC + I4B_ECHO_CANCEL_N_TAPS;
     pb = (ec->buf_X0 + ec->offset_rd +
 	  I4B_ECHO_CANCEL_N_TAPS - max_samples);
 
@@ -518,7 +850,9 @@ i4b_echo_cancel_load_complex_x(struct i4b_echo_cancel *ec,
 
     /* transform local speaker data into the "sine/cosine" domain */
 
-    i4b_echo_cancel_fft(ec->buf_XC, 0);
+    i4b_echo_cancel_fft(ec->buf_EC, 0);
+
+    i4b_echo_cancel_fold(ec->buf_XC, ec->buf_EC);
 
     return;
 }
@@ -533,7 +867,7 @@ i4b_echo_cancel_load_complex_e(struct i4b_echo_cancel *ec)
 
     /* load buf_EC[] */
 
-    bzero(ec->buf_EC, sizeof(ec->buf_EC));
+    bzero(ec->buf_EC, I4B_ECHO_CANCEL_N_COMPLEX * sizeof(ec->buf_EC[0]));
 
     pa = ec->buf_EC;
     pa_end = ec->buf_EC + I4B_ECHO_CANCEL_N_TAPS;
@@ -558,7 +892,7 @@ i4b_echo_cancel_load_complex_e(struct i4b_echo_cancel *ec)
  * i4b_echo_cancel_convolute_fir - complex multiplication that results in
  *                                 convolution in the time domain
  * Input:
- *  "ec->buf_XC" and "buf_complex"
+ *  "ec->buf_XC" and "buf_complex", both folded
  *
  * Output:
  *  "buf_real" = convolution("buf_complex", "ec->buf_XC")
@@ -582,19 +916,15 @@ i4b_echo_cancel_convolute_fir(struct i4b_echo_cancel *ec,
     uint16_t i;
     uint16_t j;
 
-    /* copy in "sine/cosine" domain version of filter */
-
-    bcopy(buf_complex, ec->buf_EC, sizeof(ec->buf_EC));
-
     for (i = 1; i != I4B_ECHO_CANCEL_N_TAPS; i++) {
 
 	j = I4B_ECHO_CANCEL_N_COMPLEX-i;
 
-	dx = (ec->buf_XC[i].x + ec->buf_XC[j].x);
-	dy = (ec->buf_XC[i].y - ec->buf_XC[j].y);
+	dx = ec->buf_XC[i].x;
+	dy = ec->buf_XC[i].y;
 
-	ex = (ec->buf_EC[i].x + ec->buf_EC[j].x);
-	ey = (ec->buf_EC[i].y - ec->buf_EC[j].y);
+	ex = buf_complex[i].x;
+	ey = buf_complex[i].y;
 
 	t = ((L64(dx) * L64(ex)) - (L64(dy) * L64(ey)));
 
@@ -616,7 +946,7 @@ i4b_echo_cancel_convolute_fir(struct i4b_echo_cancel *ec,
     /* 0Hz */
 
     dx = ec->buf_XC[0].x;
-    ex = ec->buf_EC[0].x;
+    ex = buf_complex[0].x;
 
     t = (L64(dx) * L64(ex));
 
@@ -628,7 +958,7 @@ i4b_echo_cancel_convolute_fir(struct i4b_echo_cancel *ec,
     /* 4kHz */
 
     dx = ec->buf_XC[I4B_ECHO_CANCEL_N_TAPS].x;
-    ex = ec->buf_EC[I4B_ECHO_CANCEL_N_TAPS].x;
+    ex = buf_complex[I4B_ECHO_CANCEL_N_TAPS].x;
 
     t = (L64(dx) * L64(ex));
 
@@ -659,7 +989,7 @@ i4b_echo_cancel_convolute_fir(struct i4b_echo_cancel *ec,
  * i4b_echo_cancel_complex_adapt - complex adaption
  *
  * Input:
- *  "ec->buf_XC" and "ec->buf_EC"
+ *  "ec->buf_XC", folded, and "ec->buf_EC"
  *
  * Output:
  *  "ec->buf_EC" = "ec->buf_EC" / "ec->buf_XC"
@@ -692,8 +1022,8 @@ i4b_echo_cancel_complex_adapt(struct i4b_echo_cancel *ec)
 
 	j = I4B_ECHO_CANCEL_N_COMPLEX-i;
 
-	dx = (ec->buf_XC[i].x + ec->buf_XC[j].x) / DIV0;
-	dy = (ec->buf_XC[i].y - ec->buf_XC[j].y) / DIV0;
+	dx = ec->buf_XC[i].x / DIV0;
+	dy = ec->buf_XC[i].y / DIV0;
 
 	ex = (ec->buf_EC[i].x + ec->buf_EC[j].x) / DIV0;
 	ey = (ec->buf_EC[i].y - ec->buf_EC[j].y) / DIV0;
@@ -966,10 +1296,15 @@ i4b_echo_cancel_compute_sub(struct i4b_echo_cancel *ec)
      * We need to update the "sine/cosine" domain version of the
      * foreground filter:
      */
-    bzero(ec->buf_HC, sizeof(ec->buf_HC));
+    if (ec->mode == I4B_ECHO_CANCEL_MODE_PART) {
+	i4b_echo_cancel_load_part_h(ec);
+	goto update_buffer;
+    }
 
-    pa = ec->buf_HC;
-    pa_end = ec->buf_HC + I4B_ECHO_CANCEL_N_TAPS;
+    bzero(ec->buf_EC, I4B_ECHO_CANCEL_N_COMPLEX * sizeof(ec->buf_EC[0]));
+
+    pa = ec->buf_EC;
+    pa_end = ec->buf_EC + I4B_ECHO_CANCEL_N_TAPS;
     pc = ec->buf_HR[0];
 
     while (pa != pa_end) {
@@ -980,7 +1315,11 @@ i4b_echo_cancel_compute_sub(struct i4b_echo_cancel *ec)
 
     /* transform impulse response into "sine/cosine" domain */
 
-    i4b_echo_cancel_fft(ec->buf_HC, 0);
+    i4b_echo_cancel_fft(ec->buf_EC, 0);
+
+    i4b_echo_cancel_fold(ec->u.buf_HC, ec->buf_EC);
+
+ update_buffer:
 
     /* update buffer */
 
@@ -994,6 +1333,131 @@ i4b_echo_cancel_compute_sub(struct i4b_echo_cancel *ec)
     return 0;
 }
 
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_compute_part - compute the echo of the filter tail
+ *                                for the next partition
+ *
+ * The echo of filter partition "k", k >= 1, for the samples in the
+ * next partition only depends on speaker samples that have already
+ * been merged. The "sine/cosine" domain version of the last two
+ * partitions of speaker data is computed once and then kept in a
+ * delay line, so that only one small forward and one small inverse
+ * FFT are needed per partition.
+ *---------------------------------------------------------------------------*/
+static uint8_t
+i4b_echo_cancel_compute_part(struct i4b_echo_cancel *ec)
+{
+    struct i4b_complex *pa;
+    int16_t *pb;
+
+    int64_t tx;
+    int64_t ty;
+
+    uint16_t i;
+    uint16_t k;
+    uint8_t p;
+
+    /* update filter at regular intervals! */
+
+    if (ec->offset_e < I4B_ECHO_CANCEL_N_PART) {
+
+	/* load the last 2*N_TAPS merged speaker samples */
+
+	i4b_echo_cancel_load_complex_x(ec, 0);
+
+	if (i4b_echo_cancel_compute_sub(ec)) {
+	    I4B_DBG(1, L1_EC_MSG, "offset adjust -> reset");
+	    goto no_data;
+	}
+    }
+
+    if (ec->offset_rd <= ec->offset_wr) {
+	I4B_DBG(1, L1_EC_MSG, "no more data (2)");
+	goto no_data;
+    }
+
+    /* load the last two partitions of merged speaker samples */
+
+    bzero(ec->buf_EC, I4B_ECHO_CANCEL_N_PART_COMPLEX * sizeof(ec->buf_EC[0]));
+
+    pb = ec->buf_X0 + ec->offset_rd + 1;
+
+    for (i = I4B_ECHO_CANCEL_N_PART_COMPLEX; i != 0; i--) {
+	ec->buf_EC[i - 1].x = (*pb) * I4B_ECHO_CANCEL_N_PRE;
+	pb++;
+    }
+
+    i4b_echo_cancel_fft_part(ec->buf_EC, 0);
+
+    /* insert into delay line */
+
+    if (ec->offset_p == 0) {
+	ec->offset_p = (I4B_ECHO_CANCEL_K_PART - 1);
+    }
+    ec->offset_p--;
+
+    bcopy(ec->buf_EC, ec->part->buf_XP[ec->offset_p],
+	  sizeof(ec->part->buf_XP[0]));
+
+    /* do convolution: sum of ec->part->buf_XP * ec->u.buf_HP */
+
+    for (i = 0; i != (I4B_ECHO_CANCEL_N_PART + 1); i++) {
+
+	tx = 0;
+	ty = 0;
+	p = ec->offset_p;
+
+	for (k = 0; k != (I4B_ECHO_CANCEL_K_PART - 1); k++) {
+
+	    pa = &ec->part->buf_XP[p][i];
+
+	    tx += (L64(pa->x) * L64(ec->u.buf_HP[k][i].x)) -
+		  (L64(pa->y) * L64(ec->u.buf_HP[k][i].y));
+	    ty += (L64(pa->x) * L64(ec->u.buf_HP[k][i].y)) +
+		  (L64(pa->y) * L64(ec->u.buf_HP[k][i].x));
+
+	    if (++p == (I4B_ECHO_CANCEL_K_PART - 1)) {
+		p = 0;
+	    }
+	}
+
+	tx /= I4B_ECHO_CANCEL_N_HR_DP;
+	ty /= I4B_ECHO_CANCEL_N_HR_DP;
+
+	ec->buf_EC[i].x = I32(tx);
+	ec->buf_EC[i].y = I32(ty);
+
+	if ((i != 0) && (i != I4B_ECHO_CANCEL_N_PART)) {
+	    ec->buf_EC[I4B_ECHO_CANCEL_N_PART_COMPLEX - i].x = I32(tx);
+	    ec->buf_EC[I4B_ECHO_CANCEL_N_PART_COMPLEX - i].y = -I32(ty);
+	} else {
+	    /* phase-less components */
+	    ec->buf_EC[i].y = 0;
+	}
+    }
+
+    /* transform estimated echo back into the "time" domain */
+
+    i4b_echo_cancel_fft_part(ec->buf_EC, 1);
+
+    /* keep the second half, in reverse order */
+
+    for (i = 0; i != I4B_ECHO_CANCEL_N_PART; i++) {
+	ec->buf_E0[I4B_ECHO_CANCEL_N_PART - 1 - i] =
+	  ec->buf_EC[I4B_ECHO_CANCEL_N_PART + i].x /
+	  I4B_ECHO_CANCEL_N_PART_COMPLEX;
+    }
+
+    /* store new lengths */
+
+    ec->offset_x = I4B_ECHO_CANCEL_N_PART;
+
+    return 0;
+
+ no_data:
+    return 1;
+}
+
 /*---------------------------------------------------------------------------*
  * i4b_echo_cancel_compute - subroutine
  *---------------------------------------------------------------------------*/
@@ -1002,6 +1466,10 @@ i4b_echo_cancel_compute(struct i4b_echo_cancel *ec)
 {
     uint16_t max_samples;
 
+    if (ec->mode == I4B_ECHO_CANCEL_MODE_PART) {
+	return (i4b_echo_cancel_compute_part(ec));
+    }
+
     /*
      * Buffer ordering overview. In the text below the time goes
      * forward when the number following the letter increments:
@@ -1075,9 +1543,9 @@ i4b_echo_cancel_compute(struct i4b_echo_cancel *ec)
      * Foreground echo computation
      */
 
-    /* do convolution: ec->buf_E0 = ec->buf_XC * ec->buf_HC */
+    /* do convolution: ec->buf_E0 = ec->buf_XC * ec->u.buf_HC */
 
-    i4b_echo_cancel_convolute_fir(ec, ec->buf_HC, ec->buf_E0);
+    i4b_echo_cancel_convolute_fir(ec, ec->u.buf_HC, ec->buf_E0);
 
     return 0;
 
@@ -1085,17 +1553,42 @@ i4b_echo_cancel_compute(struct i4b_echo_cancel *ec)
     return 1;
 }
 
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_head - compute the echo of the first filter partition
+ *                        in the time domain
+ *
+ * inputs:
+ *   px: pointer to the current speaker sample, older samples follow
+ *---------------------------------------------------------------------------*/
+static __inline int32_t
+i4b_echo_cancel_head(struct i4b_echo_cancel *ec, const int16_t *px)
+{
+    const int32_t *ph = ec->buf_HR[0];
+    int64_t t = 0;
+    uint16_t n;
+
+    for (n = 0; n != I4B_ECHO_CANCEL_N_PART; n++) {
+	t += L64(ph[n]) * L64(px[n]);
+    }
+
+    t /= (I4B_ECHO_CANCEL_N_HR_DP / I4B_ECHO_CANCEL_N_PRE);
+
+    return I32(t);
+}
+
 /*---------------------------------------------------------------------------*
  * i4b_echo_cancel_subtract - an implementation of a self adapting FIR filter
  *
  * inputs:
  *   y0: sample from local microphone with echo from local speaker
+ *   px: pointer to the corresponding speaker sample
  *
  * outputs:
  *   sample from local microphone without echo from local speaker
  *---------------------------------------------------------------------------*/
 static int16_t
-i4b_echo_cancel_subtract(struct i4b_echo_cancel *ec, int32_t y0)
+i4b_echo_cancel_subtract(struct i4b_echo_cancel *ec, int32_t y0,
+	const int16_t *px)
 {
     enum {
 	MAX_Y = (I4B_ECHO_CANCEL_N_PRE *
@@ -1123,6 +1616,10 @@ i4b_echo_cancel_subtract(struct i4b_echo_cancel *ec, int32_t y0)
 
     y0 -= ec->buf_E0[ec->offset_x];
 
+    if (ec->mode == I4B_ECHO_CANCEL_MODE_PART) {
+	y0 -= i4b_echo_cancel_head(ec, px);
+    }
+
     /* range check (important) */
 
     if (y0 > MAX_Y) {
@@ -1210,9 +1707,14 @@ i4b_echo_cancel_feed(struct i4b_echo_cancel *ec,
 
 	temp = i4b_echo_cancel_hp_f1(ec, temp);
 
-	/* store sample */
+	/*
+	 * Store sample. The upper half of the ring buffer mirrors
+	 * the lower half, so that the samples are already in place
+	 * when the input offset wraps around.
+	 */
 
 	ec->buf_X0[ec->offset_wr] = temp;
+	ec->buf_X0[ec->offset_wr + I4B_ECHO_CANCEL_F_SIZE] = temp;
 
 	if (ec->offset_wr == 0) {
 
@@ -1220,11 +1722,6 @@ i4b_echo_cancel_feed(struct i4b_echo_cancel *ec,
 
 	    ec->offset_wr = (I4B_ECHO_CANCEL_F_SIZE-1);
 
-	    /* move data to new location */
-
-	    bcopy(ec->buf_X0, ec->buf_X0 + I4B_ECHO_CANCEL_F_SIZE,
-		  I4B_ECHO_CANCEL_F_SIZE * sizeof(ec->buf_X0[0]));
-
 	    /* update output offset */
 
 	    ec->offset_rd += I4B_ECHO_CANCEL_F_SIZE;
@@ -1315,6 +1812,8 @@ i4b_echo_cancel_merge(struct i4b_echo_cancel *ec,
 
     uint8_t *read_ptr_end;
 
+    int16_t *px; /* current sample to speaker */
+
     int16_t sample_y; /* sample from local microphone */
 
     uint16_t max_read_len;
@@ -1323,11 +1822,15 @@ i4b_echo_cancel_merge(struct i4b_echo_cancel *ec,
 
 	/* check if we are out of data */
 
-	if (ec->offset_rd <= ec->offset_wr) {
+	if ((ec->offset_rd <= ec->offset_wr) || (read_len == 0)) {
 	    break;
 	}
 
-	/* check if we need to compute more echo */
+	/*
+	 * Check if we need to compute more echo. The computation
+	 * is deferred until there are samples to process, so that
+	 * "i4b_echo_cancel_precompute()" can do it ahead of time.
+	 */
 
 	if (ec->offset_x == 0) {
 	    if (i4b_echo_cancel_compute(ec)) {
@@ -1353,6 +1856,8 @@ i4b_echo_cancel_merge(struct i4b_echo_cancel *ec,
 
 	read_ptr_end = read_ptr + max_read_len;
 
+	px = ec->buf_X0 + ec->offset_rd;
+
 	while (read_ptr != read_ptr_end) {
 
 	    sample_y = convert_fwd[*read_ptr];
@@ -1363,7 +1868,8 @@ i4b_echo_cancel_merge(struct i4b_echo_cancel *ec,
 
 	    /* filter */
 
-	    sample_y = i4b_echo_cancel_subtract(ec, sample_y);
+	    sample_y = i4b_echo_cancel_subtract(ec, sample_y, px);
+	    px--;
 
 	    /* update */
 
@@ -1379,6 +1885,32 @@ i4b_echo_cancel_merge(struct i4b_echo_cancel *ec,
     return;
 }
 
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_precompute - compute next echo block ahead of merge
+ *
+ * This function is used by controllers having many B-channels, to
+ * compute all echo blocks that are due in a single pass, before the
+ * receive data of each channel is merged.
+ *
+ * returns:
+ *   0: No echo block was computed
+ *   Else: An echo block was computed
+ *---------------------------------------------------------------------------*/
+uint8_t
+i4b_echo_cancel_precompute(struct i4b_echo_cancel *ec)
+{
+    if ((ec->offset_x != 0) ||
+	(ec->offset_rd <= ec->offset_wr)) {
+	return 0;
+    }
+
+    if (i4b_echo_cancel_compute(ec)) {
+	i4b_echo_cancel_coeffs_reset(ec);
+	return 0;
+    }
+    return 1;
+}
+
 /*---------------------------------------------------------------------------*
  * i4b_echo_cancel_fft - I4B echo cancel Fast Fourier Transform
  *
@@ -1755,7 +2287,7 @@ i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse)
 
     /* Do the FFT */
     i4b_echo_cancel_radix4_fp(data, I4B_ECHO_CANCEL_N_COMPLEX);
-    i4b_echo_cancel_radix4_cr(data, fft_table, 4, I4B_ECHO_CANCEL_N_COMPLEX);
+    i4b_echo_cancel_radix4_cr_p(data, fft_table, 4, I4B_ECHO_CANCEL_N_COMPLEX);
 
     data_end = data + I4B_ECHO_CANCEL_N_COMPLEX;
 
@@ -2067,7 +2599,7 @@ i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse)
 
     /* Do the FFT */
     i4b_echo_cancel_radix8_fp(data, I4B_ECHO_CANCEL_N_COMPLEX);
-    i4b_echo_cancel_radix4_cr(data, fft_table, 8, I4B_ECHO_CANCEL_N_COMPLEX);
+    i4b_echo_cancel_radix4_cr_p(data, fft_table, 8, I4B_ECHO_CANCEL_N_COMPLEX);
 
     data_end = data + I4B_ECHO_CANCEL_N_COMPLEX;
 
@@ -2616,7 +3148,7 @@ i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse)
 
     /* Do the FFT */
     i4b_echo_cancel_radix4_fp(data, I4B_ECHO_CANCEL_N_COMPLEX);
-    i4b_echo_cancel_radix4_cr(data, fft_table, 4, I4B_ECHO_CANCEL_N_COMPLEX);
+    i4b_echo_cancel_radix4_cr_p(data, fft_table, 4, I4B_ECHO_CANCEL_N_COMPLEX);
 
     data_end = data + I4B_ECHO_CANCEL_N_COMPLEX;
 
@@ -3629,7 +4161,7 @@ i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse)
 
     /* Do the FFT */
     i4b_echo_cancel_radix8_fp(data, I4B_ECHO_CANCEL_N_COMPLEX);
-    i4b_echo_cancel_radix4_cr(data, fft_table, 8, I4B_ECHO_CANCEL_N_COMPLEX);
+    i4b_echo_cancel_radix4_cr_p(data, fft_table, 8, I4B_ECHO_CANCEL_N_COMPLEX);
 
     data_end = data + I4B_ECHO_CANCEL_N_COMPLEX;
 
@@ -3666,3 +4198,35 @@ i4b_echo_cancel_fft(struct i4b_complex *data, uint8_t inverse)
     return;
 }
 #endif
+
+#ifdef I4B_ECHO_CANCEL_SIMD
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_simd_compare - compare vectorized and scalar FFT
+ *
+ * "a" and "b" must contain the same I4B_ECHO_CANCEL_N_COMPLEX
+ * input values. "a" is transformed using the scalar FFT passes
+ * and "b" using the selected ones. Returns the number of output
+ * values which differ.
+ *---------------------------------------------------------------------------*/
+uint32_t
+i4b_echo_cancel_simd_compare(struct i4b_complex *a, struct i4b_complex *b,
+			     uint8_t inverse)
+{
+    i4b_echo_cancel_radix4_cr_t *func = i4b_echo_cancel_radix4_cr_p;
+    uint32_t retval = 0;
+    uint16_t x;
+
+    i4b_echo_cancel_radix4_cr_p = &i4b_echo_cancel_radix4_cr;
+    i4b_echo_cancel_fft(a, inverse);
+    i4b_echo_cancel_radix4_cr_p = func;
+    i4b_echo_cancel_fft(b, inverse);
+
+    for (x = 0; x != I4B_ECHO_CANCEL_N_COMPLEX; x++) {
+	if (a[x].x != b[x].x)
+	    retval++;
+	if (a[x].y != b[x].y)
+	    retval++;
+    }
+    return (retval);
+}
+#endif
@@ -0,0 +1,61 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *---------------------------------------------------------------------------
+ *
+ *	i4b_echo_cancel.h - echo canceller internal header file
+ *	-------------------------------------------------------
+ *
+ * $FreeBSD: $
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef _I4B_ECHO_CANCEL_H_
+#define	_I4B_ECHO_CANCEL_H_
+
+/*
+ * The radix-4 FFT passes with twiddle factors. "step" is the
+ * butterfly distance of the first pass and is always a multiple
+ * of four. The vectorized versions must give bit-exact results
+ * compared to the scalar reference in "i4b_echo_cancel.c".
+ */
+typedef void (i4b_echo_cancel_radix4_cr_t)(struct i4b_complex *data0,
+    const struct i4b_complex *table0, uint16_t step, uint16_t n);
+
+#if defined(__amd64__) || defined(__i386__)
+extern i4b_echo_cancel_radix4_cr_t i4b_echo_cancel_radix4_cr_avx2;
+#endif
+
+#if defined(__aarch64__)
+extern i4b_echo_cancel_radix4_cr_t i4b_echo_cancel_radix4_cr_neon;
+#endif
+
+#ifdef I4B_ECHO_CANCEL_SIMD
+extern const char *i4b_echo_cancel_simd_name;
+
+extern uint32_t i4b_echo_cancel_simd_compare(struct i4b_complex *a,
+    struct i4b_complex *b, uint8_t inverse);
+#endif
+
+#endif					/* _I4B_ECHO_CANCEL_H_ */
@@ -0,0 +1,178 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ * i4b_echo_cancel_avx2.c - AVX2 version of the echo canceller FFT passes
+ *
+ * NOTE: This file must be compiled with "-mavx2".
+ */
+
+#ifdef I4B_GLOBAL_INCLUDE_FILE
+#include I4B_GLOBAL_INCLUDE_FILE
+#else
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/proc.h>
+#ifdef __amd64__
+#include <machine/fpu.h>
+#else
+#include <machine/npx.h>
+#endif
+#endif
+
+#include <i4b/include/i4b_controller.h>
+
+#include <i4b/layer1/i4b_echo_cancel.h>
+
+#include <immintrin.h>
+
+/*---------------------------------------------------------------------------*
+ * i4b_avx2_mul_shift30 - lane-wise equivalent of MUL_SHIFT30()
+ *---------------------------------------------------------------------------*/
+static __inline __m256i
+i4b_avx2_mul_shift30(__m256i a, __m256i b)
+{
+    __m256i even;
+    __m256i odd;
+
+    even = _mm256_mul_epi32(a, b);
+    odd = _mm256_mul_epi32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(b, 32));
+
+    /* extract bits 30..61 of each product */
+    return (_mm256_blend_epi32(_mm256_srli_epi64(even, 30),
+	_mm256_slli_epi64(odd, 2), 0xAA));
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_avx2_twiddle - multiply four complex samples by their twiddle factors
+ *---------------------------------------------------------------------------*/
+static __inline __m256i
+i4b_avx2_twiddle(__m256i b, const struct i4b_complex *table)
+{
+    __m256i w;
+    __m256i ws;
+    __m256i wd;
+    __m256i tr;
+
+    /* [ws0, wi0, ws1, wi1, ws2, wi2, ws3, wi3] */
+    w = _mm256_inserti128_si256(_mm256_castsi128_si256(
+	_mm_unpacklo_epi64(
+	_mm_loadl_epi64((const __m128i *)(table + 0)),
+	_mm_loadl_epi64((const __m128i *)(table + 3)))),
+	_mm_unpacklo_epi64(
+	_mm_loadl_epi64((const __m128i *)(table + 6)),
+	_mm_loadl_epi64((const __m128i *)(table + 9))), 1);
+
+    /* [wi0, ws0, wi1, ws1, ...] */
+    ws = _mm256_shuffle_epi32(w, _MM_SHUFFLE(2, 3, 0, 1));
+
+    /* [ws0 + 2*wi0, ws0, ws1 + 2*wi1, ws1, ...] */
+    wd = _mm256_add_epi32(w, _mm256_add_epi32(ws, ws));
+    wd = _mm256_blend_epi32(wd, ws, 0xAA);
+
+    /* tr = wi * (br + bi) */
+    tr = i4b_avx2_mul_shift30(
+	_mm256_shuffle_epi32(w, _MM_SHUFFLE(3, 3, 1, 1)),
+	_mm256_add_epi32(b, _mm256_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1))));
+
+    /* [-tr, tr, -tr, tr, ...] */
+    tr = _mm256_blend_epi32(_mm256_sub_epi32(_mm256_setzero_si256(), tr),
+	tr, 0xAA);
+
+    return (_mm256_add_epi32(i4b_avx2_mul_shift30(wd, b), tr));
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_radix4_cr_avx2 - processes four butterflies at a time
+ *---------------------------------------------------------------------------*/
+void
+i4b_echo_cancel_radix4_cr_avx2(struct i4b_complex *data0,
+			       const struct i4b_complex *table0,
+			       uint16_t step, uint16_t n)
+{
+    struct i4b_complex *data;
+    struct i4b_complex *data_end0;
+    struct i4b_complex *data_end1;
+    const struct i4b_complex *table;
+
+    __m256i a, b, c, d, s, t;
+
+    fpu_kern_enter(curthread, NULL, FPU_KERN_NORMAL | FPU_KERN_NOCTX);
+
+    while (step < n) {
+
+        data = data0;
+	data_end0 = data0 + n;
+
+	while (data != data_end0) {
+
+	    table = table0;
+	    data_end1 = data + step;
+
+	    while (data != data_end1) {
+
+		a = _mm256_loadu_si256((const __m256i *)(data));
+		b = _mm256_loadu_si256((const __m256i *)(data + step));
+		c = _mm256_loadu_si256((const __m256i *)(data + (2*step)));
+		d = _mm256_loadu_si256((const __m256i *)(data + (3*step)));
+
+		b = i4b_avx2_twiddle(b, table + 0);
+		c = i4b_avx2_twiddle(c, table + 1);
+		d = i4b_avx2_twiddle(d, table + 2);
+		table += 12;
+
+		/* [cr + dr, ci + di] and [cr - dr, ci - di] */
+		s = _mm256_add_epi32(c, d);
+		t = _mm256_sub_epi32(c, d);
+
+		/* [di - ci, cr - dr] */
+		t = _mm256_shuffle_epi32(t, _MM_SHUFFLE(2, 3, 0, 1));
+		t = _mm256_blend_epi32(
+		    _mm256_sub_epi32(_mm256_setzero_si256(), t), t, 0xAA);
+
+		/* [ar + br, ai + bi] and [ar - br, ai - bi] */
+		c = _mm256_add_epi32(a, b);
+		d = _mm256_sub_epi32(a, b);
+
+		_mm256_storeu_si256((__m256i *)(data),
+		    _mm256_add_epi32(c, s));
+		_mm256_storeu_si256((__m256i *)(data + step),
+		    _mm256_sub_epi32(d, t));
+		_mm256_storeu_si256((__m256i *)(data + (2*step)),
+		    _mm256_sub_epi32(c, s));
+		_mm256_storeu_si256((__m256i *)(data + (3*step)),
+		    _mm256_add_epi32(d, t));
+
+		data += 4;
+	    }
+	    data += (3*step);
+	}
+	table0 += (3*step);
+	step *= 4;
+    }
+
+    fpu_kern_leave(curthread, NULL);
+    return;
+}
@@ -0,0 +1,161 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ *
+ * i4b_echo_cancel_neon.c - NEON version of the echo canceller FFT passes
+ *
+ * NOTE: This file must be compiled without "-mgeneral-regs-only".
+ */
+
+#ifdef I4B_GLOBAL_INCLUDE_FILE
+#include I4B_GLOBAL_INCLUDE_FILE
+#else
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/mbuf.h>
+#include <sys/proc.h>
+#include <machine/vfp.h>
+#endif
+
+#include <i4b/include/i4b_controller.h>
+
+#include <i4b/layer1/i4b_echo_cancel.h>
+
+#include <arm_neon.h>
+
+/*---------------------------------------------------------------------------*
+ * i4b_neon_mul_shift30 - lane-wise equivalent of MUL_SHIFT30()
+ *---------------------------------------------------------------------------*/
+static __inline int32x4_t
+i4b_neon_mul_shift30(int32x4_t a, int32x4_t b)
+{
+    /* extract bits 30..61 of each product */
+    return (vcombine_s32(
+	vshrn_n_s64(vmull_s32(vget_low_s32(a), vget_low_s32(b)), 30),
+	vshrn_n_s64(vmull_high_s32(a, b), 30)));
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_neon_twiddle - multiply two complex samples by their twiddle factors
+ *---------------------------------------------------------------------------*/
+static __inline int32x4_t
+i4b_neon_twiddle(int32x4_t b, const struct i4b_complex *table,
+    uint32x4_t x_mask)
+{
+    int32x4_t w;
+    int32x4_t ws;
+    int32x4_t wd;
+    int32x4_t tr;
+
+    /* [ws0, wi0, ws1, wi1] */
+    w = vcombine_s32(vld1_s32(&table[0].x), vld1_s32(&table[3].x));
+
+    /* [wi0, ws0, wi1, ws1] */
+    ws = vrev64q_s32(w);
+
+    /* [ws0 + 2*wi0, ws0, ws1 + 2*wi1, ws1] */
+    wd = vbslq_s32(x_mask, vaddq_s32(w, vaddq_s32(ws, ws)), ws);
+
+    /* tr = wi * (br + bi) */
+    tr = i4b_neon_mul_shift30(vtrn2q_s32(w, w),
+	vaddq_s32(b, vrev64q_s32(b)));
+
+    /* [-tr, tr, -tr, tr] */
+    tr = vbslq_s32(x_mask, vnegq_s32(tr), tr);
+
+    return (vaddq_s32(i4b_neon_mul_shift30(wd, b), tr));
+}
+
+/*---------------------------------------------------------------------------*
+ * i4b_echo_cancel_radix4_cr_neon - processes two butterflies at a time
+ *---------------------------------------------------------------------------*/
+void
+i4b_echo_cancel_radix4_cr_neon(struct i4b_complex *data0,
+			       const struct i4b_complex *table0,
+			       uint16_t step, uint16_t n)
+{
+    static const uint32_t x_mask_data[4] = { -1U, 0, -1U, 0 };
+
+    struct i4b_complex *data;
+    struct i4b_complex *data_end0;
+    struct i4b_complex *data_end1;
+    const struct i4b_complex *table;
+
+    uint32x4_t x_mask;
+    int32x4_t a, b, c, d, s, t;
+
+    fpu_kern_enter(curthread, NULL, FPU_KERN_NORMAL | FPU_KERN_NOCTX);
+
+    x_mask = vld1q_u32(x_mask_data);
+
+    while (step < n) {
+
+        data = data0;
+	data_end0 = data0 + n;
+
+	while (data != data_end0) {
+
+	    table = table0;
+	    data_end1 = data + step;
+
+	    while (data != data_end1) {
+
+		a = vld1q_s32(&data[0].x);
+		b = vld1q_s32(&data[step].x);
+		c = vld1q_s32(&data[2*step].x);
+		d = vld1q_s32(&data[3*step].x);
+
+		b = i4b_neon_twiddle(b, table + 0, x_mask);
+		c = i4b_neon_twiddle(c, table + 1, x_mask);
+		d = i4b_neon_twiddle(d, table + 2, x_mask);
+		table += 6;
+
+		/* [cr + dr, ci + di] and [cr - dr, ci - di] */
+		s = vaddq_s32(c, d);
+		t = vsubq_s32(c, d);
+
+		/* [di - ci, cr - dr] */
+		t = vrev64q_s32(t);
+		t = vbslq_s32(x_mask, vnegq_s32(t), t);
+
+		/* [ar + br, ai + bi] and [ar - br, ai - bi] */
+		c = vaddq_s32(a, b);
+		d = vsubq_s32(a, b);
+
+		vst1q_s32(&data[0].x, vaddq_s32(c, s));
+		vst1q_s32(&data[step].x, vsubq_s32(d, t));
+		vst1q_s32(&data[2*step].x, vsubq_s32(c, s));
+		vst1q_s32(&data[3*step].x, vaddq_s32(d, t));
+
+		data += 2;
+	    }
+	    data += (3*step);
+	}
+	table0 += (3*step);
+	step *= 4;
+    }
+
+    fpu_kern_leave(curthread, NULL);
+    return;
+}
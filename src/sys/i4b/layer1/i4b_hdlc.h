@@ -37,6 +37,10 @@
 extern const uint16_t HDLC_FCS_TAB[256];
 extern const uint16_t HDLC_BIT_TAB[256];
 
+extern uint16_t i4b_hdlc_fcs(uint16_t crc, const uint8_t *ptr, uint32_t len);
+extern uint32_t i4b_hdlc_idle(const uint8_t *ptr, uint32_t len, uint16_t tmp,
+			      uint8_t blevel, uint16_t ib, uint8_t flag);
+
 /*---------------------------------------------------------------------------*
  *      HDLC_DECODE
  *      ===========
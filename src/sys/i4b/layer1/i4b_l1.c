@@ -111,6 +111,8 @@ i4b_controller_setup(void *arg)
 	cntl->L1_lock_ptr =
 	  &(i4b_controller[unit & mask].L1_lock_data);
 
+	cntl->mbuf_pool.mtx = cntl->L1_lock_ptr;
+
 	unit++;
   }
   return;
@@ -138,6 +140,8 @@ SYSUNINIT(i4b_controller_unsetup, SI_SUB_LOCK, SI_ORDER_ANY, i4b_controller_unse
 static void
 i4b_controller_reset(struct i4b_controller *cntl)
 {
+  /* the mbuf pool is outside the zeroed area */
+  i4b_mbuf_pool_drain(&cntl->mbuf_pool);
 
   mtx_lock(&i4b_global_lock);
 
@@ -137,20 +137,23 @@ filter_rx FIFO_FILTER_T(sc,f)
         /* RX data */
         FIFO_READ_MULTI_1(sc,f,(f->buf_ptr),(io_len));
 
+	f->stat.bytes += io_len;
+
 	if(f->prot_curr.protocol_1 == P_TRANSPARENT)
 	{
 	    /* echo cancel first */
-	    if(f->prot_curr.u.transp.echo_cancel_enable)
+	    if((f->prot_curr.u.transp.echo_cancel_enable) &&
+	       (FIFO_ECHO_CANCEL(sc,f) != NULL))
 	    {
-	        struct i4b_echo_cancel *ec = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
+	        struct i4b_echo_cancel *ec = FIFO_ECHO_CANCEL(sc,f);
 		i4b_echo_cancel_merge(ec, f->buf_ptr, io_len);
 	    }
 
-	    /* DTMF detect second */ 
+	    /* DTMF collect second, see "ihfc_dtmf_detect_all()" */ 
 	    if(f->prot_curr.u.transp.dtmf_detect_enable)
 	    {
 	        struct fifo_translator *ft = FIFO_TRANSLATOR(sc,f);
-		i4b_dtmf_detect(ft, f->buf_ptr, io_len);
+		i4b_dtmf_collect(ft, f->buf_ptr, io_len);
 	    }
 	}
 
@@ -236,9 +239,10 @@ rx_transparent FIFO_FILTER_T(sc,f)
  done:
 	/* echo cancel */
 	if((f->prot_curr.protocol_1 == P_TRANSPARENT) &&
-	   (f->prot_curr.u.transp.echo_cancel_enable))
+	   (f->prot_curr.u.transp.echo_cancel_enable) &&
+	   (FIFO_ECHO_CANCEL(sc,f) != NULL))
 	{
-	    struct i4b_echo_cancel *ec = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
+	    struct i4b_echo_cancel *ec = FIFO_ECHO_CANCEL(sc,f);
 	    i4b_echo_cancel_update_merger(ec, f->Z_read_time - f->Z_chip);
 	}
 	return;
@@ -476,6 +480,18 @@ rx_hdlc_emulation FIFO_FILTER_T(sc,f)
 
 	    while(src != src_end)
 	    {
+		if(f->hdlc.flag < 2)
+		{
+		    /* skip idle bytes between frames */
+		    src += i4b_hdlc_idle(src, src_end - src, tmp, blevel,
+					 ib, f->hdlc.flag);
+
+		    if(src == src_end)
+		    {
+		        break;
+		    }
+		}
+
 		HDLC_DECODE(*dst++, len, tmp, tmp2, blevel, ib, crc, (f->hdlc.flag),
 		{/* rdd */
 			tmp2 = *src++;
@@ -609,11 +625,14 @@ filter_tx FIFO_FILTER_T(sc,f)
         /* TX data */
         FIFO_WRITE_MULTI_1(sc,f,(f->buf_ptr),(io_len));
 
+	f->stat.bytes += io_len;
+
 	/* echo cancel */
 	if((f->prot_curr.protocol_1 == P_TRANSPARENT) &&
-	   (f->prot_curr.u.transp.echo_cancel_enable))
+	   (f->prot_curr.u.transp.echo_cancel_enable) &&
+	   (FIFO_ECHO_CANCEL(sc,f) != NULL))
 	{
-	    struct i4b_echo_cancel *ec = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
+	    struct i4b_echo_cancel *ec = FIFO_ECHO_CANCEL(sc,f);
  	    i4b_echo_cancel_feed(ec, f->buf_ptr, io_len);
 	}
 
@@ -641,8 +660,8 @@ get_mbuf_tx FIFO_FILTER_T(sc,f)
 	if(f->mbuf) {
 	  /* setup buffer */
 	  f->buf_size =
-          f->buf_len  =  f->mbuf->m_len;
-	  f->buf_ptr  =  f->mbuf->m_data;
+          f->buf_len  =  f->mbuf_curr->m_len;
+	  f->buf_ptr  =  f->mbuf_curr->m_data;
 	} else {
 	  /* reset buffer */
 	  f->buf_size =
@@ -651,12 +670,29 @@ get_mbuf_tx FIFO_FILTER_T(sc,f)
 	}
 }
 
+static uint8_t
+get_mbuf_next_tx FIFO_FILTER_T(sc,f)
+{
+	/* continue with the next mbuf
+	 * in the chain, if any
+	 */
+	if(ihfc_i4b_nextmbuf(sc, f) == NULL) {
+	  return 0;
+	}
+
+	/* setup buffer */
+	f->buf_size =
+	f->buf_len  =  f->mbuf_curr->m_len;
+	f->buf_ptr  =  f->mbuf_curr->m_data;
+	return 1;
+}
+
 static void
 tx_transparent FIFO_FILTER_T(sc,f)
 {
 	do {
 	  /* check f->buf_len */
-	  if(!f->buf_len)
+	  if((!f->buf_len) && (!get_mbuf_next_tx(sc,f)))
 	  {
 		/* assume frame is done */
 		get_mbuf_tx(sc,f);
@@ -680,9 +716,10 @@ tx_transparent FIFO_FILTER_T(sc,f)
  done:
 	/* echo cancel */
 	if((f->prot_curr.protocol_1 == P_TRANSPARENT) &&
-	   (f->prot_curr.u.transp.echo_cancel_enable))
+	   (f->prot_curr.u.transp.echo_cancel_enable) &&
+	   (FIFO_ECHO_CANCEL(sc,f) != NULL))
 	{
-	    struct i4b_echo_cancel *ec = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
+	    struct i4b_echo_cancel *ec = FIFO_ECHO_CANCEL(sc,f);
 	    uint8_t temp_buf[64];
 	    uint16_t io_len;
 
@@ -725,15 +762,21 @@ tx_hdlc FIFO_FILTER_T(sc,f)
 	{
 		/* restore original pointers
 		 * and try repeating the current
-		 * frame
+		 * frame, from the first mbuf
+		 * of the chain
 		 */
-		f->buf_ptr -= f->buf_size - f->buf_len;
-		f->buf_len  = f->buf_size;
+		if(f->mbuf)
+		{
+			f->mbuf_curr = f->mbuf;
+			f->buf_size  = f->mbuf->m_len;
+			f->buf_ptr   = f->mbuf->m_data;
+		}
+		f->buf_len = f->buf_size;
 	}
 
 	do {
 	  /* check f->buf_len */
-	  if(!f->buf_len)
+	  if((!f->buf_len) && (!get_mbuf_next_tx(sc,f)))
 	  {
 		if(f->mbuf)
 		{ /* currently add a flag after all mbufs and
@@ -909,8 +952,8 @@ tx_hdlc_emulation FIFO_FILTER_T(sc,f)
 	  if(f->mbuf)
 	  {
 		/* resume */
-		src = f->mbuf->m_data;
-		len = f->mbuf->m_len;
+		src = f->mbuf_curr->m_data;
+		len = f->mbuf_curr->m_len;
 
 		/* currently do nothing on XDU hence
 		 * it is hard to know which frame
@@ -939,8 +982,8 @@ tx_hdlc_emulation FIFO_FILTER_T(sc,f)
 
 			if(f->mbuf)
 			{
-				src = f->mbuf->m_data;
-				len = f->mbuf->m_len;
+				src = f->mbuf_curr->m_data;
+				len = f->mbuf_curr->m_len;
 			}
 			else
 			{
@@ -957,6 +1000,11 @@ tx_hdlc_emulation FIFO_FILTER_T(sc,f)
 			}
 		},
 		{/* nmb */
+			if(ihfc_i4b_nextmbuf(sc, f))
+			{
+				src = f->mbuf_curr->m_data;
+				len = f->mbuf_curr->m_len;
+			}
 		},
 		{/* wrd */
 			*dst++ = (uint8_t)(tmp);
@@ -964,13 +1012,13 @@ tx_hdlc_emulation FIFO_FILTER_T(sc,f)
 		dd );
 	  }
 
-	  /* suspend "f->mbuf->m_len" and "f->mbuf->m_data"
-	   * if "f->mbuf" is present
+	  /* suspend "m_len" and "m_data" of the
+	   * current mbuf, if "f->mbuf" is present
 	   */
 	  if(f->mbuf)
 	  {
-		f->mbuf->m_data = src;
-		f->mbuf->m_len  = len;
+		f->mbuf_curr->m_data = src;
+		f->mbuf_curr->m_len  = len;
 	  }
 
 	  /* suspend HDLC variables */
@@ -1049,8 +1097,8 @@ tx_hdlc_emulation_dchan FIFO_FILTER_T(sc,f)
 	  if(f->mbuf)
 	  {
 		/* resume */
-		src = f->mbuf->m_data;
-		len = f->mbuf->m_len;
+		src = f->mbuf_curr->m_data;
+		len = f->mbuf_curr->m_len;
 
 		/* currently do nothing on XDU hence
 		 * it is hard to know which frame
@@ -1079,8 +1127,8 @@ tx_hdlc_emulation_dchan FIFO_FILTER_T(sc,f)
 
 			if(f->mbuf)
 			{
-				src = f->mbuf->m_data;
-				len = f->mbuf->m_len;
+				src = f->mbuf_curr->m_data;
+				len = f->mbuf_curr->m_len;
 			}
 			else
 			{
@@ -1097,6 +1145,11 @@ tx_hdlc_emulation_dchan FIFO_FILTER_T(sc,f)
 			}
 		},
 		{/* nmb */
+			if(ihfc_i4b_nextmbuf(sc, f))
+			{
+				src = f->mbuf_curr->m_data;
+				len = f->mbuf_curr->m_len;
+			}
 		},
 		{/* wrd */
 			*dst++ = (uint8_t)(tmp);
@@ -1104,13 +1157,13 @@ tx_hdlc_emulation_dchan FIFO_FILTER_T(sc,f)
 		dd );
 	  }
 
-	  /* suspend "f->mbuf->m_len" and "f->mbuf->m_data"
-	   * if "f->mbuf" is present
+	  /* suspend "m_len" and "m_data" of the
+	   * current mbuf, if "f->mbuf" is present
 	   */
 	  if(f->mbuf)
 	  {
-		f->mbuf->m_data = src;
-		f->mbuf->m_len  = len;
+		f->mbuf_curr->m_data = src;
+		f->mbuf_curr->m_len  = len;
 	  }
 
 	  /* suspend HDLC variables */
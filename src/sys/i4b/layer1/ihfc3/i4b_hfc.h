@@ -124,11 +124,7 @@ hfcs_fifo_frame_check FIFO_FRAME_CHECK_T(sc,f,m)
 	}
 
 	/* generate CRC */
-	while(len--)
-	{
-	    crc = (HDLC_FCS_TAB[(uint8_t)(*ptr++ ^ crc)]
-		   ^ (uint8_t)(crc >> 8));
-	}
+	crc = i4b_hdlc_fcs(crc, ptr, len);
 
 	/* check CRC */
 	if(crc ^ 0x3933 /* (0xf0b8) */)
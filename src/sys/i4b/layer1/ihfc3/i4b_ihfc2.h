@@ -57,6 +57,7 @@
 # include <sys/proc.h>		/* thread + msleep stuff */
 # include <machine/bus.h>
 # include <sys/callout.h>
+# include <sys/taskqueue.h>
 # include <sys/bus.h>
 # include <sys/linker_set.h>
 # include <sys/filio.h>
@@ -387,6 +388,22 @@ enum
 #error "too many channels, please update I4B"
 #endif
 
+/* maximum number of times a FIFO program
+ * may loop per wakeup:
+ */
+#define IHFC_FIFO_QUOTA 32
+
+/* maximum poll delay when no B-channels are active,
+ * which is a few times the chip default, but not
+ * more than 1/4 second, so that the D-channel FIFOs
+ * do not overflow:
+ */
+#define IHFC_POLL_IDLE_FACTOR 4
+#define IHFC_POLL_DELAY_IDLE(sc)					\
+  max((sc)->sc_default.d_interrupt_delay,				\
+      min(IHFC_POLL_IDLE_FACTOR * (sc)->sc_default.d_interrupt_delay,	\
+	  (uint32_t)(hz / 4)))
+
 /* only for 2B+1D - channel devices: */
 #define GROUP_DCHAN(sc) ((sc)->sc_config.s_fifo_en & (0x10|0x20))
 #define GROUP_BCHAN(sc) ((sc)->sc_config.s_fifo_en & (0x01|0x02|0x04|0x08))
@@ -729,7 +746,7 @@ do {							\
  *	structs related to i4b mbufs  				(all chips)
  *---------------------------------------------------------------------------*/
 #define I4B_FREEMBUF(f,mbuf)			\
-  m_freem(mbuf)
+  i4b_mbuf_pool_put((f)->mbuf_pool,mbuf)
 
 #define I4B_CLEANIFQ(f,ifqueue)			\
   IF_DRAIN(ifqueue)
@@ -1319,10 +1336,16 @@ struct sc_fifo {
 	/* /dev/ihfcX.X interface */
 	uint16_t	mbuf_rem_length; /* remaining data length */
 	struct mbuf *	mbuf;
+	struct mbuf *	mbuf_curr;	/* current mbuf in TX chain */
 	struct mbuf *	mbuf_dev;	/* used by /dev/ihfcX.X */
 	struct _ifqueue	ifqueue;	/* used by /dev/ihfcX.X */
 
 	uint32_t	io_stat;
+
+	fifostat_t	stat;		/* FIFO statistics */
+	uint32_t	stat_time_last;	/* time of last service in us */
+
+	struct i4b_mbuf_pool *mbuf_pool; /* recycles freed mbufs */
 };
 
 struct regdata {
@@ -2585,6 +2608,12 @@ struct ihfc_sc {
 	struct callout	sc_pollout_timr;      /* T50 ms  */
 	struct callout	sc_pollout_timr_wait; /* T125 us */
 
+	/* adaptive polling */
+	pollstat_t	sc_pollstat;	/* interrupt and poll statistics */
+	uint32_t	sc_poll_delay;	/* current poll delay in ticks */
+	int		sc_poll_ticks;	/* when the poll timer expires */
+	uint32_t	sc_poll_work;	/* FIFO loops during last wakeup */
+
 	uint8_t		sc_buffer[1024] __aligned(4);
   
 	struct sc_fifo *	sc_fifo_select_last; /* used by 
@@ -2598,7 +2627,13 @@ struct ihfc_sc {
 	/* ihfc application interface /dev/ihfc.XXX */
 	struct cdev *		sc_test_dev[IHFC_CHANNELS/2];
 
-	struct i4b_echo_cancel  sc_echo_cancel[IHFC_CHANNELS/2];
+	/* echo cancellers are only allocated when enabled */
+	struct i4b_echo_cancel *sc_echo_cancel[IHFC_CHANNELS/2];
+#define FIFO_ECHO_CANCEL(sc,f) ((sc)->sc_echo_cancel[FIFO_NO(f)/2])
+	struct i4b_echo_cancel_part *sc_echo_cancel_part[IHFC_CHANNELS/2];
+#define FIFO_ECHO_CANCEL_PART(sc,f) ((sc)->sc_echo_cancel_part[FIFO_NO(f)/2])
+	struct i4b_echo_cancel_scratch sc_echo_cancel_scratch;
+	struct task		sc_echo_cancel_task;
 
 	uint16_t		sc_f0_counter_offset;
 	uint32_t		sc_f0_counter_last;
@@ -813,6 +813,117 @@ ihfc_fifo_link(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	return;
 }
 
+/*---------------------------------------------------------------------------*
+ * : compute the maximum poll delay
+ *
+ * The limit is the chip default reduced by the number of active
+ * B-channels. When no B-channels are active, the limit is raised
+ * above the chip default, see IHFC_POLL_DELAY_IDLE().
+ *---------------------------------------------------------------------------*/
+static uint32_t
+ihfc_poll_limit(ihfc_sc_t *sc)
+{
+	ihfc_fifo_t *f;
+	uint32_t limit = sc->sc_default.d_interrupt_delay;
+	uint32_t n = 0;
+
+	if(limit >= (uint32_t)(1 * hz))
+	{
+	    /* sleep mode */
+	    return limit;
+	}
+
+	FIFO_FOREACH(f,sc)
+	{
+	    if(FIFO_CMP(f,>=,b1t) &&
+	       (FIFO_DIR(f) == receive) &&
+	       (f->prot_curr.protocol_1 != P_DISABLE))
+	    {
+	        n++;
+	    }
+	}
+
+	if(n == 0)
+	{
+	    /* idle, poll less often */
+	    limit = IHFC_POLL_DELAY_IDLE(sc);
+	}
+	else
+	{
+	    limit /= (1 + (n / 2));
+	}
+
+	if(limit == 0)
+	{
+	    limit = 1;
+	}
+	return limit;
+}
+
+/*---------------------------------------------------------------------------*
+ * : compute the next poll delay
+ *
+ * When FIFO programs had to loop since the last poll, the
+ * FIFOs fill faster than they are drained, and the delay is
+ * halved. Else the delay grows back by 1/8 towards the limit
+ * given by ihfc_poll_limit().
+ *---------------------------------------------------------------------------*/
+static uint32_t
+ihfc_poll_delay(ihfc_sc_t *sc)
+{
+	uint32_t delay = sc->sc_poll_delay;
+	uint32_t limit = ihfc_poll_limit(sc);
+
+	if(limit >= (uint32_t)(1 * hz))
+	{
+	    /* sleep mode */
+	    delay = limit;
+	}
+	else
+	{
+	    if(sc->sc_poll_work)
+	    {
+	        delay /= 2;
+	    }
+	    else
+	    {
+	        delay += (delay / 8) + 1;
+	    }
+
+	    if(delay > limit)
+	    {
+	        delay = limit;
+	    }
+
+	    if(delay == 0)
+	    {
+	        delay = 1;
+	    }
+	}
+
+	sc->sc_poll_delay = delay;
+	sc->sc_poll_work = 0;
+
+	return delay;
+}
+
+/*---------------------------------------------------------------------------*
+ * : ihfc poll routine
+ *---------------------------------------------------------------------------*/
+static void
+ihfc_chip_poll(void *arg)
+{
+	ihfc_sc_t *sc = (ihfc_sc_t *)arg;
+
+	/* callouts are run with the driver mutex locked */
+
+	sc->sc_pollstat.polls++;
+
+	__ihfc_chip_interrupt(sc);
+
+	return;
+}
+
 /*---------------------------------------------------------------------------*
  * : ihfc interrupt routine
  *---------------------------------------------------------------------------*/
@@ -837,6 +948,8 @@ __ihfc_chip_interrupt(ihfc_sc_t *sc)
 	if(!sc->sc_chip_interrupt_called)
 	{   sc->sc_chip_interrupt_called = 1;
 
+	    sc->sc_pollstat.wakeups++;
+
 	    /* read status */
 	    CHIP_STATUS_READ(sc);
 
@@ -892,18 +1005,31 @@ __ihfc_chip_interrupt(ihfc_sc_t *sc)
 		{
 		    callout_reset(&sc->sc_pollout_timr_wait,
 				    SC_T125_WAIT_DELAY,
-				    (void *)(void *)&__ihfc_chip_interrupt, sc);
+				    &ihfc_chip_poll, sc);
 		}
 	      }
 
-	      /* delay 50 millisecond (data delay) */
-	      if(!callout_pending(&sc->sc_pollout_timr))
+	      /* delay up to 50 millisecond (data delay). If
+	       * B-channels have become active while the timer
+	       * is pending with a longer delay, restart it:
+	       */
+	      if((!callout_pending(&sc->sc_pollout_timr)) ||
+		 ((int)(sc->sc_poll_ticks - ticks) >
+		  (int)ihfc_poll_limit(sc)))
 	      {
-		callout_reset(&sc->sc_pollout_timr,
-				sc->sc_default.d_interrupt_delay,
-				(void *)(void *)&__ihfc_chip_interrupt, sc);
+		uint32_t delay = ihfc_poll_delay(sc);
+
+		sc->sc_poll_ticks = ticks + delay;
+
+		callout_reset(&sc->sc_pollout_timr, delay,
+				&ihfc_chip_poll, sc);
 	      }
 	    }
+	    else
+	    {
+	      /* delay is not used */
+	      sc->sc_poll_work = 0;
+	    }
 
 	    /* clear ``sc_chip_interrupt_called'' */
 	    sc->sc_chip_interrupt_called = 0;
@@ -923,6 +1049,8 @@ ihfc_chip_interrupt(void *arg)
 
 	IHFC_LOCK(sc); 
 
+	sc->sc_pollstat.interrupts++;
+
 	__ihfc_chip_interrupt(sc);
 
 	IHFC_UNLOCK(sc);
@@ -976,6 +1104,174 @@ ihfc_fifo_call(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	return;
 }
 
+/*---------------------------------------------------------------------------*
+ * : allocate the echo cancellers of a controller
+ *
+ * The echo canceller states are big, and are only allocated for
+ * the channels which have echo cancellation enabled. They cannot be
+ * allocated while holding the controller mutex, so this is done by
+ * a task, which is queued by ihfc_echo_cancel_setup(). Until the
+ * task has run, the data of the channel is passed through without
+ * echo cancellation. The states are kept until detach.
+ *---------------------------------------------------------------------------*/
+static void
+ihfc_echo_cancel_alloc_task(void *arg, int pending)
+{
+	ihfc_sc_t *sc = arg;
+	struct i4b_echo_cancel *ec;
+	struct i4b_echo_cancel_part *part;
+	ihfc_fifo_t *f;
+	uint16_t n;
+	uint8_t need_ec;
+	uint8_t need_part;
+
+	for(n = 0; n != (sc->sc_default.d_channels/2); n++)
+	{
+	    f = &(sc->sc_fifo[(2*n) | receive]);
+	    ec = NULL;
+	    part = NULL;
+
+	    IHFC_LOCK(sc);
+	    need_ec = (PROT_IS_TRANSPARENT(&(f->prot_curr)) &&
+		       (f->prot_curr.u.transp.echo_cancel_enable) &&
+		       (FIFO_ECHO_CANCEL(sc,f) == NULL));
+	    need_part = (PROT_IS_TRANSPARENT(&(f->prot_curr)) &&
+			 (f->prot_curr.u.transp.echo_cancel_enable) &&
+			 (f->prot_curr.u.transp.echo_cancel_mode ==
+			  I4B_ECHO_CANCEL_MODE_PART) &&
+			 (FIFO_ECHO_CANCEL_PART(sc,f) == NULL));
+	    IHFC_UNLOCK(sc);
+
+	    if(!(need_ec || need_part))
+	    {
+	        continue;
+	    }
+
+	    if(need_ec)
+	    {
+	        ec = malloc(sizeof(*ec), M_TEMP, M_WAITOK);
+	    }
+	    if(need_part)
+	    {
+	        part = malloc(sizeof(*part), M_TEMP, M_WAITOK);
+	    }
+
+	    IHFC_LOCK(sc);
+	    if((ec != NULL) && (FIFO_ECHO_CANCEL(sc,f) == NULL))
+	    {
+	        FIFO_ECHO_CANCEL(sc,f) = ec;
+		ec = NULL;
+	    }
+	    if((part != NULL) && (FIFO_ECHO_CANCEL_PART(sc,f) == NULL))
+	    {
+	        FIFO_ECHO_CANCEL_PART(sc,f) = part;
+		part = NULL;
+	    }
+
+	    /* start the echo canceller */
+	    ihfc_echo_cancel_setup(sc,f);
+	    IHFC_UNLOCK(sc);
+
+	    /* free what was allocated by someone else meanwhile */
+	    if(ec != NULL)
+	    {
+	        free(ec, M_TEMP);
+	    }
+	    if(part != NULL)
+	    {
+	        free(part, M_TEMP);
+	    }
+	}
+	return;
+}
+
+void
+ihfc_echo_cancel_init_task(ihfc_sc_t *sc)
+{
+	TASK_INIT(&(sc->sc_echo_cancel_task), 0,
+		  &ihfc_echo_cancel_alloc_task, sc);
+	return;
+}
+
+void
+ihfc_echo_cancel_free(ihfc_sc_t *sc)
+{
+	uint16_t n;
+
+	taskqueue_drain(taskqueue_thread, &(sc->sc_echo_cancel_task));
+
+	for(n = 0; n != (IHFC_CHANNELS/2); n++)
+	{
+	    if(sc->sc_echo_cancel[n])
+	    {
+	        free(sc->sc_echo_cancel[n], M_TEMP);
+		sc->sc_echo_cancel[n] = NULL;
+	    }
+	    if(sc->sc_echo_cancel_part[n])
+	    {
+	        free(sc->sc_echo_cancel_part[n], M_TEMP);
+		sc->sc_echo_cancel_part[n] = NULL;
+	    }
+	}
+	return;
+}
+
+/*---------------------------------------------------------------------------*
+ * : initialize the echo canceller of a channel
+ *
+ * The echo canceller is restarted from a clean state each time it
+ * is enabled. The FFT scratch buffer is shared by all the channels
+ * of a controller, which are serialized by the same mutex. When the
+ * state, or the delay line of the partitioned mode, has not been
+ * allocated yet, the allocation task is queued, which calls this
+ * function again. Meanwhile the echo canceller is off, or in block
+ * mode, respectively.
+ *
+ * NOTE: "f" can be either the receive or the transmit FIFO
+ *---------------------------------------------------------------------------*/
+void
+ihfc_echo_cancel_setup(ihfc_sc_t *sc, ihfc_fifo_t *f)
+{
+	struct i4b_echo_cancel *ec;
+
+	IHFC_ASSERT_LOCKED(sc);
+
+	/* the state is given by the receive FIFO */
+	f = &(sc->sc_fifo[FIFO_NO(f) | receive]);
+
+	ec = FIFO_ECHO_CANCEL(sc,f);
+
+	if(PROT_IS_TRANSPARENT(&(f->prot_curr)) &&
+	   (f->prot_curr.u.transp.echo_cancel_enable))
+	{
+	    if((ec == NULL) ||
+	       ((f->prot_curr.u.transp.echo_cancel_mode ==
+		 I4B_ECHO_CANCEL_MODE_PART) &&
+		(FIFO_ECHO_CANCEL_PART(sc,f) == NULL)))
+	    {
+	        taskqueue_enqueue(taskqueue_thread,
+				  &(sc->sc_echo_cancel_task));
+	    }
+
+	    if(ec == NULL)
+	    {
+	        return;
+	    }
+
+	    i4b_echo_cancel_init(ec, &(sc->sc_echo_cancel_scratch),
+				 -8, f->prot_curr.protocol_4);
+
+	    /* spread the echo block computations of all channels */
+	    i4b_echo_cancel_set_phase(ec, ((FIFO_NO(f)/2) *
+		I4B_ECHO_CANCEL_N_TAPS) / ((sc->sc_default.d_channels/2) + 1));
+
+	    /* select block or partitioned mode */
+	    i4b_echo_cancel_set_mode(ec, f->prot_curr.u.transp.echo_cancel_mode,
+				     FIFO_ECHO_CANCEL_PART(sc,f));
+	}
+	return;
+}
+
 #define c (&sc->sc_config) /* save some code */
 
 /*---------------------------------------------------------------------------*
@@ -1346,6 +1642,12 @@ ihfc_fifo_setup(register ihfc_sc_t *sc, register ihfc_fifo_t *f)
 	 *
 	 * also see ``ihfc_fifo_link()'' !
 	 */
+	if(sc->sc_state[f->sub_unit].i4b_controller)
+	{
+	  f->mbuf_pool =
+	    &(sc->sc_state[f->sub_unit].i4b_controller->mbuf_pool);
+	}
+
  	I4B_FREEMBUF(f,f->mbuf);
 	I4B_FREEMBUF(f,f->mbuf_dev);
 #if 0
@@ -1358,6 +1660,7 @@ ihfc_fifo_setup(register ihfc_sc_t *sc, register ihfc_fifo_t *f)
 	 * Clear some variables
 	 */
 	f->mbuf     = NULL;
+	f->mbuf_curr = NULL;
 	f->mbuf_dev = NULL;
 	f->buf_len  = 0;
 	f->buf_size = 0;
@@ -1394,11 +1697,9 @@ ihfc_fifo_setup(register ihfc_sc_t *sc, register ihfc_fifo_t *f)
 	ihfc_fifo_setup_soft(sc,f);
 
 	/* init echo cancel */
-	if((f->prot_curr.protocol_1 == P_TRANSPARENT) &&
-	   (FIFO_DIR(f) == receive))
+	if(FIFO_DIR(f) == receive)
 	{
-	    struct i4b_echo_cancel *ec = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
-	    i4b_echo_cancel_init(ec, -8, f->prot_curr.protocol_4);
+	    ihfc_echo_cancel_setup(sc,f);
 	}
 
 	/* init DTMF detector */
@@ -44,6 +44,7 @@ uint8_t	ihfc_setup_i4b		(ihfc_sc_t *sc, uint8_t *error);
 void		ihfc_unsetup_i4b	(ihfc_sc_t *sc);
 void		ihfc_i4b_putmbuf	(ihfc_sc_t *sc, ihfc_fifo_t *f, struct mbuf *m);
 struct mbuf *   ihfc_i4b_getmbuf	(ihfc_sc_t *sc, ihfc_fifo_t *f);
+struct mbuf *   ihfc_i4b_nextmbuf	(ihfc_sc_t *sc, ihfc_fifo_t *f);
 void		ihfc_trace_info		(ihfc_sc_t *sc, ihfc_fifo_t *f, const uint8_t *desc);
 
 /* prototypes from "i4b_ihfc_drv.c" */
@@ -52,6 +53,9 @@ void		ihfc_unsetup_softc	(ihfc_sc_t *sc);
 void		ihfc_chip_interrupt     (void *);
 uint8_t	ihfc_fifos_active	(ihfc_sc_t *sc);
 uint8_t	ihfc_fifo_setup		(ihfc_sc_t *sc, ihfc_fifo_t *f);
+void		ihfc_echo_cancel_init_task	(ihfc_sc_t *sc);
+void		ihfc_echo_cancel_free	(ihfc_sc_t *sc);
+void		ihfc_echo_cancel_setup	(ihfc_sc_t *sc, ihfc_fifo_t *f);
 void		ihfc_fifo_call		(ihfc_sc_t *sc, ihfc_fifo_t *f);
 void		ihfc_config_write_sub   (ihfc_sc_t *sc, ihfc_fifo_t *f);
 void		ihfc_reset		(ihfc_sc_t *sc, uint8_t *error);
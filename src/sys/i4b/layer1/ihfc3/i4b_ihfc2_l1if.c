@@ -305,8 +305,17 @@ ihfc_mph_command_req(struct i4b_controller *cntl, int command, void *parm)
 	       PROT_IS_TRANSPARENT(&((f + transmit)->prot_curr)) &&
 	       sc->sc_default.o_ECHO_CANCEL_ENABLED)
 	    {
+	        if((f + receive)->prot_curr.u.transp.echo_cancel_enable &&
+		   (f + transmit)->prot_curr.u.transp.echo_cancel_enable)
+		{
+		    /* already enabled */
+		    break;
+		}
+
 	        (f + receive)->prot_curr.u.transp.echo_cancel_enable = 1;
 		(f + transmit)->prot_curr.u.transp.echo_cancel_enable = 1;
+
+		ihfc_echo_cancel_setup(sc, f);
 	    }
 	    else
 	    {
@@ -360,9 +369,10 @@ ihfc_mph_command_req(struct i4b_controller *cntl, int command, void *parm)
 	    if (PROT_IS_TRANSPARENT(&((f + receive)->prot_curr)) &&
 		PROT_IS_TRANSPARENT(&((f + transmit)->prot_curr)) &&
 		(f + receive)->prot_curr.u.transp.echo_cancel_enable &&
-		(f + transmit)->prot_curr.u.transp.echo_cancel_enable)
+		(f + transmit)->prot_curr.u.transp.echo_cancel_enable &&
+		(FIFO_ECHO_CANCEL(sc,f) != NULL))
 	    {
-	        ec_p = &(sc->sc_echo_cancel[FIFO_NO(f)/2]);
+	        ec_p = FIFO_ECHO_CANCEL(sc,f);
 		ec_dbg->npoints = EC_POINTS;
 		ec_dbg->decimal_point = I4B_ECHO_CANCEL_N_HR_DP;
 		for (x = 0; x < points; x++) {
@@ -376,6 +386,49 @@ ihfc_mph_command_req(struct i4b_controller *cntl, int command, void *parm)
 	    break;
 	}
 
+	case CMR_GET_POLLSTAT:
+	{
+	    i4b_poll_debug_t *poll_dbg = parm;
+
+	    poll_dbg->poll_delay = sc->sc_poll_delay;
+	    poll_dbg->poll_delay_max = IHFC_POLL_DELAY_IDLE(sc);
+	    poll_dbg->pollstat = sc->sc_pollstat;
+	    break;
+	}
+
+	case CMR_CLR_POLLSTAT:
+	    bzero(&sc->sc_pollstat, sizeof(sc->sc_pollstat));
+	    break;
+
+	case CMR_GET_FIFOSTAT:
+	case CMR_CLR_FIFOSTAT:
+	{
+	    i4b_fifo_debug_t *fifo_dbg = parm;
+
+	    if(fifo_dbg->chan >= cntl->L1_channel_end)
+	    {
+	        return EINVAL;
+	    }
+
+	    f += (2 * fifo_dbg->chan);
+
+	    if(command == CMR_GET_FIFOSTAT)
+	    {
+	        fifo_dbg->rx = (f + receive)->stat;
+		fifo_dbg->tx = (f + transmit)->stat;
+	    }
+	    else
+	    {
+	        bzero(&((f + receive)->stat), sizeof(fifostat_t));
+		bzero(&((f + transmit)->stat), sizeof(fifostat_t));
+
+		/* start a new service interval */
+		(f + receive)->stat_time_last = 0;
+		(f + transmit)->stat_time_last = 0;
+	    }
+	    break;
+	}
+
 	case CMR_ENABLE_DTMF_DETECT:
 	{
 	    struct fifo_translator *ft = parm;
@@ -495,6 +548,11 @@ ihfc_i4b_putmbuf(ihfc_sc_t *sc, ihfc_fifo_t *f, struct mbuf *m)
 
 /*---------------------------------------------------------------------------*
  *	get mbuf from layer 5
+ *
+ * NOTE: chained mbufs are not copied into a single mbuf. The
+ * transmit filters start at "f->mbuf_curr", which is the first
+ * non-empty mbuf of the chain, and get the next ones by calling
+ * ihfc_i4b_nextmbuf().
  *---------------------------------------------------------------------------*/
 struct mbuf *
 ihfc_i4b_getmbuf(ihfc_sc_t *sc, ihfc_fifo_t *f)
@@ -502,53 +560,19 @@ ihfc_i4b_getmbuf(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	fifo_translator_t *ft = FIFO_TRANSLATOR(sc,f);
 	register struct mbuf *m1;
 
- repeat:
-
 	m1 = L5_GET_MBUF(ft);
 
+	f->mbuf_curr = m1;
+
 	if(m1)
 	{
-	    if(m1->m_next)
+	    if((m1->m_len == 0) && (m1->m_next))
 	    {
-	        /* XXX the system currently doesn't handle
-		 * chained mbufs, so a pullup is needed:
-		 */
-	        struct mbuf *m2;
-		struct mbuf *m3;
-		uint32_t total_len = 0;
-		uint8_t *ptr;
-
-		m2 = m1;
-		do {
-		  total_len += m2->m_len;
-		} while((m2 = m2->m_next));
-
-		m3 = i4b_getmbuf(total_len, M_NOWAIT);
-
-		if(m3 == NULL)
-		{
-		    printf("%s: %s: cannot pullup mbuf "
-			   "with length %d bytes!\n",
-			   __FILE__, __FUNCTION__, 
-			   total_len);
-
-		    m_freem(m1);
-		    goto repeat;
-		}
-
-		ptr = m3->m_data;
-
-		m2 = m1;
-		do {
-		  bcopy(m2->m_data, ptr, m2->m_len);
-		  ptr += m2->m_len;
-		} while((m2 = m2->m_next));
-
-		m_freem(m1);
-		m1 = m3;
+	        /* skip empty mbufs at the start of the chain */
+	        ihfc_i4b_nextmbuf(sc, f);
 	    }
 
-	    f->io_stat += m1->m_len;
+	    f->io_stat += m_length(m1, NULL);
 
 	    if(f->state & ST_I4B_TRACE)
 	    {
@@ -561,6 +585,28 @@ ihfc_i4b_getmbuf(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	return m1;
 }
 
+/*---------------------------------------------------------------------------*
+ *	get next non-empty mbuf in the current chain
+ *
+ * Returns NULL at the end of the chain, and then "f->mbuf_curr"
+ * is not changed.
+ *---------------------------------------------------------------------------*/
+struct mbuf *
+ihfc_i4b_nextmbuf(ihfc_sc_t *sc, ihfc_fifo_t *f)
+{
+	register struct mbuf *m = f->mbuf_curr;
+
+	while(m && (m = m->m_next))
+	{
+	    if(m->m_len)
+	    {
+	        f->mbuf_curr = m;
+		break;
+	    }
+	}
+	return m;
+}
+
 /*---------------------------------------------------------------------------*
  *	initialize rx/tx data structures
  *---------------------------------------------------------------------------*/
@@ -838,6 +838,8 @@ ihfc_unsetup(device_t dev, const uint8_t *error, uint8_t level)
 	    sc->sc_temp_ptr = NULL;
 	}
 
+	ihfc_echo_cancel_free(sc);
+
 	if(IHFC_IS_ERR(error))
 	{
 	  device_printf(dev,"ERROR(s): %s\n", error);
@@ -1042,6 +1044,12 @@ ihfc_pnp_probe_sub(device_t dev, ihfc_sc_t *sc, const struct drvr_id *id)
 	callout_init_mtx(&sc->sc_pollout_timr_wait, sc->sc_mtx_p, 0);
 	callout_init_mtx(&sc->sc_pollout_timr, sc->sc_mtx_p, 0);
 
+	/* start polling at the chip default */
+	sc->sc_poll_delay = sc->sc_default.d_interrupt_delay;
+
+	/* echo cancellers are allocated on demand */
+	ihfc_echo_cancel_init_task(sc);
+
 	for(n = 0; 
 	    n < sc->sc_default.d_sub_controllers;
 	    n++)
@@ -274,6 +274,131 @@ ihfc_program_check_status(ihfc_sc_t *sc)
 	return;
 }
 
+/*---------------------------------------------------------------------------*
+ * : echo canceller precompute
+ *
+ * Loop over the channels and compute each echo block that is due,
+ * before the FIFOs are processed, so that the receive filters only
+ * subtract the precomputed echo. Each channel is still computed on
+ * its own. The block phase set in "ihfc_fifo_setup()" makes sure
+ * that only a few channels are due in the same interrupt.
+ *---------------------------------------------------------------------------*/
+static void
+ihfc_echo_cancel_precompute_all(ihfc_sc_t *sc)
+{
+	ihfc_fifo_t *f;
+
+	if(!sc->sc_default.o_ECHO_CANCEL_ENABLED)
+	{
+	    return;
+	}
+
+	FIFO_FOREACH(f,sc)
+	{
+	    if((FIFO_DIR(f) == receive) &&
+	       (f->prot_curr.protocol_1 == P_TRANSPARENT) &&
+	       (f->prot_curr.u.transp.echo_cancel_enable) &&
+	       (FIFO_ECHO_CANCEL(sc,f) != NULL))
+	    {
+	        i4b_echo_cancel_precompute(FIFO_ECHO_CANCEL(sc,f));
+	    }
+	}
+	return;
+}
+
+/*---------------------------------------------------------------------------*
+ * : deferred DTMF detection
+ *
+ * The receive filters only collect the samples. When all the FIFOs
+ * have been serviced, the pending blocks of all the channels having
+ * DTMF detection enabled are passed to the DTMF detector at once, so
+ * that the blocks of several channels are processed in the same pass
+ * over the samples. This also keeps the detector out of the FIFO
+ * timing.
+ *---------------------------------------------------------------------------*/
+static void
+ihfc_dtmf_detect_all(ihfc_sc_t *sc)
+{
+	struct fifo_translator *ft[I4B_DTMF_N_BATCH];
+	ihfc_fifo_t *f;
+	uint16_t n = 0;
+
+	FIFO_FOREACH(f,sc)
+	{
+	    if((FIFO_DIR(f) == receive) &&
+	       (f->prot_curr.protocol_1 == P_TRANSPARENT) &&
+	       (f->prot_curr.u.transp.dtmf_detect_enable) &&
+	       (FIFO_TRANSLATOR(sc,f)->dtmf_rx.count >= I4B_DTMF_N_SAMPLES))
+	    {
+	        ft[n++] = FIFO_TRANSLATOR(sc,f);
+
+		if(n == I4B_DTMF_N_BATCH)
+		{
+		    i4b_dtmf_detect_batch(ft, n);
+		    n = 0;
+		}
+	    }
+	}
+
+	if(n != 0)
+	{
+	    i4b_dtmf_detect_batch(ft, n);
+	}
+	return;
+}
+
+/*---------------------------------------------------------------------------*
+ * : FIFO statistics
+ *---------------------------------------------------------------------------*/
+static __inline uint32_t
+ihfc_fifo_stat_bucket(uint32_t value)
+{
+	value = fls(value);
+
+	if(value >= I4B_FIFOSTAT_HIST_MAX)
+	{
+	    value = (I4B_FIFOSTAT_HIST_MAX - 1);
+	}
+	return value;
+}
+
+static void
+ihfc_fifo_stat_begin(ihfc_fifo_t *f, uint32_t time)
+{
+	uint32_t delta;
+
+	if(f->prot_curr.protocol_1 == P_DISABLE)
+	{
+	    /* no service interval while disabled */
+	    f->stat_time_last = 0;
+	    return;
+	}
+
+	if(f->stat_time_last != 0)
+	{
+	    delta = (time - f->stat_time_last);
+
+	    if(f->stat.interval_max < delta)
+	    {
+	        f->stat.interval_max = delta;
+	    }
+
+	    f->stat.interval_hist[ihfc_fifo_stat_bucket(delta / 125)]++;
+	}
+
+	/* zero means no previous service */
+	f->stat_time_last = time | 1;
+	f->stat.services++;
+	return;
+}
+
+static void
+ihfc_fifo_stat_end(ihfc_fifo_t *f, uint32_t bytes)
+{
+	f->stat.bytes_hist[ihfc_fifo_stat_bucket(f->stat.bytes - bytes)]++;
+	return;
+}
+
 /*---------------------------------------------------------------------------*
  * : fifo processing kernel
  *---------------------------------------------------------------------------*/
@@ -281,6 +406,10 @@ static void
 ihfc_fifo_program(ihfc_sc_t *sc)
 {
 	ihfc_fifo_t *f;
+	struct timeval tv;
+
+	uint32_t time;
+	uint32_t bytes;
 
 	uint8_t status;
 	uint8_t fifo_max;
@@ -296,9 +425,20 @@ ihfc_fifo_program(ihfc_sc_t *sc)
 	 *      ... fifo processing ...
 	 * }
 	 *
+	 * ... DTMF detection ...
+	 *
 	 * return;
 	 */
 
+	ihfc_echo_cancel_precompute_all(sc);
+
+	/* one time stamp per wakeup is
+	 * accurate enough for statistics
+	 */
+	microuptime(&tv);
+
+	time = (tv.tv_sec * 1000000) + tv.tv_usec;
+
 	while(1)
 	{
 		/* Interrupts that occur during
@@ -335,25 +475,38 @@ ihfc_fifo_program(ihfc_sc_t *sc)
 		 * In the worst case 32*125us = 4ms
 		 * is used per FIFO
 		 */
-		fifo_max = 32; /* XXX */
+		fifo_max = IHFC_FIFO_QUOTA;
+
+		ihfc_fifo_stat_begin(f, time);
+
+		bytes = f->stat.bytes;
 
 	loop:
 
+		sc->sc_pollstat.fifo_runs++;
+
 		status = (f->program)(sc, f);
 
 		/* call fifo processing program */
 		switch(status) {
 		case PROGRAM_SLEEP:
-		    return;
+		    ihfc_fifo_stat_end(f, bytes);
+		    goto done;
 
 		case PROGRAM_LOOP:
 		    /*
 		     * check number of loops
 		     */
+		    sc->sc_pollstat.fifo_loops++;
+		    sc->sc_poll_work++;
+
 		    if(!fifo_max--)
 		    {
 		        IHFC_ERR("(#%d) FIFO quota "
 				 "exceeded!\n", FIFO_NO(f));
+			sc->sc_pollstat.quota_exceeded++;
+			f->stat.quota_exceeded++;
+			sc->sc_poll_work += IHFC_FIFO_QUOTA;
 			break;
 		    }
 		    goto loop;
@@ -363,9 +516,13 @@ ihfc_fifo_program(ihfc_sc_t *sc)
 		    break;
 		}
 
+		ihfc_fifo_stat_end(f, bytes);
+
 		/* get next entry */
 		sc->sc_intr_list_curr--;
 	}
+ done:
+	ihfc_dtmf_detect_all(sc);
 	return;
 }
 
@@ -406,6 +563,8 @@ i4b_ipac_rx_program(ihfc_sc_t *sc, ihfc_fifo_t *f)
 
 	if(f->i_ista & I_ISTA_ERR)
 	{
+	    /* receive data overflow (RFO) */
+	    f->stat.overruns++;
 	    goto rx_error;
 	}
 
@@ -434,6 +593,11 @@ i4b_ipac_rx_program(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	     */
 	    if(((f->F_chip) ^ 0x20) & 0x70)
 	    {
+	        if((f->F_chip) & 0x40)
+		{
+		    /* receive data overflow (RDO) */
+		    f->stat.overruns++;
+		}
 	        goto rx_error;
 	    }
 	    else
@@ -563,6 +727,8 @@ i4b_ipac_tx_program(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	    HDLC_MSG("(#%d) Transmit data underflow or "
 		     "collision.\n", FIFO_NO(f));
 
+	    f->stat.underruns++;
+
 	    /* execute XRES command so that an XPR
 	     * interrupt will be generated:
 	     */
@@ -792,6 +958,12 @@ i4b_hfc_rx_program(ihfc_sc_t *sc, ihfc_fifo_t *f)
 
 	    ihfc_fifo_fz_read(sc,f);
 
+	    if((f->Z_chip + 1) >= f->fm.h.Zsize)
+	    {
+	        /* receive FIFO is full */
+	        f->stat.overruns++;
+	    }
+
 	    /* In HDLC mode the FIFO will append a
 	     * status byte to the end of each frame,
 	     * but without incrementing the Z-counter
@@ -1048,6 +1220,15 @@ i4b_hfc_tx_program(ihfc_sc_t *sc, ihfc_fifo_t *f)
 		    /* transmit data underflow */
 		    f->state |= ST_FRAME_ERROR;
 		    f->Z_chip = f->fm.h.Zsize;
+
+		    /* the FIFO is empty after each
+		     * frame in HDLC mode
+		     */
+		    if(f->Z_chip_written &&
+		       (!PROT_IS_HDLC(&(f->prot_curr))))
+		    {
+		        f->stat.underruns++;
+		    }
 		}
 
 		/* compute number of bytes 
@@ -1309,6 +1490,15 @@ i4b_hfc_tx_program_new(ihfc_sc_t *sc, ihfc_fifo_t *f)
 	        /* transmit data underflow */
 	        f->state |= ST_FRAME_ERROR;
 		f->Z_chip = f->fm.h.Zsize;
+
+		/* the FIFO is empty after each
+		 * frame in HDLC mode
+		 */
+		if(f->Z_chip_written &&
+		   (!PROT_IS_HDLC(&(f->prot_curr))))
+		{
+		    f->stat.underruns++;
+		}
 	    }
 
 	    /* compute number of bytes 
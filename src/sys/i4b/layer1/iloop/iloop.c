@@ -90,7 +90,6 @@ iloop_timeout(void *arg)
 {
 	struct iloop_softc *sc = arg;
 	struct dss1_lite_fifo *f = &sc->sc_dl.dl_fifo[sc->sc_dl.dl_audio_channel];
-	uint16_t i;
 	uint16_t timestamp;
 
 	callout_reset(&sc->sc_callout, hz / ILOOP_FPS,
@@ -113,15 +112,11 @@ iloop_timeout(void *arg)
 
 	f->tx_timestamp = sc->sc_timestamp;
 
-	for (i = 0; i != ILOOP_BPS; i++) {
-		dss1_lite_l5_put_sample(&sc->sc_dl, f, sc->sc_buffer[i]);
-	}
+	dss1_lite_l5_put_samples(&sc->sc_dl, f, sc->sc_buffer, ILOOP_BPS);
 
 	dss1_lite_l5_put_sample_complete(&sc->sc_dl, f);
 
-	for (i = 0; i != ILOOP_BPS; i++) {
-		sc->sc_buffer[i] = dss1_lite_l5_get_sample(&sc->sc_dl, f);
-	}
+	dss1_lite_l5_get_samples(&sc->sc_dl, f, sc->sc_buffer, ILOOP_BPS);
 
 	dss1_lite_l5_get_sample_complete(&sc->sc_dl, f);
 
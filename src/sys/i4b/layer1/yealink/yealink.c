@@ -681,6 +681,8 @@ yealink_isoc_read_callback(struct usb_xfer *xfer, usb_error_t error)
 	uint16_t i;
 	uint16_t j;
 	uint16_t k;
+	uint16_t n;
+	int16_t temp;
 
 	switch (USB_GET_STATE(xfer)) {
 	case USB_ST_TRANSFERRED:
@@ -689,21 +691,28 @@ yealink_isoc_read_callback(struct usb_xfer *xfer, usb_error_t error)
 
 		buf = usbd_xfer_get_priv(xfer);
 
+		temp = f->m_tx_last_sample;
+		n = 0;
+
 		for (i = 0; i != YEALINK_MINFRAMES; i++) {
 
 			k = usbd_xfer_frame_len(xfer, i) & -2UL;
 
 			for (j = 0; j < k; j += 2) {
-				dss1_lite_l5_put_sample(&sc->sc_dl, f, (int16_t)UGETW(buf + j));
+				temp = UGETW(buf + j);
+				sc->sc_samples[n++] = temp;
 			}
 
+			/* repeat last sample for short frames */
 			for (; j < YEALINK_BPF; j += 2) {
-				dss1_lite_l5_put_sample(&sc->sc_dl, f, (int16_t)f->m_tx_last_sample);
+				sc->sc_samples[n++] = temp;
 			}
 
 			buf += YEALINK_BPF;
 		}
 
+		dss1_lite_l5_put_samples(&sc->sc_dl, f, sc->sc_samples, n);
+
 		dss1_lite_l5_put_sample_complete(&sc->sc_dl, f);
 
 	case USB_ST_SETUP:
@@ -739,7 +748,6 @@ yealink_isoc_write_callback(struct usb_xfer *xfer, usb_error_t error)
 	struct dss1_lite_fifo *f = &sc->sc_dl.dl_fifo[sc->sc_dl.dl_audio_channel];
 	uint8_t *buf;
 	uint16_t i;
-	uint16_t temp;
 	uint16_t timestamp = (usbd_xfer_get_timestamp(xfer) * 8) + (YEALINK_MINFRAMES * 8 * 2);
 
 	switch (USB_GET_STATE(xfer)) {
@@ -748,9 +756,11 @@ yealink_isoc_write_callback(struct usb_xfer *xfer, usb_error_t error)
 tr_setup:
 		buf = usbd_xfer_get_priv(xfer);
 
+		dss1_lite_l5_get_samples(&sc->sc_dl, f,
+		    sc->sc_samples, YEALINK_BUFSIZE / 2);
+
 		for (i = 0; i != YEALINK_BUFSIZE; i += 2) {
-			temp = dss1_lite_l5_get_sample(&sc->sc_dl, f);
-			USETW(buf + i, temp);
+			USETW(buf + i, sc->sc_samples[i / 2]);
 		}
 
 		dss1_lite_l5_get_sample_complete(&sc->sc_dl, f);
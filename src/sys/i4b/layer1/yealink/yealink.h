@@ -109,6 +109,7 @@ struct yealink_softc {
 	int	sc_last_ring;
 
 	uint8_t	sc_buffer[YEALINK_BUFSIZE * 4];
+	int16_t	sc_samples[YEALINK_BUFSIZE / 2];	/* protected by sc_pmtx */
 
 	uint8_t	sc_st_data[YEALINK_ST_MAX];
 	uint8_t	sc_st_index;
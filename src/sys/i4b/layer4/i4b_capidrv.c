@@ -54,7 +54,17 @@
 #include <sys/lock.h>
 #include <sys/priv.h>
 #include <sys/queue.h>
+#include <sys/proc.h>
+#include <sys/event.h>
+#include <sys/selinfo.h>
 #include <net/if.h>
+#include <vm/vm.h>
+#include <vm/vm_param.h>
+#include <vm/vm_object.h>
+#include <vm/vm_map.h>
+#include <vm/vm_pager.h>
+#include <vm/vm_kern.h>
+#include <vm/vm_extern.h>
 #endif
 
 #include <i4b/include/i4b_debug.h>
@@ -64,9 +74,18 @@
 
 #define CAPI_MAKE_TRANSLATOR
 #include <i4b/include/capi20.h>
+#include <i4b/include/i4b_capi_ioctl.h>
 
 #include <i4b/layer4/i4b_l4.h>
 
+#if (!defined(I4B_GLOBAL_INCLUDE_FILE)) && (__FreeBSD_version >= 1000000)
+#define	CAPI_SHM_SUPPORT
+#endif
+
+#ifndef I4B_GLOBAL_INCLUDE_FILE
+#define	CAPI_KQUEUE_SUPPORT
+#endif
+
 /* the following structure describes one CAPI application */
 
 struct capi_ai_softc {
@@ -79,6 +98,25 @@ struct capi_ai_softc {
 #define MIN_B_DATA_LEN 128 /* bytes */
 
 	uint16_t sc_max_b_data_blocks;
+	uint16_t sc_max_logical_connections;
+
+	/* coalescing, see I4B_CAPI_SET_COALESCE */
+	uint16_t sc_rx_delay;
+	uint16_t sc_conf_max;
+
+	/* echo canceller, see I4B_CAPI_SET_EC_MODE */
+	uint8_t sc_ec_mode;
+
+	/* shared memory, see I4B_CAPI_SHM_SETUP */
+	void *sc_shm_obj;
+	struct i4b_capi_shm_header *sc_shm_hdr;
+	uint32_t sc_shm_size;
+	uint32_t sc_shm_slot_count;
+	uint32_t sc_shm_slot_size;
+	uint32_t sc_shm_rx_slot_offset;
+	uint32_t sc_shm_tx_slot_offset;
+	uint32_t sc_shm_rx_head;
+	uint16_t sc_shm_rx_handle;
 
 	unsigned long sc_refs;
 
@@ -101,6 +139,7 @@ struct capi_ai_softc {
 #define ST_IOCTL             0x0200 /* set if AI is doing a IOCTL */
 #define ST_D_OPEN            0x0400 /* set if D-channel has been started */
 #define ST_MBUF_LOST         0x0800 /* set if an mbuf was lost */
+#define ST_BATCH             0x1000 /* set if read and write are batched */
 
 	struct _ifqueue sc_rdqueue;
 	struct selinfo sc_selinfo;
@@ -142,6 +181,12 @@ static	d_read_t	capi_read;
 static	d_write_t	capi_write;
 static	d_ioctl_t	capi_ioctl;
 static	d_poll_t	capi_poll;
+#ifdef CAPI_SHM_SUPPORT
+static	d_mmap_single_t	capi_mmap_single;
+#endif
+#ifdef CAPI_KQUEUE_SUPPORT
+static	d_kqfilter_t	capi_kqfilter;
+#endif
 
 static cdevsw_t capi_cdevsw = {
       .d_version  = D_VERSION,
@@ -151,6 +196,12 @@ static cdevsw_t capi_cdevsw = {
       .d_write    = capi_write,
       .d_ioctl    = capi_ioctl,
       .d_poll     = capi_poll,
+#ifdef CAPI_SHM_SUPPORT
+      .d_mmap_single = capi_mmap_single,
+#endif
+#ifdef CAPI_KQUEUE_SUPPORT
+      .d_kqfilter = capi_kqfilter,
+#endif
       .d_name     = "capi",
       .d_flags    = D_TRACKCLOSE,
 };
@@ -189,6 +240,10 @@ capi_ai_new_softc(void)
 
 	mtx_init(&sc->sc_mtx, "CAPI AI", NULL, MTX_DEF | MTX_RECURSE);
 
+#ifdef CAPI_KQUEUE_SUPPORT
+	knlist_init_mtx(&sc->sc_selinfo.si_note, &sc->sc_mtx);
+#endif
+
 	cv_init(&sc->sc_cv_ref, "CAPI-REF");
 	cv_init(&sc->sc_cv_rdqueue, "CAPI-RDQ");
 
@@ -197,6 +252,7 @@ capi_ai_new_softc(void)
 	/* set default receive length */
 
 	sc->sc_max_b_data_len = BCH_MAX_DATALEN;
+	sc->sc_max_logical_connections = 1;
 
 	mtx_lock(&i4b_global_lock);
 	TAILQ_INSERT_TAIL(&capi_head, sc, entry);
@@ -205,6 +261,295 @@ capi_ai_new_softc(void)
 	return (sc);
 }
 
+#ifdef CAPI_SHM_SUPPORT
+/*---------------------------------------------------------------------------*
+ *	capi_shm_alloc - allocate shared memory for DATA_B3 payloads
+ *
+ * The memory is a VM object, which is wired into the kernel map
+ * and referenced by every user mapping, so that the pages stay
+ * valid until the last mapping is gone, also after the softc
+ * has been freed.
+ *---------------------------------------------------------------------------*/
+static int
+capi_shm_alloc(struct capi_ai_softc *sc, struct i4b_capi_shm_setup *setup)
+{
+	struct i4b_capi_shm_header *hdr;
+	vm_object_t obj;
+	vm_offset_t kva;
+	uint32_t slot_count;
+	uint32_t slot_size;
+	uint32_t size;
+	uint32_t n;
+
+	CAPI_AI_LOCK(sc);
+	n = sc->sc_max_logical_connections * sc->sc_max_b_data_blocks;
+	slot_size = sc->sc_max_b_data_len;
+	obj = sc->sc_shm_obj;
+	CAPI_AI_UNLOCK(sc);
+
+	if(obj != NULL)
+	{
+		return(EBUSY);
+	}
+
+	if(n > I4B_CAPI_SHM_SLOT_MAX)
+	   n = I4B_CAPI_SHM_SLOT_MAX;
+
+	/* round up to a power of two */
+	for(slot_count = 1; slot_count < n; slot_count *= 2)
+		;
+
+	/* keep the slots 64-bit aligned */
+	slot_size = (slot_size + 7) & ~7;
+
+	size = sizeof(*hdr) +
+	  (slot_count * sizeof(struct i4b_capi_shm_desc)) +
+	  (2 * slot_count * slot_size);
+	size = round_page(size);
+
+	obj = vm_pager_allocate(OBJT_PHYS, NULL, size, VM_PROT_DEFAULT,
+				0, curthread->td_ucred);
+	if(obj == NULL)
+	{
+		return(ENOMEM);
+	}
+
+	/* one reference is consumed by the kernel map */
+	vm_object_reference(obj);
+
+	kva = vm_map_min(kernel_map);
+	if(vm_map_find(kernel_map, obj, 0, &kva, size, 0, VMFS_OPTIMAL_SPACE,
+		       VM_PROT_READ | VM_PROT_WRITE,
+		       VM_PROT_READ | VM_PROT_WRITE, 0) != KERN_SUCCESS)
+	{
+		vm_object_deallocate(obj);
+		vm_object_deallocate(obj);
+		return(ENOMEM);
+	}
+
+	if(vm_map_wire(kernel_map, kva, kva + size,
+		       VM_MAP_WIRE_SYSTEM | VM_MAP_WIRE_NOHOLES) != KERN_SUCCESS)
+	{
+		vm_map_remove(kernel_map, kva, kva + size);
+		vm_object_deallocate(obj);
+		return(ENOMEM);
+	}
+
+	hdr = (void *)kva;
+
+	/* the pages are zeroed by the pager */
+	hdr->magic = I4B_CAPI_SHM_MAGIC;
+	hdr->size = size;
+	hdr->slot_count = slot_count;
+	hdr->slot_size = slot_size;
+	hdr->rx_desc_offset = sizeof(*hdr);
+	hdr->rx_slot_offset = hdr->rx_desc_offset +
+	  (slot_count * sizeof(struct i4b_capi_shm_desc));
+	hdr->tx_slot_offset = hdr->rx_slot_offset + (slot_count * slot_size);
+
+	CAPI_AI_LOCK(sc);
+	if(sc->sc_shm_obj != NULL)
+	{
+		/* lost race */
+		CAPI_AI_UNLOCK(sc);
+		vm_map_remove(kernel_map, kva, kva + size);
+		vm_object_deallocate(obj);
+		return(EBUSY);
+	}
+	sc->sc_shm_obj = obj;
+	sc->sc_shm_hdr = hdr;
+	sc->sc_shm_size = size;
+	sc->sc_shm_slot_count = slot_count;
+	sc->sc_shm_slot_size = slot_size;
+	sc->sc_shm_rx_slot_offset = hdr->rx_slot_offset;
+	sc->sc_shm_tx_slot_offset = hdr->tx_slot_offset;
+	sc->sc_shm_rx_head = 0;
+	CAPI_AI_UNLOCK(sc);
+
+	setup->size = size;
+	setup->slot_count = slot_count;
+	setup->slot_size = slot_size;
+	setup->unused = 0;
+
+	return(0);
+}
+
+/*---------------------------------------------------------------------------*
+ *	capi_shm_free - release the kernel references to shared memory
+ *---------------------------------------------------------------------------*/
+static void
+capi_shm_free(struct capi_ai_softc *sc)
+{
+	vm_object_t obj;
+	vm_offset_t kva;
+	uint32_t size;
+
+	CAPI_AI_LOCK(sc);
+	obj = sc->sc_shm_obj;
+	kva = (vm_offset_t)sc->sc_shm_hdr;
+	size = sc->sc_shm_size;
+	sc->sc_shm_obj = NULL;
+	sc->sc_shm_hdr = NULL;
+	CAPI_AI_UNLOCK(sc);
+
+	if(obj == NULL)
+		return;
+
+	vm_map_remove(kernel_map, kva, kva + size);
+	vm_object_deallocate(obj);
+}
+
+/*---------------------------------------------------------------------------*
+ *	capi_shm_put_data - store received data in shared memory
+ *
+ * Returns non-zero if the shared memory is in use, and then
+ * the mbuf has been consumed.
+ *---------------------------------------------------------------------------*/
+static uint8_t
+capi_shm_put_data(struct capi_ai_softc *sc, struct call_desc *cd,
+		  struct mbuf *m1)
+{
+	struct i4b_capi_shm_header *hdr;
+	struct i4b_capi_shm_desc *desc;
+	struct mbuf *m;
+	uint32_t index;
+	uint32_t head;
+	uint32_t tail;
+	uint32_t len;
+
+	CAPI_AI_LOCK(sc);
+
+	hdr = sc->sc_shm_hdr;
+
+	if(hdr == NULL)
+	{
+		CAPI_AI_UNLOCK(sc);
+		return(0);
+	}
+
+	len = 0;
+	for(m = m1; m != NULL; m = m->m_next)
+		len += m->m_len;
+
+	head = sc->sc_shm_rx_head;
+
+	/* the header is writable by the application and
+	 * cannot be trusted, but an invalid "rx_tail" will
+	 * just make the ring look full:
+	 */
+	tail = atomic_load_acq_32(&hdr->rx_tail);
+
+	if(((head - tail) >= sc->sc_shm_slot_count) ||
+	   (len > sc->sc_shm_slot_size))
+	{
+		hdr->rx_dropped++;
+		goto done;
+	}
+
+	index = head & (sc->sc_shm_slot_count - 1);
+
+	m_copydata(m1, 0, len, ((uint8_t *)hdr) + sc->sc_shm_rx_slot_offset +
+		   (index * sc->sc_shm_slot_size));
+
+	desc = ((struct i4b_capi_shm_desc *)(hdr + 1)) + index;
+	desc->dwCid = CDID2CAPI_ID(cd->cdid)|CAPI_ID_NCCI;
+	desc->wLen = len;
+	desc->wFlags = 0;
+	desc->wHandle = sc->sc_shm_rx_handle++;
+	desc->wUnused = 0;
+	desc->dwUnused = 0;
+
+	sc->sc_shm_rx_head = head + 1;
+	atomic_store_rel_32(&hdr->rx_head, head + 1);
+
+	/* only wakeup when the ring goes non-empty */
+	if(head == tail)
+	{
+		if(sc->sc_flags & ST_SELECT)
+		{
+			sc->sc_flags &= ~ST_SELECT;
+			selwakeup(&sc->sc_selinfo);
+		}
+#ifdef CAPI_KQUEUE_SUPPORT
+		KNOTE_LOCKED(&sc->sc_selinfo.si_note, 0);
+#endif
+	}
+ done:
+	CAPI_AI_UNLOCK(sc);
+
+	m_freem(m1);
+	return(1);
+}
+
+/*---------------------------------------------------------------------------*
+ *	capi_shm_get_data - get transmit data from shared memory
+ *
+ * Sets "*pm" to NULL if the DATA_B3_REQ has no data in shared
+ * memory. Returns EINVAL if it references an invalid transmit slot.
+ *---------------------------------------------------------------------------*/
+static int
+capi_shm_get_data(struct capi_ai_softc *sc, struct mbuf **pm)
+{
+	const uint8_t *ptr = (const void *)&sc->sc_msg.data;
+	struct mbuf *m;
+	uint32_t offset;
+	uint32_t start;
+	uint16_t len;
+
+	*pm = NULL;
+
+	/* the Data and DataLength fields are first */
+	if(sc->sc_msg.head.wLen < 6)
+	{
+		return(0);
+	}
+
+	offset = le32dec(ptr + 0);
+	len = le16dec(ptr + 4);
+
+	/* unlocked check, which is repeated below */
+	if((len == 0) || (sc->sc_shm_hdr == NULL))
+	{
+		return(0);
+	}
+
+	m = i4b_getmbuf(len, M_WAITOK);
+
+	if(m == NULL)
+	{
+		return(ENOMEM);
+	}
+
+	CAPI_AI_LOCK(sc);
+
+	if(sc->sc_shm_hdr == NULL)
+	{
+		CAPI_AI_UNLOCK(sc);
+		m_freem(m);
+		return(0);
+	}
+
+	start = sc->sc_shm_tx_slot_offset;
+
+	if((len > sc->sc_shm_slot_size) ||
+	   (offset < start) ||
+	   (((offset - start) / sc->sc_shm_slot_size) >= sc->sc_shm_slot_count) ||
+	   (((offset - start) % sc->sc_shm_slot_size) != 0))
+	{
+		CAPI_AI_UNLOCK(sc);
+		m_freem(m);
+		return(EINVAL);
+	}
+
+	bcopy(((uint8_t *)sc->sc_shm_hdr) + offset, m->m_data, len);
+
+	CAPI_AI_UNLOCK(sc);
+
+	*pm = m;
+	return(0);
+}
+#endif
+
 static void
 capi_ai_free_softc(void *arg)
 {
@@ -220,6 +565,15 @@ capi_ai_free_softc(void *arg)
 	_IF_DRAIN(&sc->sc_rdqueue);
 	CAPI_AI_UNLOCK(sc);
 
+#ifdef CAPI_SHM_SUPPORT
+	capi_shm_free(sc);
+#endif
+
+#ifdef CAPI_KQUEUE_SUPPORT
+	knlist_clear(&sc->sc_selinfo.si_note, 0);
+	knlist_destroy(&sc->sc_selinfo.si_note);
+#endif
+
 	cv_destroy(&sc->sc_cv_ref);
 	cv_destroy(&sc->sc_cv_rdqueue);
 
@@ -264,84 +618,115 @@ SYSUNINIT(capi_ai_detach, SI_SUB_PSEUDO, SI_ORDER_ANY, capi_ai_detach, NULL);
 #define CAPI_PUTQUEUE_FLAG_DROP_OK       0x02
 
 /*---------------------------------------------------------------------------*
- *	capi_ai_putqueue - put message into application interface queue(s)
+ *	capi_ai_enqueue - put message into one application interface queue
  *
- * NOTE: if "m1 == NULL" this is an indication that the system has lost
- *       an important CAPI message
+ * If "copy" is set, "m1" is shared and a copy is queued, else "m1"
+ * is consumed.
  *---------------------------------------------------------------------------*/
 static void
-capi_ai_putqueue(struct capi_ai_softc *sc, 
-		 uint8_t flags, struct mbuf *m1, uint16_t *p_copy_count)
+capi_ai_enqueue(struct capi_ai_softc *sc, uint8_t flags, struct mbuf *m1,
+		uint8_t copy, uint16_t *p_copy_count)
 {
-	struct capi_ai_softc *sc_exclude;
 	struct capi_message_encoded *mp;
-	struct mbuf *m2;
 
-	if((sc == NULL) || (flags & CAPI_PUTQUEUE_FLAG_SC_COMPLEMENT))
+	CAPI_AI_LOCK(sc);
+
+	if(sc->sc_flags & ST_CLOSING)
 	{
-		/* remove the complement flag */
+	    goto done;
+	}
 
-		flags &= ~CAPI_PUTQUEUE_FLAG_SC_COMPLEMENT;
+	/* check that there is an mbuf and
+	 * that the queue is not full
+	 */
+	if((m1 == NULL) || 
+	   (_IF_QLEN(&sc->sc_rdqueue) >= IFQ_LIMIT_HIGH))
+	{
+	    if(flags & CAPI_PUTQUEUE_FLAG_DROP_OK)
+	    {
+	        goto done;
+	    }
+	    if(!(sc->sc_flags & ST_MBUF_LOST))
+	    {
+	        sc->sc_flags |= ST_MBUF_LOST;
 
-		/* Broadcast a message */
+		NDBGL4(L4_ERR, "Unrecoverable data loss!");
+	    }
+	    goto done;
+	}
 
-		sc_exclude = sc;
+	mp = (void *)(m1->m_data);
 
-		mtx_lock(&i4b_global_lock);
-		sc = TAILQ_FIRST(&capi_head);
-		if (sc != NULL)
-			sc->sc_refs++;
-		mtx_unlock(&i4b_global_lock);
+	/* filter connect indications */
 
-		while(sc)
-		{
-			if(sc != sc_exclude)
-			{
-				/*
-				 * m_copypacket() is used hence
-				 * writeable copies are not
-				 * required. This means that data
-				 * pointed to by m_data can be shared.
-				 * Else m_dup() must be used.
-				 */
-				if (m1 == NULL)
-					m2 = NULL;
-				else
-					m2 = m_copypacket(m1, M_NOWAIT);
-
-				capi_ai_putqueue(sc,flags,m2,p_copy_count);
-			}
+	if(mp->head.wCmd == htole16(CAPI_IND(CONNECT)))
+	{
+	    uint32_t cip = le16toh(mp->data.CONNECT_IND.wCIP);
+	    uint8_t controller = le32toh(mp->head.dwCid) & 0xFF;
 
-			mtx_lock(&i4b_global_lock);
-			sc->sc_refs--;
-			sc = TAILQ_NEXT(sc, entry);
-			if (sc != NULL)
-				sc->sc_refs++;
-			if (sc->sc_refs == 0)
-				cv_broadcast(&sc->sc_cv_ref);
-			mtx_unlock(&i4b_global_lock);
-		}
+	    if(cip < 32)
+	      cip = (1 << cip) | 1;
+	    else
+	      cip = 1;
+
+	    if(controller >= I4B_MAX_CONTROLLERS)
+	    {
+	        /* application does not want this message */
+		goto done;
+	    }
+
+	    if(!(sc->sc_CIP_mask_1[controller] & cip))
+	    {
+	        /* application does not want this message */
+		goto done;
+	    }
 	}
-	else
+
+	/* filter information indications */
+
+	if(mp->head.wCmd == htole16(CAPI_IND(INFO)))
 	{
-		CAPI_AI_LOCK(sc);
+	    uint8_t controller = le32toh(mp->head.dwCid) & 0xFF;
 
-		if(sc->sc_flags & ST_CLOSING)
+	    if(controller >= I4B_MAX_CONTROLLERS)
+	    {
+	        /* application does not want this message */
+		goto done;
+	    }
+
+	    if(sc->sc_info_mask[controller] == 0)
+	    {
+		/* application does not want this message */
+		goto done;
+	    }
+	}
+
+	/* check if the frame can be dropped */
+
+	if(flags & CAPI_PUTQUEUE_FLAG_DROP_OK)
+	{
+		if(_IF_QLEN(&sc->sc_rdqueue) >= IFQ_LIMIT_LOW)
 		{
-		    goto done;
+			/* data overflow */
+			goto done;
 		}
+	}
 
-		/* check that there is an mbuf and
-		 * that the queue is not full
+	if(copy)
+	{
+		/*
+		 * m_copypacket() is used hence
+		 * writeable copies are not
+		 * required. This means that data
+		 * pointed to by m_data can be shared.
+		 * Else m_dup() must be used.
 		 */
-		if((m1 == NULL) || 
-		   (_IF_QLEN(&sc->sc_rdqueue) >= IFQ_LIMIT_HIGH))
+		m1 = m_copypacket(m1, M_NOWAIT);
+
+		if(m1 == NULL)
 		{
-		    if(flags & CAPI_PUTQUEUE_FLAG_DROP_OK)
-		    {
-		        goto done;
-		    }
-		    if(!(sc->sc_flags & ST_MBUF_LOST))
+		    if(!(flags & CAPI_PUTQUEUE_FLAG_DROP_OK) &&
+		       !(sc->sc_flags & ST_MBUF_LOST))
 		    {
 		        sc->sc_flags |= ST_MBUF_LOST;
 
@@ -349,86 +734,118 @@ capi_ai_putqueue(struct capi_ai_softc *sc,
 		    }
 		    goto done;
 		}
+	}
 
-		mp = (void *)(m1->m_data);
+	if (p_copy_count)
+	  (*p_copy_count) ++;
 
-		/* filter connect indications */
+	_IF_ENQUEUE(&sc->sc_rdqueue, m1);
+	m1 = NULL;
 
-		if(mp->head.wCmd == htole16(CAPI_IND(CONNECT)))
-		{
-		    uint32_t cip = le16toh(mp->data.CONNECT_IND.wCIP);
-		    uint8_t controller = le32toh(mp->head.dwCid) & 0xFF;
+	if(sc->sc_flags & ST_RD_SLEEP_WAKEUP)
+	{
+		sc->sc_flags &= ~ST_RD_SLEEP_WAKEUP;
+		cv_broadcast(&sc->sc_cv_rdqueue);
+	}
 
-		    if(cip < 32)
-		      cip = (1 << cip) | 1;
-		    else
-		      cip = 1;
+	if(sc->sc_flags & ST_SELECT)
+	{
+		sc->sc_flags &= ~ST_SELECT;
+		selwakeup(&sc->sc_selinfo);
+	}
 
-		    if(controller >= I4B_MAX_CONTROLLERS)
-		    {
-		        /* application does not want this message */
-			goto done;
-		    }
+#ifdef CAPI_KQUEUE_SUPPORT
+	KNOTE_LOCKED(&sc->sc_selinfo.si_note, 0);
+#endif
 
-		    if(!(sc->sc_CIP_mask_1[controller] & cip))
-		    {
-		        /* application does not want this message */
-			goto done;
-		    }
-		}
+ done:
+	CAPI_AI_UNLOCK(sc);
 
-		/* filter information indications */
+	if ((m1 != NULL) && (copy == 0))
+		m_freem(m1);
+}
 
-		if(mp->head.wCmd == htole16(CAPI_IND(INFO)))
-		{
-		    uint8_t controller = le32toh(mp->head.dwCid) & 0xFF;
+/*---------------------------------------------------------------------------*
+ *	capi_ai_putqueue - put message into application interface queue(s)
+ *
+ * NOTE: if "m1 == NULL" this is an indication that the system has lost
+ *       an important CAPI message
+ *---------------------------------------------------------------------------*/
+#define CAPI_BROADCAST_BATCH 16 /* applications per global lock */
 
-		    if(controller >= I4B_MAX_CONTROLLERS)
-		    {
-		        /* application does not want this message */
-			goto done;
-		    }
+static void
+capi_ai_putqueue(struct capi_ai_softc *sc, 
+		 uint8_t flags, struct mbuf *m1, uint16_t *p_copy_count)
+{
+	struct capi_ai_softc *sc_list[CAPI_BROADCAST_BATCH];
+	struct capi_ai_softc *sc_exclude;
+	struct capi_ai_softc *sc_next;
+	uint8_t n;
+	uint8_t x;
 
-		    if(sc->sc_info_mask[controller] == 0)
-		    {
-			/* application does not want this message */
-			goto done;
-		    }
-		}
+	if((sc != NULL) && !(flags & CAPI_PUTQUEUE_FLAG_SC_COMPLEMENT))
+	{
+		capi_ai_enqueue(sc, flags, m1, 0, p_copy_count);
+		return;
+	}
+
+	/* remove the complement flag */
+
+	flags &= ~CAPI_PUTQUEUE_FLAG_SC_COMPLEMENT;
+
+	/* Broadcast a message. The applications are
+	 * referenced in batches, so that the global lock
+	 * is not taken per application. Every application
+	 * gets a copy sharing the data of "m1".
+	 */
+	sc_exclude = sc;
+
+	mtx_lock(&i4b_global_lock);
 
-		/* check if the frame can be dropped */
+	sc_next = TAILQ_FIRST(&capi_head);
 
-		if(flags & CAPI_PUTQUEUE_FLAG_DROP_OK)
+	while(1)
+	{
+		for(n = 0;
+		    (sc_next != NULL) && (n != CAPI_BROADCAST_BATCH);
+		    sc_next = TAILQ_NEXT(sc_next, entry))
 		{
-			if(_IF_QLEN(&sc->sc_rdqueue) >= IFQ_LIMIT_LOW)
+			if(sc_next != sc_exclude)
 			{
-				/* data overflow */
-				goto done;
+				sc_next->sc_refs++;
+				sc_list[n++] = sc_next;
 			}
 		}
 
-		if (p_copy_count)
-		  (*p_copy_count) ++;
+		/* keep our position in the list */
+		if(sc_next != NULL)
+			sc_next->sc_refs++;
 
-		_IF_ENQUEUE(&sc->sc_rdqueue, m1);
-		m1 = NULL;
+		mtx_unlock(&i4b_global_lock);
 
-		if(sc->sc_flags & ST_RD_SLEEP_WAKEUP)
-		{
-			sc->sc_flags &= ~ST_RD_SLEEP_WAKEUP;
-			cv_broadcast(&sc->sc_cv_rdqueue);
-		}
+		for(x = 0; x != n; x++)
+			capi_ai_enqueue(sc_list[x], flags, m1, 1, p_copy_count);
 
-		if(sc->sc_flags & ST_SELECT)
+		mtx_lock(&i4b_global_lock);
+
+		for(x = 0; x != n; x++)
 		{
-			sc->sc_flags &= ~ST_SELECT;
-			selwakeup(&sc->sc_selinfo);
+			if(--(sc_list[x]->sc_refs) == 0)
+				cv_broadcast(&sc_list[x]->sc_cv_ref);
 		}
 
-	done:
-		CAPI_AI_UNLOCK(sc);
+		if(sc_next == NULL)
+			break;
+
+		/* "sc_next" cannot be removed until
+		 * the global lock is released
+		 */
+		if(--(sc_next->sc_refs) == 0)
+			cv_broadcast(&sc_next->sc_cv_ref);
 	}
 
+	mtx_unlock(&i4b_global_lock);
+
 	if (m1 != NULL)
 		m_freem(m1);
 }
@@ -1803,6 +2220,95 @@ static const uint8_t cause_table[9] = {
 	[8] = CAUSE_I4B_OOO,     /* Reject call, destination out of order */
 };
 
+/*---------------------------------------------------------------------------*
+ *	capi_read_batch - read as many messages as will fit
+ *
+ * NOTE: the caller has checked that the read queue is not empty
+ *---------------------------------------------------------------------------*/
+static int
+capi_read_batch(struct capi_ai_softc *sc, struct uio *uio)
+{
+	struct _ifqueue batch;
+	struct mbuf *m1;
+	struct mbuf *m2;
+	uint8_t hdr[I4B_CAPI_BATCH_HDR_SIZE];
+	__typeof(uio->uio_resid) resid;
+	uint32_t len;
+	int error = 0;
+
+	bzero(&batch, sizeof(batch));
+
+	resid = uio->uio_resid;
+
+	CAPI_AI_LOCK(sc);
+
+	while(1)
+	{
+		_IF_POLL(&sc->sc_rdqueue, m1);
+
+		if(m1 == NULL)
+		{
+			break;
+		}
+
+		len = 0;
+		for(m2 = m1; m2; m2 = m2->m_next)
+		{
+			len += m2->m_len;
+		}
+
+		if((len > 0xFFFF) ||
+		   ((len + sizeof(hdr)) > (uint32_t)resid))
+		{
+			break;
+		}
+
+		resid -= (len + sizeof(hdr));
+
+		_IF_DEQUEUE(&sc->sc_rdqueue, m1);
+		_IF_ENQUEUE(&batch, m1);
+	}
+
+	CAPI_AI_UNLOCK(sc);
+
+	if(_IF_QEMPTY(&batch))
+	{
+		/* buffer too small for next message */
+		return (EMSGSIZE);
+	}
+
+	while(1)
+	{
+		_IF_DEQUEUE(&batch, m1);
+
+		if(m1 == NULL)
+		{
+			break;
+		}
+
+		if(error == 0)
+		{
+			len = 0;
+			for(m2 = m1; m2; m2 = m2->m_next)
+			{
+				len += m2->m_len;
+			}
+
+			hdr[0] = len & 0xFF;
+			hdr[1] = len >> 8;
+
+			error = uiomove(hdr, sizeof(hdr), uio);
+
+			for(m2 = m1; m2 && !error; m2 = m2->m_next)
+			{
+				error = uiomove(m2->m_data, m2->m_len, uio);
+			}
+		}
+		m_freem(m1);
+	}
+	return (error);
+}
+
 /*---------------------------------------------------------------------------*
  *	capi_read - device driver read routine
  *---------------------------------------------------------------------------*/
@@ -1856,6 +2362,13 @@ capi_read(struct cdev *dev, struct uio *uio, int flag)
 		return error;
 	    }
 	}
+	if(sc->sc_flags & ST_BATCH)
+	{
+		CAPI_AI_UNLOCK(sc);
+
+		return (capi_read_batch(sc, uio));
+	}
+
 	_IF_DEQUEUE(&sc->sc_rdqueue, m1);
 	CAPI_AI_UNLOCK(sc);
 
@@ -1879,12 +2392,13 @@ capi_read(struct cdev *dev, struct uio *uio, int flag)
 }
 
 /*---------------------------------------------------------------------------*
- *	capi_write - device driver write routine
+ *	capi_write_msg - process one CAPI message
+ *
+ * NOTE: "uio->uio_resid" must not exceed the length of the message
  *---------------------------------------------------------------------------*/
 static int
-capi_write(struct cdev *dev, struct uio * uio, int flag)
+capi_write_msg(struct capi_ai_softc *sc, struct uio *uio)
 {
-	struct capi_ai_softc *sc;
 	struct i4b_controller *cntl;
 	struct call_desc *cd;
 	struct mbuf *m1 = NULL;
@@ -1893,26 +2407,11 @@ capi_write(struct cdev *dev, struct uio * uio, int flag)
 	uint8_t response;
 	uint16_t cause;
 
-        error = devfs_get_cdevpriv((void **)&sc);
-	if (error != 0)
-                return (error);
-	if (sc == NULL)
-		return (ENXIO);
-
 	/*
 	 * NOTE: one has got to read all data into buffers before
 	 * locking the controller, hence uiomove() can sleep
 	 */
 
-	CAPI_AI_LOCK(sc);
-	error = (sc->sc_write_busy != 0);
-	sc->sc_write_busy = 1;
-	CAPI_AI_UNLOCK(sc);
-
-	if (error) {
-		return (EBUSY);
-	}
-
 	if(uio->uio_resid < (int)sizeof(sc->sc_msg.head))
 	{
 		error = EINVAL;
@@ -1971,27 +2470,40 @@ capi_write(struct cdev *dev, struct uio * uio, int flag)
 	 * This implementation allows zero length
 	 * frames in case of DATA-B3 request.
 	 */
+	m1 = NULL;
+
 	if(sc->sc_msg.head.wCmd == CAPI_P_REQ(DATA_B3))
 	{
-		m1 = i4b_getmbuf(uio->uio_resid, M_WAITOK);
+#ifdef CAPI_SHM_SUPPORT
+		/* without payload the data can be in shared memory */
+		if(uio->uio_resid == 0)
+		{
+			error = capi_shm_get_data(sc, &m1);
 
+			if(error)
+			{
+				goto done;
+			}
+		}
 		if(m1 == NULL)
+#endif
 		{
-			error = ENOMEM;
-			goto done;
-		}
+			m1 = i4b_getmbuf(uio->uio_resid, M_WAITOK);
 
-		error = uiomove(m1->m_data, m1->m_len, uio);
+			if(m1 == NULL)
+			{
+				error = ENOMEM;
+				goto done;
+			}
 
-		if(error)
-		{
-			goto done;
+			error = uiomove(m1->m_data, m1->m_len, uio);
+
+			if(error)
+			{
+				goto done;
+			}
 		}
 	}
-	else
-	{
-		m1 = NULL;
-	}
 
 	cntl = CNTL_FIND(CAPI_ID2CONTROLLER(sc->sc_msg.head.dwCid));
 
@@ -3149,37 +3661,111 @@ capi_write(struct cdev *dev, struct uio * uio, int flag)
 		     "wCmd=0x%04x (ignored)!",
 		     sc->sc_msg.head.dwCid, sc->sc_msg.head.wCmd);
 
-	      /* only return error
-	       * when operation cannot
-	       * be continued
-	       *
-	       * error = EINVAL; 
-	       */
-	      break;
-	    }
+	      /* only return error
+	       * when operation cannot
+	       * be continued
+	       *
+	       * error = EINVAL; 
+	       */
+	      break;
+	    }
+	}
+
+	if(cntl)
+	{
+		CNTL_UNLOCK(cntl);
+	}
+
+	CAPI_AI_LOCK(sc);
+
+	sc->sc_flags &= ~ST_WR_SLEEP_ENTERED;
+
+	if(sc->sc_flags & ST_CLOSING)
+	{
+		cv_broadcast(&sc->sc_cv_rdqueue);
+		error = EIO;
+	}
+	CAPI_AI_UNLOCK(sc);
+
+ done:
+	if (m1) {
+		m_freem(m1);
+	}
+	return (error);
+}
+
+/*---------------------------------------------------------------------------*
+ *	capi_write - device driver write routine
+ *---------------------------------------------------------------------------*/
+static int
+capi_write(struct cdev *dev, struct uio * uio, int flag)
+{
+	struct capi_ai_softc *sc;
+	uint8_t hdr[I4B_CAPI_BATCH_HDR_SIZE];
+	__typeof(uio->uio_resid) resid;
+	uint16_t len;
+	uint8_t batch;
+	int error;
+
+        error = devfs_get_cdevpriv((void **)&sc);
+	if (error != 0)
+                return (error);
+	if (sc == NULL)
+		return (ENXIO);
+
+	CAPI_AI_LOCK(sc);
+	error = (sc->sc_write_busy != 0);
+	sc->sc_write_busy = 1;
+	batch = ((sc->sc_flags & ST_BATCH) != 0);
+	CAPI_AI_UNLOCK(sc);
+
+	if (error) {
+		return (EBUSY);
 	}
 
-	if(cntl)
-	{
-		CNTL_UNLOCK(cntl);
+	if (batch == 0) {
+		error = capi_write_msg(sc, uio);
+		goto done;
 	}
 
-	CAPI_AI_LOCK(sc);
+	while (uio->uio_resid > 0) {
 
-	sc->sc_flags &= ~ST_WR_SLEEP_ENTERED;
+		if (uio->uio_resid < (int)sizeof(hdr)) {
+			error = EINVAL;
+			break;
+		}
 
-	if(sc->sc_flags & ST_CLOSING)
-	{
-		cv_broadcast(&sc->sc_cv_rdqueue);
-		error = EIO;
-	}
-	CAPI_AI_UNLOCK(sc);
+		error = uiomove(hdr, sizeof(hdr), uio);
+		if (error) {
+			break;
+		}
 
- done:
-	if (m1) {
-		m_freem(m1);
+		len = hdr[0] | (hdr[1] << 8);
+
+		if (len > uio->uio_resid) {
+			error = EINVAL;
+			break;
+		}
+
+		/* limit the transfer to this message */
+		resid = uio->uio_resid - len;
+		uio->uio_resid = len;
+
+		error = capi_write_msg(sc, uio);
+
+		/* the message must be used completely */
+		if ((error == 0) && (uio->uio_resid != 0)) {
+			error = EINVAL;
+		}
+
+		uio->uio_resid += resid;
+
+		if (error) {
+			break;
+		}
 	}
 
+ done:
 	CAPI_AI_LOCK(sc);
 	sc->sc_write_busy = 0;
 	CAPI_AI_UNLOCK(sc);
@@ -3235,9 +3821,18 @@ capi_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct thread *
 		   req->max_b_data_blocks = 128;
 		}
 
+		if(req->max_logical_connections == 0) {
+		   req->max_logical_connections = 1;
+		}
+
+		if(req->max_logical_connections > I4B_CAPI_SHM_SLOT_MAX) {
+		   req->max_logical_connections = I4B_CAPI_SHM_SLOT_MAX;
+		}
+
 		CAPI_AI_LOCK(sc);
 		sc->sc_max_b_data_len = req->max_b_data_len;
 		sc->sc_max_b_data_blocks = req->max_b_data_blocks;
+		sc->sc_max_logical_connections = req->max_logical_connections;
 		CAPI_AI_UNLOCK(sc);
 
 		req->app_id = 0; /* unused */
@@ -3613,6 +4208,9 @@ capi_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct thread *
 
 		if(_IF_QEMPTY(&sc->sc_rdqueue))
 		    *(int *)data = 0;
+		else if(sc->sc_flags & ST_BATCH)
+		    *(int *)data = I4B_CAPI_BATCH_HDR_SIZE +
+		      sizeof(struct CAPI_HEADER_ENCODED);
 		else
 		    *(int *)data = sizeof(struct CAPI_HEADER_ENCODED);
 
@@ -3620,6 +4218,84 @@ capi_ioctl(struct cdev *dev, u_long cmd, caddr_t data, int flag, struct thread *
 
 		break;
       
+	case I4B_CAPI_SET_BATCH:
+
+		CAPI_AI_LOCK(sc);
+
+		if(*(uint32_t *)data)
+		  sc->sc_flags |= ST_BATCH;
+		else
+		  sc->sc_flags &= ~ST_BATCH;
+
+		CAPI_AI_UNLOCK(sc);
+		break;
+
+	case I4B_CAPI_GET_BATCH:
+
+		CAPI_AI_LOCK(sc);
+
+		*(uint32_t *)data = ((sc->sc_flags & ST_BATCH) != 0);
+
+		CAPI_AI_UNLOCK(sc);
+		break;
+
+	case I4B_CAPI_SET_COALESCE:
+	{
+		struct i4b_capi_coalesce *req = (void *)data;
+
+		if(req->rx_delay > I4B_CAPI_RX_DELAY_MAX) {
+		   req->rx_delay = I4B_CAPI_RX_DELAY_MAX;
+		}
+
+		if(req->conf_max > 128) {
+		   req->conf_max = 128;
+		}
+
+		CAPI_AI_LOCK(sc);
+		sc->sc_rx_delay = req->rx_delay;
+		sc->sc_conf_max = req->conf_max;
+		CAPI_AI_UNLOCK(sc);
+		break;
+	}
+
+	case I4B_CAPI_GET_COALESCE:
+	{
+		struct i4b_capi_coalesce *req = (void *)data;
+
+		CAPI_AI_LOCK(sc);
+		req->rx_delay = sc->sc_rx_delay;
+		req->conf_max = sc->sc_conf_max;
+		CAPI_AI_UNLOCK(sc);
+		break;
+	}
+
+	case I4B_CAPI_SET_EC_MODE:
+
+		if((*(uint32_t *)data != I4B_ECHO_CANCEL_MODE_BLOCK) &&
+		   (*(uint32_t *)data != I4B_ECHO_CANCEL_MODE_PART)) {
+		   error = EINVAL;
+		   break;
+		}
+
+		CAPI_AI_LOCK(sc);
+		sc->sc_ec_mode = *(uint32_t *)data;
+		CAPI_AI_UNLOCK(sc);
+		break;
+
+	case I4B_CAPI_GET_EC_MODE:
+
+		CAPI_AI_LOCK(sc);
+		*(uint32_t *)data = sc->sc_ec_mode;
+		CAPI_AI_UNLOCK(sc);
+		break;
+
+#ifdef CAPI_SHM_SUPPORT
+	case I4B_CAPI_SHM_SETUP:
+
+		error = capi_shm_alloc(sc, (void *)data);
+		break;
+#endif
+
 	case FIONBIO:
 
 		CAPI_AI_LOCK(sc);
@@ -3673,6 +4349,14 @@ capi_poll(struct cdev *dev, int events, struct thread *td)
 		revents |= (events & (POLLIN|POLLRDNORM));
 	}
 
+#ifdef CAPI_SHM_SUPPORT
+	if((sc->sc_shm_hdr != NULL) &&
+	   (sc->sc_shm_rx_head != atomic_load_acq_32(&sc->sc_shm_hdr->rx_tail)))
+	{
+		revents |= (events & POLLRDBAND);
+	}
+#endif
+
 	/* assume that one can always write data */
 	revents |= (events & (POLLOUT|POLLWRNORM));
 
@@ -3687,6 +4371,131 @@ capi_poll(struct cdev *dev, int events, struct thread *td)
 	return(revents);
 }
 
+#ifdef CAPI_SHM_SUPPORT
+/*---------------------------------------------------------------------------*
+ *	capi_mmap_single - map the shared memory, if any
+ *---------------------------------------------------------------------------*/
+static int
+capi_mmap_single(struct cdev *dev, vm_ooffset_t *offset, vm_size_t size,
+		 struct vm_object **object, int nprot)
+{
+	struct capi_ai_softc *sc;
+	vm_object_t obj;
+	int error;
+
+	error = devfs_get_cdevpriv((void **)&sc);
+	if (error != 0)
+		return (error);
+	if (sc == NULL)
+		return (ENXIO);
+
+	CAPI_AI_LOCK(sc);
+
+	obj = sc->sc_shm_obj;
+
+	if((obj == NULL) ||
+	   (*offset >= sc->sc_shm_size) ||
+	   (size > (sc->sc_shm_size - *offset)))
+	{
+		error = EINVAL;
+	}
+	else
+	{
+		vm_object_reference(obj);
+		*object = obj;
+	}
+
+	CAPI_AI_UNLOCK(sc);
+
+	return(error);
+}
+#endif
+
+#ifdef CAPI_KQUEUE_SUPPORT
+/*---------------------------------------------------------------------------*
+ *	capi_kqfilter - device driver kqueue routine
+ *
+ * NOTE: the filter routines are called with the
+ * CAPI application interface lock held
+ *---------------------------------------------------------------------------*/
+static void
+capi_kqdetach_read(struct knote *kn)
+{
+	struct capi_ai_softc *sc = kn->kn_hook;
+
+	knlist_remove(&sc->sc_selinfo.si_note, kn, 0);
+}
+
+static int
+capi_kqevent_read(struct knote *kn, long hint)
+{
+	struct capi_ai_softc *sc = kn->kn_hook;
+
+	/* report the number of messages that can be
+	 * received, and not the number of bytes
+	 */
+	kn->kn_data = _IF_QLEN(&sc->sc_rdqueue);
+
+#ifdef CAPI_SHM_SUPPORT
+	if(sc->sc_shm_hdr != NULL)
+	{
+		uint32_t count;
+
+		count = sc->sc_shm_rx_head -
+		    atomic_load_acq_32(&sc->sc_shm_hdr->rx_tail);
+
+		/* "rx_tail" is written by the application */
+		if(count > sc->sc_shm_slot_count)
+		{
+			count = sc->sc_shm_slot_count;
+		}
+
+		kn->kn_data += count;
+	}
+#endif
+
+	if(sc->sc_flags & ST_MBUF_LOST)
+	{
+		/* let read() report the error */
+		return(1);
+	}
+	return(kn->kn_data != 0);
+}
+
+static struct filterops capi_filtops_read = {
+	.f_isfd = 1,
+	.f_detach = &capi_kqdetach_read,
+	.f_event = &capi_kqevent_read,
+};
+
+static int
+capi_kqfilter(struct cdev *dev, struct knote *kn)
+{
+	struct capi_ai_softc *sc;
+	int error;
+
+	error = devfs_get_cdevpriv((void **)&sc);
+	if (error != 0)
+		return (error);
+	if (sc == NULL)
+		return (ENXIO);
+
+	switch(kn->kn_filter) {
+	case EVFILT_READ:
+		kn->kn_fop = &capi_filtops_read;
+		break;
+	default:
+		return(EINVAL);
+	}
+
+	kn->kn_hook = sc;
+
+	knlist_add(&sc->sc_selinfo.si_note, kn, 0);
+
+	return(0);
+}
+#endif
+
 #define CAPI_CUSTOM_DTMF_IND(m,n) \
   m(n, BYTE_ARRAY, Digits, 1) \
   END
@@ -3718,13 +4527,11 @@ capi_put_dtmf(struct fifo_translator *f, uint8_t *dtmf_ptr, uint16_t dtmf_len)
 }
 
 /*---------------------------------------------------------------------------*
- *	this routine is called from the HSCX interrupt handler
- *	when a new frame (mbuf) has been received
+ *	send CAPI data B3 indication
  *---------------------------------------------------------------------------*/
 static void
-capi_put_mbuf(struct fifo_translator *f, struct mbuf *m1)
+capi_ai_data_b3_ind(struct call_desc *cd, struct mbuf *m1)
 {
-	struct call_desc *cd = f->L5_sc;
 	struct capi_ai_softc *sc = cd->ai_ptr;
 	struct {
 	  /* XXX this structure is 
@@ -3743,6 +4550,12 @@ capi_put_mbuf(struct fifo_translator *f, struct mbuf *m1)
 
 	if(cd->ai_type == I4B_AI_CAPI)
 	{
+#ifdef CAPI_SHM_SUPPORT
+	    if(capi_shm_put_data(sc, cd, m1))
+	    {
+		return;
+	    }
+#endif
 	    if((m2 = i4b_getmbuf(sizeof(*mp), M_NOWAIT)))
 	    {
 	        mp = (void *)(m2->m_data);
@@ -3781,6 +4594,97 @@ capi_put_mbuf(struct fifo_translator *f, struct mbuf *m1)
 	return;
 }
 
+/*---------------------------------------------------------------------------*
+ *	capi_rx_coalesce - join received transparent data
+ *
+ * Returns the data that should be indicated now, if any.
+ *
+ * NOTE: There is no timer. The delay is only checked when more data
+ * is received. This is sufficient, because a transparent B-channel
+ * delivers data at a steady rate while it is connected, and the
+ * pending data is indicated when it is disconnected.
+ *---------------------------------------------------------------------------*/
+static struct mbuf *
+capi_rx_coalesce(struct call_desc *cd, struct mbuf *m1)
+{
+	struct mbuf *m0 = cd->capi_rx_pending;
+	uint32_t len = m_length(m1, NULL);
+
+	if(m0 != NULL)
+	{
+		if((cd->capi_rx_len + len) > cd->curr_max_packet_size)
+		{
+			/* indicate the pending data and
+			 * start over with the new data
+			 */
+			cd->capi_rx_pending = m1;
+			cd->capi_rx_len = len;
+			cd->capi_rx_ticks = ticks;
+			return(m0);
+		}
+
+		m_cat(m0, m1);
+		cd->capi_rx_len += len;
+	}
+	else
+	{
+		m0 = m1;
+		cd->capi_rx_pending = m0;
+		cd->capi_rx_len = len;
+		cd->capi_rx_ticks = ticks;
+	}
+
+	if((cd->capi_rx_len >= cd->curr_max_packet_size) ||
+	   ((uint32_t)(ticks - cd->capi_rx_ticks) >= cd->capi_rx_delay))
+	{
+		cd->capi_rx_pending = NULL;
+		cd->capi_rx_len = 0;
+		return(m0);
+	}
+	return(NULL);
+}
+
+/*---------------------------------------------------------------------------*
+ *	capi_conf_flush - queue deferred DATA_B3 confirmations
+ *---------------------------------------------------------------------------*/
+static void
+capi_conf_flush(struct call_desc *cd)
+{
+	struct mbuf *m;
+
+	while(1)
+	{
+		_IF_DEQUEUE(&cd->capi_conf_queue, m);
+
+		if(m == NULL)
+			break;
+
+		capi_ai_putqueue(cd->ai_ptr,0,m,NULL);
+	}
+}
+
+/*---------------------------------------------------------------------------*
+ *	this routine is called from the HSCX interrupt handler
+ *	when a new frame (mbuf) has been received
+ *---------------------------------------------------------------------------*/
+static void
+capi_put_mbuf(struct fifo_translator *f, struct mbuf *m1)
+{
+	struct call_desc *cd = f->L5_sc;
+
+	if(cd->capi_rx_delay != 0)
+	{
+		m1 = capi_rx_coalesce(cd, m1);
+
+		if(m1 == NULL)
+		{
+			return;
+		}
+	}
+
+	capi_ai_data_b3_ind(cd, m1);
+}
+
 /*---------------------------------------------------------------------------*
  *	this routine is called from the HSCX interrupt handler
  *	when the last frame has been sent out and there is no
@@ -3805,8 +4709,28 @@ capi_get_mbuf(struct fifo_translator *f)
 			m1 = m1->m_next;
 			m2->m_next = NULL;
 
-			/* send acknowledge back */
-			capi_ai_putqueue(sc,0,m2,NULL);
+			if(cd->capi_conf_max != 0)
+			{
+				/* defer acknowledge */
+				_IF_ENQUEUE(&cd->capi_conf_queue, m2);
+
+				if((_IF_QLEN(&cd->capi_conf_queue) >=
+				    cd->capi_conf_max) ||
+				   _IF_QEMPTY(&f->tx_queue))
+				{
+					capi_conf_flush(cd);
+				}
+			}
+			else
+			{
+				/* send acknowledge back */
+				capi_ai_putqueue(sc,0,m2,NULL);
+			}
+		}
+		else
+		{
+			/* no more data, so send all acknowledges */
+			capi_conf_flush(cd);
 		}
 	}
 	else
@@ -3834,7 +4758,7 @@ capi_alloc_mbuf(struct fifo_translator *f, uint16_t def_len, uint16_t tr_len)
 	    def_len = cd->curr_max_packet_size;
 	}
 
-	return i4b_getmbuf(def_len, M_NOWAIT);
+	return i4b_mbuf_pool_get(f->mbuf_pool, def_len);
 }
 
 /*---------------------------------------------------------------------------*
@@ -3887,6 +4811,29 @@ capi_setup_ft(i4b_controller_t *cntl, fifo_translator_t *f,
 		    if (cd->curr_max_packet_size < MIN_B_DATA_LEN) {
 		        cd->curr_max_packet_size = MIN_B_DATA_LEN;
 		    }
+
+		    /* HDLC frames cannot be joined */
+		    if ((sc->sc_rx_delay != 0) &&
+			(pp->protocol_1 == P_TRANS)) {
+		        cd->capi_rx_delay = 
+			  ((sc->sc_rx_delay * hz) + 999) / 1000;
+		    } else {
+		        cd->capi_rx_delay = 0;
+		    }
+		    cd->capi_conf_max = sc->sc_conf_max;
+
+		    /* flush confirmations at half the transmit
+		     * window, so that the application can refill
+		     * the window before it runs empty
+		     */
+		    if (cd->capi_conf_max > (f->tx_queue.ifq_maxlen / 2)) {
+		        cd->capi_conf_max = (f->tx_queue.ifq_maxlen / 2);
+		    }
+
+		    /* passed to the echo canceller by L1_FIFO_SETUP */
+		    if (PROT_IS_TRANSPARENT(pp)) {
+		        pp->u.transp.echo_cancel_mode = sc->sc_ec_mode;
+		    }
 		    CAPI_AI_UNLOCK(sc);
 		}
 
@@ -3896,6 +4843,17 @@ capi_setup_ft(i4b_controller_t *cntl, fifo_translator_t *f,
 	{
 		/* disconnected */
 
+		struct mbuf *m = cd->capi_rx_pending;
+
+		if(m != NULL)
+		{
+			cd->capi_rx_pending = NULL;
+			cd->capi_rx_len = 0;
+			capi_ai_data_b3_ind(cd, m);
+		}
+
+		capi_conf_flush(cd);
+
 		capi_ai_disconnect_b3_ind(cd);
 	}
 	return f;
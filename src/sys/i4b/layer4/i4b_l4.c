@@ -812,7 +812,7 @@ response_to_user_t *i4b_drivers_response_to_user[N_I4B_DRIVERS];
 static struct mbuf *
 i4b_default_alloc_mbuf(struct fifo_translator *f, uint16_t def_len, uint16_t tr_len)
 {
-    return i4b_getmbuf(def_len, M_NOWAIT);
+    return i4b_mbuf_pool_get(f->mbuf_pool, def_len);
 }
 
 void
@@ -944,6 +944,8 @@ i4b_setup_driver(i4b_controller_t *cntl, uint32_t channel,
 	  /* set mutex */
 	  f2->mtx = CNTL_GET_LOCK(cntl);
 
+	  f2->mbuf_pool = &cntl->mbuf_pool;
+
 	  /* increase refcount in case
 	   * the disconnect happens while
 	   * another thread is sleeping
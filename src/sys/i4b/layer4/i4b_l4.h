@@ -116,6 +116,7 @@ extern struct call_desc * cd_by_unitcr(struct i4b_controller *cntl,
 				       u_int cr);
 
 extern void i4b_free_cd(struct call_desc *cd);
+extern void cd_set_cr(struct call_desc *cd, u_int cr);
 extern void cd_allocate_channel(struct call_desc *cd);
 extern void cd_free_channel(struct call_desc *cd);
 
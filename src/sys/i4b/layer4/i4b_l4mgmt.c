@@ -54,18 +54,37 @@
 
 #include <i4b/layer4/i4b_l4.h>
 
+/*---------------------------------------------------------------------------*
+ *	get call descriptor by CDID reference
+ *	-------------------------------------
+ *	The reference part of a CDID selects the call descriptor
+ *	directly, so that no searching is needed.
+ *---------------------------------------------------------------------------*/
+static struct call_desc *
+cd_by_ref(struct i4b_controller *cntl, u_int ref)
+{
+	u_int n = (cntl->N_call_desc_end - cntl->N_call_desc_start);
+
+	if(n == 0)
+	{
+		return(NULL);
+	}
+	return(cntl->N_call_desc_start + (ref % n));
+}
+
 /*---------------------------------------------------------------------------*
  *	get a new unique CDID value,
  *	----------------------------
  *	which is used to uniquely identify a single call [-descriptor]
- *	in the communication between kernel and userland
+ *	in the communication between kernel and userland. Only
+ *	CDID values that map to an unused call descriptor are
+ *	returned, which makes the CDID unique.
  *---------------------------------------------------------------------------*/
 static u_int
 get_cdid(struct i4b_controller *cntl)
 {
-	uint8_t timeout = 1;
 	struct call_desc *cd;
-	u_int new_cdid;
+	u_int timeout;
 
 	CNTL_LOCK_ASSERT(cntl);
 
@@ -77,88 +96,122 @@ get_cdid(struct i4b_controller *cntl)
 	  cntl->N_cdid_end = CDID_REF_MAX;
 	}
 
- again:
 	/* NOTE: "N_cdid_xxx" must be multiplied by
 	 * "I4B_MAX_CONTROLLERS" to get the real cdid value !
 	 */
 
-	/* get next ID */
-	cntl->N_cdid_count++;
-
-	/* range-check */
-	if((cntl->N_cdid_count <= 0) ||
-	   (cntl->N_cdid_count >= cntl->N_cdid_end))
+	for(timeout = cntl->N_cdid_end; timeout--; )
 	{
-	  if(!timeout--)
-	  {
-	    /* no CDID value available */
-	    return CDID_UNUSED;
-	  }
-	  cntl->N_cdid_count = 1;
-	}
+		/* get next ID */
+		cntl->N_cdid_count++;
 
-	new_cdid = MAKE_CDID(cntl->unit, cntl->N_cdid_count);
+		/* range-check */
+		if((cntl->N_cdid_count <= 0) ||
+		   (cntl->N_cdid_count >= cntl->N_cdid_end))
+		{
+			cntl->N_cdid_count = 1;
+		}
 
-	/* check if ID already in use */
-	CD_FOREACH(cd, cntl)
-	{
-		if(cd->cdid == new_cdid)
+		/* check if ID already in use */
+		cd = cd_by_ref(cntl, cntl->N_cdid_count);
+
+		if((cd != NULL) && (cd->cdid == CDID_UNUSED))
 		{
-			goto again;
+			return MAKE_CDID(cntl->unit, cntl->N_cdid_count);
 		}
 	}
 
-	return new_cdid;
+	/* no CDID value available */
+	return CDID_UNUSED;
 }
 
 /*---------------------------------------------------------------------------*
  *      reserve a call descriptor for later usage
  *      ----------------------------------------
- *      searches the call descriptor array until an unused
- *      descriptor is found, gets a new call descriptor id
- *      and reserves it by putting the id into the cdid field.
- *      returns pointer to the call descriptor.
+ *      gets a new call descriptor id and reserves the
+ *      call descriptor it maps to, by putting the id
+ *      into the cdid field. returns pointer to the
+ *      call descriptor.
  *---------------------------------------------------------------------------*/
 struct call_desc *
 i4b_allocate_cd(struct i4b_controller *cntl)
 {
 	struct call_desc *cd;
+	u_int cdid;
 
 	CNTL_LOCK_ASSERT(cntl);
 
-	CD_FOREACH(cd, cntl)
+	cdid = get_cdid(cntl);
+
+	if(cdid == CDID_UNUSED)
 	{
-		if(cd->cdid == CDID_UNUSED)
-		{
-			/* clear call descriptor */
-			bzero(cd, sizeof(*cd));
+		return(NULL);
+	}
 
-			cd->cdid = get_cdid(cntl);	/* fill in new cdid */
-			cd->p_cntl = cntl;
+	cd = cd_by_ref(cntl, CDID2CALLREFERENCE(cdid));
 
-			if(cd->cdid == CDID_UNUSED)
-			{
-				goto error;
-			}
+	/* clear call descriptor */
+	bzero(cd, sizeof(*cd));
 
-			callout_init_mtx(&cd->idle_callout, 
-					   CNTL_GET_LOCK(cntl), 0);
+	cd->cdid = cdid;	/* fill in new cdid */
+	cd->p_cntl = cntl;
 
-			callout_init_mtx(&cd->set_state_callout, 
-					   CNTL_GET_LOCK(cntl), 0);
+	callout_init_mtx(&cd->idle_callout, 
+			   CNTL_GET_LOCK(cntl), 0);
 
-			NDBGL4(L4_MSG, "found free cd - "
-			       "cdid=%d", cd->cdid);
+	callout_init_mtx(&cd->set_state_callout, 
+			   CNTL_GET_LOCK(cntl), 0);
 
-  			goto done;
+	NDBGL4(L4_MSG, "found free cd - "
+	       "cdid=%d", cd->cdid);
+
+ 	return(cd);
+}
+
+/*---------------------------------------------------------------------------*
+ *	unlink a call descriptor from the call reference hash
+ *---------------------------------------------------------------------------*/
+static void
+cd_unlink_cr(struct call_desc *cd)
+{
+	struct i4b_controller *cntl = i4b_controller_by_cd(cd);
+	struct call_desc **pp;
+
+	for(pp = &cntl->N_cr_hash[cd->cr & (I4B_CR_HASH_MAX - 1)];
+	    *pp != NULL;
+	    pp = &(*pp)->cr_hash_next)
+	{
+		if(*pp == cd)
+		{
+			*pp = cd->cr_hash_next;
+			break;
 		}
 	}
+	cd->cr_hash_next = NULL;
+}
+
+/*---------------------------------------------------------------------------*
+ *	set call reference of a call descriptor
+ *	---------------------------------------
+ *	the call descriptor is hashed by call reference,
+ *	so that "cd_by_unitcr()" does not have to search
+ *	all call descriptors.
+ *---------------------------------------------------------------------------*/
+void
+cd_set_cr(struct call_desc *cd, u_int cr)
+{
+	struct i4b_controller *cntl = i4b_controller_by_cd(cd);
+	struct call_desc **pp;
 
- error:
-	cd = NULL;
+	CNTL_LOCK_ASSERT(cntl);
 
- done:
- 	return(cd);
+	cd_unlink_cr(cd);
+
+	cd->cr = cr;
+
+	pp = &cntl->N_cr_hash[cr & (I4B_CR_HASH_MAX - 1)];
+	cd->cr_hash_next = *pp;
+	*pp = cd;
 }
 
 /*---------------------------------------------------------------------------*
@@ -173,6 +226,8 @@ i4b_free_cd(struct call_desc *cd)
 	NDBGL4(L4_MSG, "releasing cd - cdid=%u, cr=%d",
 	       cd->cdid, cd->cr);
 
+	cd_unlink_cr(cd);
+
 	cd->cdid = CDID_UNUSED;
 
 	callout_stop(&cd->idle_callout);
@@ -303,9 +358,9 @@ cd_set_appl_interface(struct call_desc *cd, uint8_t appl_interface_type,
 /*---------------------------------------------------------------------------*
  *      return pointer to call descriptor by giving the call descriptor id
  *      ----------------------------------------------------------------
- *      lookup a call descriptor in the call descriptor array by looking
- *      at the cdid field. return pointer to call descriptor if found,
- *      else return NULL if not found.
+ *      lookup a call descriptor in the call descriptor array by the
+ *      reference part of the cdid. return pointer to call descriptor
+ *      if found, else return NULL if not found.
  *---------------------------------------------------------------------------*/
 struct call_desc *
 cd_by_cdid(struct i4b_controller *cntl, unsigned int cdid)
@@ -316,15 +371,14 @@ cd_by_cdid(struct i4b_controller *cntl, unsigned int cdid)
 
 	if(cdid != CDID_UNUSED)
 	{
-	    CD_FOREACH(cd, cntl)
+	    cd = cd_by_ref(cntl, CDID2CALLREFERENCE(cdid));
+
+	    if((cd != NULL) && (cd->cdid == cdid))
 	    {
-		if(cd->cdid == cdid)
-		{
-			NDBGL4(L4_MSG, "found cdid - cdid=%u cr=%d",
-			       cd->cdid, cd->cr);
+		NDBGL4(L4_MSG, "found cdid - cdid=%u cr=%d",
+		       cd->cdid, cd->cr);
 
-			return(cd);
-		}
+		return(cd);
 	    }
 	}
 	return(NULL);
@@ -360,8 +414,13 @@ cd_by_unitcr(struct i4b_controller *cntl, void *pipe, void *pipe_adapter, u_int
 
 	/* NT use CR to identify
 	 * TE use TEI+CR to identify
+	 *
+	 * NOTE: the hash is by CR only, hence
+	 * the pipe can be either of two
 	 */
-	CD_FOREACH(cd, cntl)
+	for(cd = cntl->N_cr_hash[cr & (I4B_CR_HASH_MAX - 1)];
+	    cd != NULL;
+	    cd = cd->cr_hash_next)
 	{
 	    if((cd->cdid != CDID_UNUSED)  &&
 	       (cd->cr == cr)             &&
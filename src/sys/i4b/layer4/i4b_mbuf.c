@@ -35,7 +35,10 @@
 #else
 #include <sys/param.h>
 #include <sys/systm.h>
+#include <sys/lock.h>
+#include <sys/mutex.h>
 #include <sys/mbuf.h>
+#include <machine/atomic.h>
 #include <sys/socket.h>
 #include <net/if.h>
 #endif
@@ -102,3 +105,213 @@ i4b_getmbuf(int len, int how)
 	return(m);
 }
 
+/*---------------------------------------------------------------------------*
+ *	allocate mbuf space from a controller's mbuf pool
+ *
+ * NOTE: the pool must be locked by the caller. If the pool is
+ * empty, the mbuf is taken from the system.
+ *---------------------------------------------------------------------------*/
+struct mbuf *
+i4b_mbuf_pool_get(struct i4b_mbuf_pool *pool, int len)
+{
+	struct mbuf *m;
+
+	if((pool == NULL) || (len < (int)MHLEN) || (len > MCLBYTES))
+	{
+		return (i4b_getmbuf(len, M_NOWAIT));
+	}
+
+	mtx_assert(pool->mtx, MA_OWNED);
+
+	m = pool->free;
+
+	if(m == NULL)
+	{
+		pool->misses++;
+
+		return (i4b_getmbuf(len, M_NOWAIT));
+	}
+
+	pool->free = m->m_nextpkt;
+	pool->count--;
+	pool->hits++;
+
+	m->m_nextpkt = NULL;
+	m->m_len = len;
+	m->m_pkthdr.len = len;
+
+	return (m);
+}
+
+/*---------------------------------------------------------------------------*
+ *	free mbuf into a controller's mbuf pool
+ *
+ * NOTE: the pool must be locked by the caller. Only the first mbuf
+ * of a chain is kept, and only if it has a private cluster.
+ * Everything else is given back to the system.
+ *---------------------------------------------------------------------------*/
+void
+i4b_mbuf_pool_put(struct i4b_mbuf_pool *pool, struct mbuf *m)
+{
+	if(m == NULL)
+	{
+		return;
+	}
+
+	if((pool == NULL) ||
+	   (pool->count >= I4B_MBUF_POOL_MAX) ||
+	   ((m->m_flags & (M_PKTHDR|M_EXT)) != (M_PKTHDR|M_EXT)) ||
+	   (m->m_ext.ext_type != EXT_CLUSTER) ||
+	   (!M_WRITABLE(m)))
+	{
+		if(pool)
+		{
+			mtx_assert(pool->mtx, MA_OWNED);
+
+			pool->dropped++;
+		}
+		m_freem(m);
+		return;
+	}
+
+	mtx_assert(pool->mtx, MA_OWNED);
+
+	if(m->m_next)
+	{
+		m_freem(m->m_next);
+		m->m_next = NULL;
+	}
+
+	/* reset packet header */
+	m_tag_delete_chain(m, NULL);
+#if (__FreeBSD_version >= 1000000)
+	m_pkthdr_init(m, M_NOWAIT);
+#else
+	m->m_pkthdr.rcvif = NULL;
+	m->m_pkthdr.csum_flags = 0;
+#endif
+	m->m_flags &= (M_PKTHDR|M_EXT);
+	m->m_data = m->m_ext.ext_buf;
+	m->m_len = 0;
+	m->m_pkthdr.len = 0;
+
+	m->m_nextpkt = pool->free;
+	pool->free = m;
+	pool->count++;
+	pool->recycled++;
+}
+
+/*---------------------------------------------------------------------------*
+ *	give all mbufs in a controller's mbuf pool back to the system
+ *---------------------------------------------------------------------------*/
+void
+i4b_mbuf_pool_drain(struct i4b_mbuf_pool *pool)
+{
+	struct mbuf *m;
+
+	mtx_assert(pool->mtx, MA_OWNED);
+
+	while((m = pool->free) != NULL)
+	{
+		pool->free = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+		m_freem(m);
+	}
+	pool->count = 0;
+}
+
+#if (__FreeBSD_version >= 1000000)
+#define	I4B_MBUF_RING_BARRIER() atomic_thread_fence_seq_cst()
+#else
+#define	I4B_MBUF_RING_BARRIER() mb()
+#endif
+
+/*---------------------------------------------------------------------------*
+ *	put mbuf on a ring - called by the producer
+ *
+ * Returns zero on success, else the ring is full and the mbuf has
+ * not been queued.
+ *---------------------------------------------------------------------------*/
+int
+i4b_mbuf_ring_enqueue(struct i4b_mbuf_ring *r, struct mbuf *m)
+{
+	uint32_t head = r->head;
+
+	if((head - atomic_load_acq_32(&r->tail)) >= I4B_MBUF_RING_MAX)
+	{
+		r->full++;
+		return (ENOBUFS);
+	}
+
+	r->ring[head & (I4B_MBUF_RING_MAX-1)] = m;
+
+	/* publish the mbuf */
+	atomic_store_rel_32(&r->head, head + 1);
+
+	return (0);
+}
+
+/*---------------------------------------------------------------------------*
+ *	get mbuf from a ring - called by the consumer
+ *
+ * If the ring is empty, the idle flag is set before the ring is
+ * checked again, so that the producer either sees the flag or the
+ * consumer sees the new mbuf.
+ *---------------------------------------------------------------------------*/
+struct mbuf *
+i4b_mbuf_ring_dequeue(struct i4b_mbuf_ring *r)
+{
+	uint32_t tail = r->tail;
+	struct mbuf *m;
+
+	if(tail == atomic_load_acq_32(&r->head))
+	{
+		r->idle = 1;
+
+		I4B_MBUF_RING_BARRIER();
+
+		if(tail == atomic_load_acq_32(&r->head))
+		{
+			return (NULL);
+		}
+
+		r->idle = 0;
+	}
+
+	m = r->ring[tail & (I4B_MBUF_RING_MAX-1)];
+	r->ring[tail & (I4B_MBUF_RING_MAX-1)] = NULL;
+
+	/* release the slot */
+	atomic_store_rel_32(&r->tail, tail + 1);
+
+	return (m);
+}
+
+/*---------------------------------------------------------------------------*
+ *	check if the consumer of a ring has gone idle - called by
+ *	the producer after "i4b_mbuf_ring_enqueue()"
+ *
+ * Returns non-zero if the consumer must be restarted. The idle
+ * flag is cleared.
+ *---------------------------------------------------------------------------*/
+uint8_t
+i4b_mbuf_ring_idle(struct i4b_mbuf_ring *r)
+{
+	I4B_MBUF_RING_BARRIER();
+
+	return (atomic_readandclear_32(&r->idle) ? 1 : 0);
+}
+
+/*---------------------------------------------------------------------------*
+ *	free all mbufs on a ring - called by the consumer
+ *---------------------------------------------------------------------------*/
+void
+i4b_mbuf_ring_drain(struct i4b_mbuf_ring *r)
+{
+	struct mbuf *m;
+
+	while((m = i4b_mbuf_ring_dequeue(r)) != NULL)
+	{
+		m_freem(m);
+	}
+}
@@ -34,6 +34,7 @@
 #include <sys/time.h>
 #include <sys/endian.h>
 #include <sys/types.h>
+#include <sys/event.h>
 #include <sys/socket.h>
 #include <sys/ioccom.h>
 #include <sys/filio.h>
@@ -47,45 +48,15 @@
 #include <pthread.h>
 #include <libutil.h>
 #include <err.h>
+#include <zlib.h>
 
 #define	CAPI_MAKE_IOCTL
 #include <i4b/include/capi20.h>
-
-#define	CAPISERVER_HDR_SIZE 4		/* bytes */
-
-/* define supported commands */
-enum {
-	CAPISERVER_CMD_CAPI_MSG,
-	CAPISERVER_CMD_CAPI_REGISTER,
-	CAPISERVER_CMD_CAPI_MANUFACTURER,
-	CAPISERVER_CMD_CAPI_VERSION,
-	CAPISERVER_CMD_CAPI_SERIAL,
-	CAPISERVER_CMD_CAPI_PROFILE,
-	CAPISERVER_CMD_CAPI_START,
-};
+#include <i4b/include/i4b_capi_ioctl.h>
+#include <i4b/include/i4b_capiserver.h>
 
 static struct pidfh *local_pid;
 
-static int
-capiserver_read(int fd, char *buf, int len)
-{
-	int retval = 0;
-
-	while (len > 0) {
-		int delta;
-
-		delta = read(fd, buf, len);
-		if (delta == 0)
-			return (-1);	/* hangup */
-		if (delta < 0)
-			return (-1);
-		buf += delta;
-		len -= delta;
-		retval += delta;
-	}
-	return (retval);
-}
-
 static int
 capiserver_do_listen(const char *host, const char *port, int buffer, int *pfd, int num_sock)
 {
@@ -138,22 +109,287 @@ capiserver_do_listen(const char *host, const char *port, int buffer, int *pfd, i
 	return (ns);
 }
 
+#define	CAPISERVER_BUF_MIN 4096		/* bytes */
+#define	CAPISERVER_BUF_MAX 65536	/* bytes, per read() from CAPI */
+#define	CAPISERVER_TX_MAX (4 * CAPISERVER_BUF_MAX) /* bytes, queued for TCP */
+#define	CAPISERVER_SOCK_MAX 32
+#define	CAPISERVER_IOV_MAX 64		/* messages per writev() */
+#define	CAPISERVER_EV_MAX 64		/* events per kevent() */
+#define	CAPISERVER_THREAD_MAX 64
+#define	CAPISERVER_DEFLATE_MIN 64	/* bytes, smallest data to compress */
+
+#define	CAPISERVER_FEATURES \
+	(CAPISERVER_FEATURE_MULTI | CAPISERVER_FEATURE_REQID | \
+	CAPISERVER_FEATURE_DEFLATE)
+
+struct capiserver_buf {
+	uint8_t *ptr;
+	size_t	off;			/* bytes consumed */
+	size_t	len;			/* bytes valid */
+	size_t	size;			/* bytes allocated */
+};
+
+struct capiserver_conn {
+	struct capiserver_conn *next_dead;
+	struct capiserver_buf rx;	/* from TCP */
+	struct capiserver_buf tx;	/* to TCP */
+	size_t	tx_frame;		/* open frame, relative to "tx.off" */
+	uint32_t features;		/* negotiated using HELLO */
+	int	capi_fd;
+	int	tcp_fd;
+	uint8_t	batch;
+	uint8_t	tx_frame_on;		/* a frame is open */
+	uint8_t	capi_rd_on;		/* CAPI read filter is enabled */
+	uint8_t	tcp_wr_on;		/* TCP write filter is enabled */
+	uint8_t	dead;
+};
+
+struct capiserver_worker {
+	pthread_t thread;
+	int	kq;
+	uint8_t	scratch[CAPISERVER_BUF_MAX];
+	uint8_t	zbuf[I4B_CAPI_BATCH_HDR_SIZE + CAPISERVER_BUF_MAX];
+};
+
+/*
+ * Make room for at least "n" more bytes at the end of the buffer.
+ */
+static int
+capiserver_buf_reserve(struct capiserver_buf *pb, size_t n)
+{
+	uint8_t *ptr;
+	size_t size;
+
+	if ((pb->size - pb->len) >= n)
+		return (0);
+
+	/* reclaim consumed space first */
+	if (pb->off != 0) {
+		memmove(pb->ptr, pb->ptr + pb->off, pb->len - pb->off);
+		pb->len -= pb->off;
+		pb->off = 0;
+
+		if ((pb->size - pb->len) >= n)
+			return (0);
+	}
+	size = (pb->size != 0) ? pb->size : CAPISERVER_BUF_MIN;
+	while ((size - pb->len) < n)
+		size *= 2;
+
+	ptr = realloc(pb->ptr, size);
+	if (ptr == NULL)
+		return (-1);
+
+	pb->ptr = ptr;
+	pb->size = size;
+	return (0);
+}
+
+static int
+capiserver_tx_append(struct capiserver_conn *pc, const void *data, size_t length)
+{
+	struct capiserver_buf *pb = &pc->tx;
+
+	if (capiserver_buf_reserve(pb, length))
+		return (-1);
+
+	memcpy(pb->ptr + pb->len, data, length);
+	pb->len += length;
+	return (0);
+}
+
+/*
+ * Set the length of the open frame, if any. The frame must be
+ * closed before calling capiserver_tcp_output().
+ */
+static void
+capiserver_tx_end(struct capiserver_conn *pc)
+{
+	struct capiserver_buf *pb = &pc->tx;
+	uint8_t *ptr;
+	size_t length;
+
+	if (pc->tx_frame_on == 0)
+		return;
+	pc->tx_frame_on = 0;
+
+	ptr = pb->ptr + pb->off + pc->tx_frame;
+	length = pb->len - pb->off - pc->tx_frame - CAPISERVER_HDR_SIZE;
+
+	ptr[0] = length & 0xFF;
+	ptr[1] = length >> 8;
+}
+
+/*
+ * Start a new frame. The buffer may move while data is appended,
+ * so the frame position is stored relative to the consumed data.
+ */
+static int
+capiserver_tx_start(struct capiserver_conn *pc, uint8_t cmd, uint8_t error)
+{
+	struct capiserver_buf *pb = &pc->tx;
+	uint8_t header[CAPISERVER_HDR_SIZE];
+
+	capiserver_tx_end(pc);
+
+	header[0] = 0;
+	header[1] = 0;
+	header[2] = cmd;
+	header[3] = error;
+
+	if (capiserver_tx_append(pc, header, sizeof(header)))
+		return (-1);
+
+	pc->tx_frame = pb->len - pb->off - CAPISERVER_HDR_SIZE;
+	pc->tx_frame_on = 1;
+	return (0);
+}
+
+/*
+ * Queue one message for the TCP connection.
+ */
+static int
+capiserver_tx_msg(struct capiserver_conn *pc, uint8_t cmd,
+    uint8_t error, const void *data, size_t length)
+{
+	if (capiserver_tx_start(pc, cmd, error) ||
+	    capiserver_tx_append(pc, data, length))
+		return (-1);
+
+	capiserver_tx_end(pc);
+	return (0);
+}
+
+/*
+ * Compress the B-channel data of a DATA_B3 message, "mlen" bytes
+ * into the message. Returns 1 if the message was queued, 0 if
+ * compression does not pay off and -1 on failure.
+ */
+static int
+capiserver_tx_deflate(struct capiserver_worker *pw, struct capiserver_conn *pc,
+    const uint8_t *data, size_t length, size_t mlen)
+{
+	uLongf zlen;
+	size_t dlen = length - mlen;
+	uint8_t hdr[2];
+
+	/* the compressed data must be smaller, including its header */
+	zlen = dlen - sizeof(hdr) - 1;
+
+	if (compress2(pw->zbuf, &zlen, data + mlen, dlen, Z_BEST_SPEED) != Z_OK)
+		return (0);
+
+	hdr[0] = dlen & 0xFF;
+	hdr[1] = dlen >> 8;
+
+	if (capiserver_tx_start(pc, CAPISERVER_CMD_CAPI_DEFLATE, 0) ||
+	    capiserver_tx_append(pc, data, mlen) ||
+	    capiserver_tx_append(pc, hdr, sizeof(hdr)) ||
+	    capiserver_tx_append(pc, pw->zbuf, zlen))
+		return (-1);
+
+	capiserver_tx_end(pc);
+	return (1);
+}
+
+/*
+ * Queue one CAPI message for the TCP connection, using the
+ * features negotiated. Consecutive messages are collected in one
+ * CAPI_MULTI frame, which stays open until capiserver_tx_end().
+ */
+static int
+capiserver_tx_capi(struct capiserver_worker *pw, struct capiserver_conn *pc,
+    const uint8_t *data, size_t length)
+{
+	struct capiserver_buf *pb = &pc->tx;
+	uint8_t hdr[CAPISERVER_MULTI_HDR_SIZE];
+	size_t mlen;
+	int retval;
+
+	if ((pc->features & CAPISERVER_FEATURE_DEFLATE) &&
+	    length >= CAPISERVER_CAPI_HDR_SIZE &&
+	    data[CAPISERVER_CAPI_CMD_OFFSET] == CAPISERVER_CAPI_DATA_B3) {
+		mlen = data[0] | (data[1] << 8);
+
+		if (mlen >= CAPISERVER_CAPI_HDR_SIZE && mlen <= length &&
+		    (length - mlen) >= CAPISERVER_DEFLATE_MIN) {
+			retval = capiserver_tx_deflate(pw, pc, data, length, mlen);
+			if (retval != 0)
+				return (retval < 0 ? -1 : 0);
+		}
+	}
+
+	if ((pc->features & CAPISERVER_FEATURE_MULTI) == 0 ||
+	    length > (CAPISERVER_FRAME_MAX - sizeof(hdr)))
+		return (capiserver_tx_msg(pc, CAPISERVER_CMD_CAPI_MSG,
+		    0, data, length));
+
+	/* start a new frame if there is none or if it is full */
+	if (pc->tx_frame_on == 0 ||
+	    (pb->len - pb->off - pc->tx_frame - CAPISERVER_HDR_SIZE +
+	    sizeof(hdr) + length) > CAPISERVER_FRAME_MAX) {
+		if (capiserver_tx_start(pc, CAPISERVER_CMD_CAPI_MULTI, 0))
+			return (-1);
+	}
+
+	hdr[0] = length & 0xFF;
+	hdr[1] = length >> 8;
+
+	if (capiserver_tx_append(pc, hdr, sizeof(hdr)) ||
+	    capiserver_tx_append(pc, data, length))
+		return (-1);
+	return (0);
+}
+
+static int
+capiserver_set_filter(struct capiserver_worker *pw, struct capiserver_conn *pc,
+    int fd, int filter, uint8_t on, uint8_t *pstate)
+{
+	struct kevent kev;
+
+	if (*pstate == on)
+		return (0);
+
+	EV_SET(&kev, fd, filter, on ? EV_ENABLE : EV_DISABLE, 0, 0, pc);
+
+	if (kevent(pw->kq, &kev, 1, NULL, 0, NULL) != 0)
+		return (-1);
+
+	*pstate = on;
+	return (0);
+}
+
 #define	CAPI_FWD(x) (x) = le32toh(x)
 #define	CAPI_REV(x) (x) = htole32(x)
 
 static int
-capiserver_ioctl(int tcp_fd, uint32_t cmd, int capi_fd,
-    uint32_t ioctl_cmd, void *buffer, ssize_t length)
+capiserver_ioctl(struct capiserver_conn *pc, uint8_t cmd,
+    uint32_t ioctl_cmd, const uint8_t *data, size_t length)
 {
-	uint8_t header[CAPISERVER_HDR_SIZE] __aligned(4);
-	struct iovec iov[2];
+	uint64_t buffer[IOCPARM_MAX / 8];
+	const uint8_t *reqid = NULL;
 
+	if (CAPISERVER_CMD_HAS_REQID(cmd)) {
+		if ((pc->features & CAPISERVER_FEATURE_REQID) == 0)
+			return (0);	/* ignore */
+		if (length < CAPISERVER_REQID_SIZE) {
+			errno = EINVAL;
+			goto error;
+		}
+		reqid = data;
+		data += CAPISERVER_REQID_SIZE;
+		length -= CAPISERVER_REQID_SIZE;
+	}
 	if (length != IOCPARM_LEN(ioctl_cmd)) {
 		errno = EINVAL;
 		goto error;
 	}
+
+	/* the message data is not aligned */
+	memcpy(buffer, data, length);
+
 	if (ioctl_cmd == CAPI_REGISTER_REQ) {
-		struct capi_register_req *req = buffer;
+		struct capi_register_req *req = (void *)buffer;
 
 		CAPI_FWD(req->max_logical_connections);
 		CAPI_FWD(req->max_b_data_blocks);
@@ -164,15 +400,15 @@ capiserver_ioctl(int tcp_fd, uint32_t cmd, int capi_fd,
 		    ioctl_cmd == CAPI_GET_VERSION_REQ ||
 		    ioctl_cmd == CAPI_GET_SERIAL_REQ ||
 	    ioctl_cmd == CAPI_GET_PROFILE_REQ) {
-		uint32_t *pcontroller = buffer;
+		uint32_t *pcontroller = (void *)buffer;
 
 		CAPI_FWD(*pcontroller);
 	}
-	if (ioctl(capi_fd, ioctl_cmd, buffer) != 0)
+	if (ioctl(pc->capi_fd, ioctl_cmd, buffer) != 0)
 		goto error;
 
 	if (ioctl_cmd == CAPI_REGISTER_REQ) {
-		struct capi_register_req *req = buffer;
+		struct capi_register_req *req = (void *)buffer;
 
 		CAPI_REV(req->max_logical_connections);
 		CAPI_REV(req->max_b_data_blocks);
@@ -183,166 +419,831 @@ capiserver_ioctl(int tcp_fd, uint32_t cmd, int capi_fd,
 		    ioctl_cmd == CAPI_GET_VERSION_REQ ||
 		    ioctl_cmd == CAPI_GET_SERIAL_REQ ||
 	    ioctl_cmd == CAPI_GET_PROFILE_REQ) {
-		uint32_t *pcontroller = buffer;
+		uint32_t *pcontroller = (void *)buffer;
 
 		CAPI_REV(*pcontroller);
 	}
-	header[0] = length & 0xFF;
-	header[1] = length >> 8;
-	header[2] = cmd;
-	header[3] = 0;
+	if (capiserver_tx_start(pc, cmd, 0))
+		return (-1);
+	goto done;
 
-	iov[0].iov_base = header;
-	iov[0].iov_len = sizeof(header);
+error:
+	if (capiserver_tx_start(pc, cmd, (errno < 256) ? errno : EINVAL))
+		return (-1);
+	length = 0;
+done:
+	/* the request ID goes first, if any */
+	if (reqid != NULL &&
+	    capiserver_tx_append(pc, reqid, CAPISERVER_REQID_SIZE))
+		return (-1);
+	if (capiserver_tx_append(pc, buffer, length))
+		return (-1);
+	capiserver_tx_end(pc);
+	return (0);
+}
 
-	iov[1].iov_base = buffer;
-	iov[1].iov_len = length;
+/*
+ * Select the protocol version and features, see i4b_capiserver.h.
+ */
+static int
+capiserver_hello(struct capiserver_conn *pc, const uint8_t *data, size_t length)
+{
+	struct capiserver_hello hello;
 
-	if (writev(tcp_fd, iov, 2) != (ssize_t)(sizeof(header) + length))
-		return (-1);
+	if (length < sizeof(hello))
+		return (0);		/* ignore */
+
+	memcpy(&hello, data, sizeof(hello));
 
+	if (le32toh(hello.version) >= CAPISERVER_VERSION_2) {
+		pc->features = le32toh(hello.features) & CAPISERVER_FEATURES;
+		hello.version = htole32(CAPISERVER_VERSION_2);
+	} else {
+		pc->features = 0;
+		hello.version = htole32(CAPISERVER_VERSION_1);
+	}
+	hello.features = htole32(pc->features);
+
+	return (capiserver_tx_msg(pc, CAPISERVER_CMD_HELLO,
+	    0, &hello, sizeof(hello)));
+}
+
+static int
+capiserver_capi_writev(struct capiserver_conn *pc, struct iovec *iov,
+    int n, ssize_t total)
+{
+	if (n == 0)
+		return (0);
+	if (writev(pc->capi_fd, iov, n) != total)
+		return (-1);
 	return (0);
+}
 
-error:
-	header[0] = 0;
-	header[1] = 0;
-	header[2] = cmd;
-	if (errno < 256)
-		header[3] = errno;
-	else
-		header[3] = EINVAL;
+/*
+ * Write the messages of a CAPI_MULTI frame one by one, when the
+ * CAPI device does not support batching.
+ */
+static int
+capiserver_capi_write_multi(struct capiserver_conn *pc,
+    const uint8_t *data, size_t length)
+{
+	size_t len;
+
+	while (length >= CAPISERVER_MULTI_HDR_SIZE) {
+		len = data[0] | (data[1] << 8);
+		data += CAPISERVER_MULTI_HDR_SIZE;
+		length -= CAPISERVER_MULTI_HDR_SIZE;
 
-	if (write(tcp_fd, header, sizeof(header)) != sizeof(header))
+		if (len > length)
+			return (-1);
+		if (write(pc->capi_fd, data, len) != (ssize_t)len)
+			return (-1);
+
+		data += len;
+		length -= len;
+	}
+	return (length != 0 ? -1 : 0);
+}
+
+/*
+ * Decompress and write the message of a CAPI_DEFLATE frame.
+ */
+static int
+capiserver_capi_inflate(struct capiserver_worker *pw, struct capiserver_conn *pc,
+    const uint8_t *data, size_t length)
+{
+	uint8_t *ptr = pw->zbuf + I4B_CAPI_BATCH_HDR_SIZE;
+	uLongf zlen;
+	size_t mlen;
+	size_t dlen;
+	size_t total;
+
+	if (length < CAPISERVER_CAPI_HDR_SIZE)
+		return (-1);
+
+	mlen = data[0] | (data[1] << 8);
+	if (mlen < CAPISERVER_CAPI_HDR_SIZE || (mlen + 2) > length)
+		return (-1);
+
+	dlen = data[mlen] | (data[mlen + 1] << 8);
+	total = mlen + dlen;
+	if (total > CAPISERVER_FRAME_MAX)
+		return (-1);
+
+	memcpy(ptr, data, mlen);
+
+	zlen = dlen;
+	if (uncompress(ptr + mlen, &zlen, data + mlen + 2,
+	    length - mlen - 2) != Z_OK || zlen != dlen)
+		return (-1);
+
+	if (pc->batch == 0) {
+		if (write(pc->capi_fd, ptr, total) != (ssize_t)total)
+			return (-1);
+		return (0);
+	}
+	pw->zbuf[0] = total & 0xFF;
+	pw->zbuf[1] = total >> 8;
+
+	total += I4B_CAPI_BATCH_HDR_SIZE;
+	if (write(pc->capi_fd, pw->zbuf, total) != (ssize_t)total)
 		return (-1);
 	return (0);
 }
 
-struct capiserver_arg {
-	int	capi_fd;
-	int	tcp_fd;
-};
+/*
+ * Send as much queued data as possible to the TCP connection.
+ */
+static int
+capiserver_tcp_output(struct capiserver_worker *pw, struct capiserver_conn *pc)
+{
+	struct capiserver_buf *pb = &pc->tx;
+	ssize_t delta;
 
-#define	CAPISERVER_BUF_MAX 65536
-#define	CAPISERVER_SOCK_MAX 32
+	while (pb->off != pb->len) {
+		delta = write(pc->tcp_fd, pb->ptr + pb->off, pb->len - pb->off);
+		if (delta < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+			return (-1);
+		}
+		pb->off += delta;
+	}
+	if (pb->off == pb->len)
+		pb->off = pb->len = 0;
 
-static void *
-capiserver(void *_parg)
+	/* only wait for TCP when there is data left */
+	if (capiserver_set_filter(pw, pc, pc->tcp_fd, EVFILT_WRITE,
+	    pb->len != 0, &pc->tcp_wr_on))
+		return (-1);
+
+	/* stop reading CAPI messages while TCP is congested */
+	if (capiserver_set_filter(pw, pc, pc->capi_fd, EVFILT_READ,
+	    (pb->len - pb->off) < CAPISERVER_TX_MAX, &pc->capi_rd_on))
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Process all complete messages received from the TCP connection.
+ * Consecutive CAPI messages are written using a single system
+ * call, when batching is supported.
+ */
+static int
+capiserver_tcp_input(struct capiserver_worker *pw, struct capiserver_conn *pc)
 {
-	uint8_t header[CAPISERVER_HDR_SIZE] __aligned(4);
-	uint8_t *buffer;
-	struct capiserver_arg *parg = _parg;
-	struct pollfd fds[2];
-	ssize_t length;
+	struct capiserver_buf *pb = &pc->rx;
+	struct iovec iov[CAPISERVER_IOV_MAX];
+	ssize_t total;
+	ssize_t delta;
+	size_t length;
+	size_t need;
+	uint8_t *data;
 	uint8_t cmd;
+	int n;
 
-	buffer = malloc(CAPISERVER_BUF_MAX);
-	if (buffer == NULL)
-		goto done;
+	if (capiserver_buf_reserve(pb, CAPISERVER_BUF_MIN))
+		return (-1);
 
-	while (1) {
-		fds[0].fd = parg->capi_fd;
-		fds[0].events = (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI |
-		    POLLERR | POLLHUP | POLLNVAL);
-		fds[0].revents = 0;
+	delta = read(pc->tcp_fd, pb->ptr + pb->len, pb->size - pb->len);
+	if (delta == 0)
+		return (-1);	/* hangup */
+	if (delta < 0)
+		return ((errno == EAGAIN || errno == EINTR) ? 0 : -1);
+
+	pb->len += delta;
+
+	need = 0;
+	total = 0;
+	n = 0;
+
+	while ((pb->len - pb->off) >= CAPISERVER_HDR_SIZE) {
+		data = pb->ptr + pb->off;
+		length = data[0] | (data[1] << 8);
+		cmd = data[2];
+
+		if ((pb->len - pb->off) < (CAPISERVER_HDR_SIZE + length)) {
+			need = CAPISERVER_HDR_SIZE + length - (pb->len - pb->off);
+			break;
+		}
+		pb->off += CAPISERVER_HDR_SIZE + length;
+		data += CAPISERVER_HDR_SIZE;
 
-		fds[1].fd = parg->tcp_fd;
-		fds[1].events = (POLLIN | POLLRDNORM | POLLRDBAND | POLLPRI |
-		    POLLERR | POLLHUP | POLLNVAL);
-		fds[1].revents = 0;
+		if (cmd == CAPISERVER_CMD_CAPI_MULTI &&
+		    (pc->features & CAPISERVER_FEATURE_MULTI) == 0)
+			continue;	/* ignore */
 
-		if (poll(fds, 2, -1) < 0)
-			goto done;
+		if (cmd == CAPISERVER_CMD_CAPI_MSG && pc->batch) {
+			/* the batch header replaces the end of our header */
+			data[-2] = length & 0xFF;
+			data[-1] = length >> 8;
 
-		if (fds[0].revents != 0) {
-			struct iovec iov[2];
+			iov[n].iov_base = data - I4B_CAPI_BATCH_HDR_SIZE;
+			iov[n].iov_len = length + I4B_CAPI_BATCH_HDR_SIZE;
+			total += iov[n].iov_len;
 
-			length = read(parg->capi_fd, buffer, CAPISERVER_BUF_MAX);
-			if (length < 0)
-				goto done;
+			if (++n == CAPISERVER_IOV_MAX) {
+				if (capiserver_capi_writev(pc, iov, n, total))
+					return (-1);
+				total = 0;
+				n = 0;
+			}
+			continue;
+		}
 
-			header[0] = length & 0xFF;
-			header[1] = length >> 8;
-			header[2] = CAPISERVER_CMD_CAPI_MSG;
-			header[3] = 0;
+		if (cmd == CAPISERVER_CMD_CAPI_MULTI && pc->batch) {
+			/* the frame is already in the batch format */
+			if (length == 0)
+				continue;
 
-			iov[0].iov_base = header;
-			iov[0].iov_len = sizeof(header);
+			iov[n].iov_base = data;
+			iov[n].iov_len = length;
+			total += iov[n].iov_len;
 
-			iov[1].iov_base = buffer;
-			iov[1].iov_len = length;
+			if (++n == CAPISERVER_IOV_MAX) {
+				if (capiserver_capi_writev(pc, iov, n, total))
+					return (-1);
+				total = 0;
+				n = 0;
+			}
+			continue;
+		}
+
+		/* keep the order of the messages */
+		if (capiserver_capi_writev(pc, iov, n, total))
+			return (-1);
+		total = 0;
+		n = 0;
 
-			if (writev(parg->tcp_fd, iov, 2) != (ssize_t)(sizeof(header) + length))
-				goto done;
+		switch (cmd) {
+		case CAPISERVER_CMD_CAPI_MSG:
+			if (write(pc->capi_fd, data, length) != (ssize_t)length)
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_REGISTER:
+		case CAPISERVER_CMD_CAPI_REGISTER_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_REGISTER_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_MANUFACTURER:
+		case CAPISERVER_CMD_CAPI_MANUFACTURER_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_GET_MANUFACTURER_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_VERSION:
+		case CAPISERVER_CMD_CAPI_VERSION_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_GET_VERSION_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_SERIAL:
+		case CAPISERVER_CMD_CAPI_SERIAL_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_GET_SERIAL_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_PROFILE:
+		case CAPISERVER_CMD_CAPI_PROFILE_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_GET_PROFILE_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_START:
+		case CAPISERVER_CMD_CAPI_START_ID:
+			if (capiserver_ioctl(pc, cmd,
+			    CAPI_START_D_CHANNEL_REQ, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_HELLO:
+			if (capiserver_hello(pc, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_MULTI:
+			if (capiserver_capi_write_multi(pc, data, length))
+				return (-1);
+			break;
+		case CAPISERVER_CMD_CAPI_DEFLATE:
+			if ((pc->features & CAPISERVER_FEATURE_DEFLATE) == 0)
+				break;	/* ignore */
+			if (capiserver_capi_inflate(pw, pc, data, length))
+				return (-1);
+			break;
+		default:
+			break;
 		}
-		if (fds[1].revents != 0) {
-			if (capiserver_read(parg->tcp_fd, buffer,
-			    CAPISERVER_HDR_SIZE) != CAPISERVER_HDR_SIZE)
-				goto done;
+	}
 
-			length = buffer[0] | (buffer[1] << 8);
-			cmd = buffer[2];
+	if (capiserver_capi_writev(pc, iov, n, total))
+		return (-1);
 
-			if (capiserver_read(parg->tcp_fd, buffer, length) != length)
-				goto done;
+	if (pb->off == pb->len)
+		pb->off = pb->len = 0;
+	else if (capiserver_buf_reserve(pb, need))
+		return (-1);
 
-			switch (cmd) {
-			case CAPISERVER_CMD_CAPI_MSG:
-				if (write(parg->capi_fd, buffer, length) != length)
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_REGISTER:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_REGISTER_REQ, buffer, length))
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_MANUFACTURER:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_GET_MANUFACTURER_REQ, buffer, length))
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_VERSION:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_GET_VERSION_REQ, buffer, length))
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_SERIAL:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_GET_SERIAL_REQ, buffer, length))
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_PROFILE:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_GET_PROFILE_REQ, buffer, length))
-					goto done;
-				break;
-			case CAPISERVER_CMD_CAPI_START:
-				if (capiserver_ioctl(parg->tcp_fd, cmd, parg->capi_fd,
-				    CAPI_START_D_CHANNEL_REQ, buffer, length))
-					goto done;
-				break;
-			default:
+	/* send replies, if any */
+	return (capiserver_tcp_output(pw, pc));
+}
+
+/*
+ * Forward CAPI messages to the TCP connection, until there are
+ * no more messages or until too much data is queued.
+ */
+static int
+capiserver_capi_input(struct capiserver_worker *pw, struct capiserver_conn *pc)
+{
+	uint8_t *data;
+	ssize_t length;
+	uint16_t len;
+
+	while ((pc->tx.len - pc->tx.off) < CAPISERVER_TX_MAX) {
+		data = pw->scratch;
+
+		length = read(pc->capi_fd, data, CAPISERVER_BUF_MAX);
+		if (length < 0) {
+			if (errno == EAGAIN || errno == EINTR)
 				break;
+			return (-1);
+		}
+		if (length == 0)
+			break;
+
+		if (pc->batch == 0) {
+			if (capiserver_tx_capi(pw, pc, data, length))
+				return (-1);
+			continue;
+		}
+		while (length >= I4B_CAPI_BATCH_HDR_SIZE) {
+			len = data[0] | (data[1] << 8);
+			data += I4B_CAPI_BATCH_HDR_SIZE;
+			length -= I4B_CAPI_BATCH_HDR_SIZE;
+
+			if (len > length)
+				return (-1);
+
+			if (capiserver_tx_capi(pw, pc, data, len))
+				return (-1);
+
+			data += len;
+			length -= len;
+		}
+	}
+	capiserver_tx_end(pc);
+
+	return (capiserver_tcp_output(pw, pc));
+}
+
+static void
+capiserver_conn_free(struct capiserver_conn *pc)
+{
+	free(pc->rx.ptr);
+	free(pc->tx.ptr);
+	free(pc);
+}
+
+/*
+ * Each worker thread serves any number of connections, using
+ * non-blocking I/O and a kqueue.
+ */
+static void *
+capiserver_worker(void *arg)
+{
+	struct capiserver_worker *pw = arg;
+	struct kevent ev[CAPISERVER_EV_MAX];
+	struct capiserver_conn *pc;
+	struct capiserver_conn *dead;
+	int error;
+	int n;
+	int x;
+
+	while (1) {
+		n = kevent(pw->kq, NULL, 0, ev, CAPISERVER_EV_MAX, NULL);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			err(EX_SOFTWARE, "kevent");
+		}
+		dead = NULL;
+
+		for (x = 0; x != n; x++) {
+			pc = ev[x].udata;
+
+			/* events may still refer to a closed connection */
+			if (pc->dead)
+				continue;
+
+			if (ev[x].flags & EV_ERROR)
+				error = -1;
+			else if (ev[x].filter == EVFILT_WRITE)
+				error = capiserver_tcp_output(pw, pc);
+			else if (ev[x].ident == (uintptr_t)pc->tcp_fd)
+				error = capiserver_tcp_input(pw, pc);
+			else
+				error = capiserver_capi_input(pw, pc);
+
+			if (error) {
+				/* closing removes the events from the kqueue */
+				close(pc->capi_fd);
+				close(pc->tcp_fd);
+				pc->dead = 1;
+				pc->next_dead = dead;
+				dead = pc;
 			}
 		}
+
+		while ((pc = dead) != NULL) {
+			dead = pc->next_dead;
+			capiserver_conn_free(pc);
+		}
 	}
-done:
-	close(parg->capi_fd);
-	close(parg->tcp_fd);
-	free(parg);
-	free(buffer);
 	return (NULL);
 }
 
+/*
+ * Hand over a new connection to a worker thread.
+ */
+static int
+capiserver_conn_add(struct capiserver_worker *pw, int tcp_fd, int capi_fd)
+{
+	struct capiserver_conn *pc;
+	struct kevent kev[3];
+	int d;
+
+	if (capi_fd < 0)
+		return (-1);
+
+	pc = calloc(1, sizeof(*pc));
+	if (pc == NULL)
+		goto error;
+
+	pc->tcp_fd = tcp_fd;
+	pc->capi_fd = capi_fd;
+
+	d = 1;
+	if (ioctl(pc->capi_fd, FIONBIO, &d) != 0)
+		goto error;
+	d = 1;
+	if (ioctl(pc->tcp_fd, FIONBIO, &d) != 0)
+		goto error;
+
+	/* read and write many messages at a time, if supported */
+	d = 1;
+	pc->batch = (ioctl(pc->capi_fd, I4B_CAPI_SET_BATCH, &d) == 0);
+	pc->capi_rd_on = 1;
+	pc->tcp_wr_on = 0;
+
+	EV_SET(&kev[0], pc->tcp_fd, EVFILT_READ, EV_ADD, 0, 0, pc);
+	EV_SET(&kev[1], pc->tcp_fd, EVFILT_WRITE, EV_ADD | EV_DISABLE, 0, 0, pc);
+	EV_SET(&kev[2], pc->capi_fd, EVFILT_READ, EV_ADD, 0, 0, pc);
+
+	if (kevent(pw->kq, kev, 3, NULL, 0, NULL) != 0)
+		goto error;
+
+	return (0);
+
+error:
+	close(capi_fd);
+	free(pc);
+	return (-1);
+}
+
+/*
+ * Create a worker thread.
+ */
+static struct capiserver_worker *
+capiserver_worker_create(void)
+{
+	struct capiserver_worker *pw;
+
+	pw = malloc(sizeof(*pw));
+	if (pw == NULL)
+		errx(EX_SOFTWARE, "Out of memory");
+	pw->kq = kqueue();
+	if (pw->kq < 0)
+		errx(EX_SOFTWARE, "Cannot create kqueue");
+	if (pthread_create(&pw->thread, NULL, &capiserver_worker, pw) != 0)
+		errx(EX_SOFTWARE, "Cannot create thread");
+	return (pw);
+}
+
+/*
+ * Loopback self test of protocol version 2. A worker thread serves
+ * one connection, where a socket pair replaces the TCP connection
+ * and another one replaces the CAPI device. The CAPI requests fail,
+ * because the socket does not support them, but the answers must
+ * still be framed correctly.
+ */
+#define	CAPISERVER_TEST_MSG_MAX 3000	/* messages from the device */
+#define	CAPISERVER_TEST_MSG_SIZE 512	/* bytes */
+#define	CAPISERVER_TEST_REQ_MAX 4	/* pipelined requests */
+
+static void
+capiserver_test_write(int fd, const void *data, size_t length)
+{
+	if (write(fd, data, length) != (ssize_t)length)
+		err(EX_SOFTWARE, "Self test write failed");
+}
+
+static void
+capiserver_test_read(int fd, void *data, size_t length)
+{
+	uint8_t *ptr = data;
+	ssize_t delta;
+
+	while (length != 0) {
+		delta = read(fd, ptr, length);
+		if (delta <= 0)
+			errx(EX_SOFTWARE, "Self test read failed");
+		ptr += delta;
+		length -= delta;
+	}
+}
+
+static void
+capiserver_test_send(int fd, uint8_t cmd, const void *data, size_t length)
+{
+	uint8_t header[CAPISERVER_HDR_SIZE];
+
+	header[0] = length & 0xFF;
+	header[1] = length >> 8;
+	header[2] = cmd;
+	header[3] = 0;
+
+	capiserver_test_write(fd, header, sizeof(header));
+	capiserver_test_write(fd, data, length);
+}
+
+static size_t
+capiserver_test_recv(int fd, uint8_t *pcmd, uint8_t *perror, uint8_t *data)
+{
+	uint8_t header[CAPISERVER_HDR_SIZE];
+	size_t length;
+
+	capiserver_test_read(fd, header, sizeof(header));
+
+	length = header[0] | (header[1] << 8);
+	*pcmd = header[2];
+	*perror = header[3];
+
+	capiserver_test_read(fd, data, length);
+	return (length);
+}
+
+/*
+ * Build CAPI message number "n". Every third message is a DATA_B3
+ * message with data that compresses well, and every third one is
+ * a DATA_B3 message with pseudo random data, which does not.
+ */
+static size_t
+capiserver_test_msg(uint8_t *data, uint16_t n)
+{
+	uint32_t seed = n;
+	size_t length;
+	size_t x;
+
+	length = ((n % 3) == 2) ? 12 : 22;
+
+	memset(data, 0, length);
+	data[0] = length;
+	data[4] = ((n % 3) == 2) ? 0x05 : CAPISERVER_CAPI_DATA_B3;
+	data[5] = 0x82;
+	data[6] = n & 0xFF;
+	data[7] = n >> 8;
+
+	switch (n % 3) {
+	case 0:
+		for (x = 0; x != (CAPISERVER_DEFLATE_MIN + (n % 256)); x++)
+			data[length++] = x / 16;
+		break;
+	case 1:
+		for (x = 0; x != (CAPISERVER_DEFLATE_MIN + (n % 128)); x++) {
+			seed = (seed * 1103515245U) + 12345U;
+			data[length++] = seed >> 24;
+		}
+		break;
+	default:
+		break;
+	}
+	return (length);
+}
+
+static void *
+capiserver_test_device(void *arg)
+{
+	uint8_t data[CAPISERVER_TEST_MSG_SIZE];
+	int fd = *(int *)arg;
+	uint16_t n;
+
+	for (n = 0; n != CAPISERVER_TEST_MSG_MAX; n++)
+		capiserver_test_write(fd, data, capiserver_test_msg(data, n));
+	return (NULL);
+}
+
+/*
+ * Check the next message received from the server.
+ */
+static void
+capiserver_test_check(uint16_t *pn, const uint8_t *data, size_t length)
+{
+	uint8_t ref[CAPISERVER_TEST_MSG_SIZE];
+
+	if (*pn == CAPISERVER_TEST_MSG_MAX ||
+	    capiserver_test_msg(ref, *pn) != length ||
+	    memcmp(ref, data, length) != 0)
+		errx(EX_SOFTWARE, "Self test message %d is wrong", *pn);
+	(*pn)++;
+}
+
+static int
+capiserver_test(void)
+{
+	static uint8_t data[CAPISERVER_FRAME_MAX];
+	static uint8_t zbuf[CAPISERVER_FRAME_MAX];
+	struct capiserver_worker *pw;
+	struct capiserver_hello hello;
+	pthread_t thread;
+	uint32_t count[256];
+	uint32_t reqid;
+	uLongf zlen;
+	size_t length;
+	size_t mlen;
+	size_t len;
+	uint16_t n;
+	uint8_t error;
+	uint8_t cmd;
+	int tcp[2];
+	int capi[2];
+	int x;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, tcp) != 0 ||
+	    socketpair(AF_UNIX, SOCK_SEQPACKET, 0, capi) != 0)
+		err(EX_SOFTWARE, "Cannot create socket pair");
+
+	/* make the server queue data, like on a slow TCP connection */
+	x = CAPISERVER_BUF_MIN;
+	setsockopt(tcp[0], SOL_SOCKET, SO_SNDBUF, &x, (int)sizeof(x));
+	setsockopt(tcp[1], SOL_SOCKET, SO_RCVBUF, &x, (int)sizeof(x));
+
+	pw = capiserver_worker_create();
+
+	if (capiserver_conn_add(pw, tcp[0], capi[0]) != 0)
+		errx(EX_SOFTWARE, "Cannot add connection");
+
+	/* a request of version 1 may follow HELLO at once */
+	hello.version = htole32(CAPISERVER_VERSION_2);
+	hello.features = htole32(CAPISERVER_FEATURES);
+	capiserver_test_send(tcp[1], CAPISERVER_CMD_HELLO,
+	    &hello, sizeof(hello));
+
+	memset(data, 0, sizeof(data));
+	capiserver_test_send(tcp[1], CAPISERVER_CMD_CAPI_VERSION,
+	    data, IOCPARM_LEN(CAPI_GET_VERSION_REQ));
+
+	length = capiserver_test_recv(tcp[1], &cmd, &error, data);
+	memcpy(&hello, data, sizeof(hello));
+
+	if (cmd != CAPISERVER_CMD_HELLO || length != sizeof(hello) ||
+	    le32toh(hello.version) != CAPISERVER_VERSION_2 ||
+	    le32toh(hello.features) != CAPISERVER_FEATURES)
+		errx(EX_SOFTWARE, "Self test HELLO answer is wrong");
+
+	length = capiserver_test_recv(tcp[1], &cmd, &error, data);
+	if (cmd != CAPISERVER_CMD_CAPI_VERSION ||
+	    (error == 0 && length != IOCPARM_LEN(CAPI_GET_VERSION_REQ)) ||
+	    (error != 0 && length != 0))
+		errx(EX_SOFTWARE, "Self test VERSION answer is wrong");
+
+	/* pipelined requests with request IDs */
+	for (x = 0; x != CAPISERVER_TEST_REQ_MAX; x++) {
+		memset(data, 0, sizeof(data));
+		reqid = htole32(0x49344200 + x);
+		memcpy(data, &reqid, sizeof(reqid));
+		capiserver_test_send(tcp[1], CAPISERVER_CMD_CAPI_PROFILE_ID,
+		    data, CAPISERVER_REQID_SIZE +
+		    IOCPARM_LEN(CAPI_GET_PROFILE_REQ));
+	}
+	for (x = 0; x != CAPISERVER_TEST_REQ_MAX; x++) {
+		length = capiserver_test_recv(tcp[1], &cmd, &error, data);
+		memcpy(&reqid, data, sizeof(reqid));
+
+		if (cmd != CAPISERVER_CMD_CAPI_PROFILE_ID ||
+		    length < CAPISERVER_REQID_SIZE ||
+		    le32toh(reqid) != (uint32_t)(0x49344200 + x) ||
+		    (error == 0 && length != (CAPISERVER_REQID_SIZE +
+		    IOCPARM_LEN(CAPI_GET_PROFILE_REQ))) ||
+		    (error != 0 && length != CAPISERVER_REQID_SIZE))
+			errx(EX_SOFTWARE, "Self test PROFILE answer is wrong");
+	}
+
+	/* messages to the device, in MULTI and DEFLATE frames */
+	length = 0;
+	for (n = 0; n != 3; n++) {
+		len = capiserver_test_msg(data + length +
+		    CAPISERVER_MULTI_HDR_SIZE, n);
+		data[length] = len & 0xFF;
+		data[length + 1] = len >> 8;
+		length += CAPISERVER_MULTI_HDR_SIZE + len;
+	}
+	capiserver_test_send(tcp[1], CAPISERVER_CMD_CAPI_MULTI, data, length);
+
+	length = capiserver_test_msg(data, 3);
+	mlen = data[0];
+	len = length - mlen;
+
+	memcpy(zbuf, data, mlen);
+	zbuf[mlen] = len & 0xFF;
+	zbuf[mlen + 1] = len >> 8;
+	zlen = sizeof(zbuf) - mlen - 2;
+	if (compress2(zbuf + mlen + 2, &zlen, data + mlen, len,
+	    Z_BEST_SPEED) != Z_OK)
+		errx(EX_SOFTWARE, "Self test compress failed");
+	capiserver_test_send(tcp[1], CAPISERVER_CMD_CAPI_DEFLATE,
+	    zbuf, mlen + 2 + zlen);
+
+	for (n = 0; n != 4; ) {
+		length = read(capi[1], zbuf, sizeof(zbuf));
+		if (length > sizeof(zbuf))
+			errx(EX_SOFTWARE, "Self test read failed");
+		capiserver_test_check(&n, zbuf, length);
+	}
+
+	/*
+	 * Messages from the device. They are many more than fit into
+	 * the socket buffers, so that the frames are built while the
+	 * transmit buffer of the server grows and drains.
+	 */
+	if (pthread_create(&thread, NULL, &capiserver_test_device, &capi[1]) != 0)
+		errx(EX_SOFTWARE, "Cannot create thread");
+
+	memset(count, 0, sizeof(count));
+
+	for (n = 0; n != CAPISERVER_TEST_MSG_MAX; ) {
+		length = capiserver_test_recv(tcp[1], &cmd, &error, data);
+		count[cmd]++;
+
+		switch (cmd) {
+		case CAPISERVER_CMD_CAPI_MSG:
+			capiserver_test_check(&n, data, length);
+			break;
+		case CAPISERVER_CMD_CAPI_MULTI:
+			while (length >= CAPISERVER_MULTI_HDR_SIZE) {
+				len = data[0] | (data[1] << 8);
+				if (len > (length - CAPISERVER_MULTI_HDR_SIZE))
+					errx(EX_SOFTWARE, "Self test MULTI frame is wrong");
+				capiserver_test_check(&n,
+				    data + CAPISERVER_MULTI_HDR_SIZE, len);
+				memmove(data, data + CAPISERVER_MULTI_HDR_SIZE + len,
+				    length - CAPISERVER_MULTI_HDR_SIZE - len);
+				length -= CAPISERVER_MULTI_HDR_SIZE + len;
+			}
+			if (length != 0)
+				errx(EX_SOFTWARE, "Self test MULTI frame is wrong");
+			break;
+		case CAPISERVER_CMD_CAPI_DEFLATE:
+			mlen = data[0] | (data[1] << 8);
+			if (mlen < CAPISERVER_CAPI_HDR_SIZE || (mlen + 2) > length)
+				errx(EX_SOFTWARE, "Self test DEFLATE frame is wrong");
+			len = data[mlen] | (data[mlen + 1] << 8);
+			memcpy(zbuf, data, mlen);
+			zlen = sizeof(zbuf) - mlen;
+			if (uncompress(zbuf + mlen, &zlen, data + mlen + 2,
+			    length - mlen - 2) != Z_OK || zlen != len)
+				errx(EX_SOFTWARE, "Self test DEFLATE frame is wrong");
+			capiserver_test_check(&n, zbuf, mlen + len);
+			break;
+		default:
+			errx(EX_SOFTWARE, "Self test frame %d is unexpected", cmd);
+		}
+	}
+	pthread_join(thread, NULL);
+
+	if (count[CAPISERVER_CMD_CAPI_MULTI] == 0 ||
+	    count[CAPISERVER_CMD_CAPI_DEFLATE] == 0)
+		errx(EX_SOFTWARE, "Self test did not use all features");
+
+	printf("Self test passed: %d MULTI, %d DEFLATE and %d CAPI_MSG "
+	    "frames for %d messages\n",
+	    (int)count[CAPISERVER_CMD_CAPI_MULTI],
+	    (int)count[CAPISERVER_CMD_CAPI_DEFLATE],
+	    (int)count[CAPISERVER_CMD_CAPI_MSG], CAPISERVER_TEST_MSG_MAX);
+	return (0);
+}
+
 static void
 capiserver_usage(void)
 {
 	fprintf(stderr,
 	    "\n"
 	    "\n" "capiserver - CAPI server, version %d.%02d, compiled %s %s"
-	    "\n" "usage: capiserver [-B] [-b 127.0.0.1] [-p 2663] [-h]"
+	    "\n" "usage: capiserver [-B] [-b 127.0.0.1] [-p 2663] [-t 1] [-T] [-h]"
 	    "\n" "       -B            run in background"
 	    "\n" "       -b <addr>     bind address"
 	    "\n" "       -p <port>     bind port"
+	    "\n" "       -t <num>      number of worker threads"
+	    "\n" "       -T            run protocol self test and exit"
 	    "\n" "       -h            show usage"
 	    "\n"
 	    ,CAPI_STACK_VERSION / 100, CAPI_STACK_VERSION % 100,
@@ -376,16 +1277,18 @@ do_pidfile(void)
 int
 main(int argc, char **argv)
 {
-	const char *params = "Bb:p:h";
+	const char *params = "Bb:p:t:Th";
 	const char *host = "127.0.0.1";
 	const char *port = "2663";
+	struct capiserver_worker *pw[CAPISERVER_THREAD_MAX];
 	int do_fork = 0;
+	int nthread = 1;
 	int opt;
 	int ns;
 	int s[CAPISERVER_SOCK_MAX];
 	int f;
 	int c;
-	int d;
+	int w;
 
 	atexit(&do_exit);
 
@@ -400,6 +1303,15 @@ main(int argc, char **argv)
 		case 'B':
 			do_fork = 1;
 			break;
+		case 't':
+			nthread = atoi(optarg);
+			if (nthread < 1 || nthread > CAPISERVER_THREAD_MAX) {
+				errx(EX_USAGE, "Number of threads must be "
+				    "from 1 to %d", CAPISERVER_THREAD_MAX);
+			}
+			break;
+		case 'T':
+			return (capiserver_test());
 		default:
 			capiserver_usage();
 			return (EX_USAGE);
@@ -420,10 +1332,12 @@ main(int argc, char **argv)
 		errx(EX_SOFTWARE, "Could not bind to "
 		    "'%s' and '%s'\n", host, port);
 	}
+	for (w = 0; w != nthread; w++)
+		pw[w] = capiserver_worker_create();
+	w = 0;
+
 	while (1) {
 		struct pollfd fds[ns];
-		struct capiserver_arg *parg;
-		pthread_t dummy;
 
 		for (c = 0; c != ns; c++) {
 			fds[c].fd = s[c];
@@ -445,36 +1359,13 @@ main(int argc, char **argv)
 		if (f < 0)
 			break;
 
-		parg = malloc(sizeof(*parg));
-		if (parg == NULL) {
+		/* distribute the connections evenly */
+		if (capiserver_conn_add(pw[w], f,
+		    open(CAPI_DEVICE_NAME, O_RDWR)) != 0)
 			close(f);
-			continue;
-		}
-		c = open(CAPI_DEVICE_NAME, O_RDWR);
-		if (c < 0) {
-			close(f);
-			continue;
-		}
-		d = 0;
-		if (ioctl(c, FIONBIO, &d) != 0) {
-			close(c);
-			close(f);
-			continue;
-		}
-		d = 0;
-		if (ioctl(f, FIONBIO, &d) != 0) {
-			close(c);
-			close(f);
-			continue;
-		}
-		parg->capi_fd = c;
-		parg->tcp_fd = f;
 
-		if (pthread_create(&dummy, NULL, &capiserver, parg) != 0) {
-			free(parg);
-			close(c);
-			close(f);
-		}
+		if (++w == nthread)
+			w = 0;
 	}
 	return (0);
 }
@@ -0,0 +1,86 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * This file is the global include file used when the kernel echo
+ * canceller is compiled for userland. It provides the few kernel
+ * definitions needed by the I4B header files.
+ */
+
+#ifndef _ECTEST_H_
+#define	_ECTEST_H_
+
+#include <sys/cdefs.h>
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+/* not defined by all C libraries */
+#ifndef __unused
+#define	__unused __attribute__((__unused__))
+#endif
+
+struct mtx {
+	int	unused;
+};
+
+struct sx {
+	int	unused;
+};
+
+struct callout {
+	int	unused;
+};
+
+struct mbuf {
+	struct mbuf *m_next;
+	struct mbuf *m_nextpkt;
+	uint8_t *m_data;
+	int	m_len;
+};
+
+extern void m_freem(struct mbuf *);
+
+#define	DO_I4B_DEBUG 0
+
+#ifdef I4B_ECHO_CANCEL_SIMD
+/* select the vectorized FFT passes at startup, like the kernel does */
+#define	SYSINIT(name, sub, order, func, arg)			\
+static void __attribute__((__constructor__)) name##_ctor(void)	\
+{								\
+	func(arg);						\
+}
+#define	bootverbose 0
+#define	fpu_kern_enter(td, ctx, flags) do { } while (0)
+#define	fpu_kern_leave(td, ctx) do { } while (0)
+#if defined(__amd64__) || defined(__i386__)
+#define	I4B_ECHO_CANCEL_HAVE_AVX2() __builtin_cpu_supports("avx2")
+#endif
+#endif
+
+#endif					/* _ECTEST_H_ */
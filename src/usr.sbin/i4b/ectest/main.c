@@ -0,0 +1,458 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * ectest - run the kernel echo canceller in userland and measure
+ * how well it cancels and how long each call takes
+ */
+
+#include "ectest.h"
+
+#include <err.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <i4b/include/i4b_debug.h>
+#include <i4b/include/i4b_ioctl.h>
+#include <i4b/include/i4b_global.h>
+
+#include <i4b/layer1/i4b_echo_cancel.h>
+
+struct i4b_debug_mask i4b_debug_mask;
+
+struct ectest_stats {
+	uint64_t sum_ns;
+	uint64_t samples;
+	uint32_t *call_ns;
+	uint32_t calls;
+	uint32_t max_calls;
+};
+
+/* the ERLE is measured in windows of 100ms */
+#define	ECTEST_WINDOW 800		/* samples */
+
+struct ectest_erle {
+	double	win_in;
+	double	win_out;
+	double	sum_in;
+	double	sum_out;
+	uint64_t samples;
+	uint64_t converged;		/* sample offset */
+	uint16_t win_samples;
+};
+
+static struct i4b_echo_cancel ec;
+static struct i4b_echo_cancel_scratch ec_scratch;
+static struct i4b_echo_cancel_part ec_part;
+
+static uint32_t blocks = 10000;
+static uint16_t block_len = 160;
+static uint16_t pre_delay;
+static uint8_t use_ulaw;
+static uint8_t simd_compare;
+static uint8_t ec_mode = I4B_ECHO_CANCEL_MODE_BLOCK;
+static double threshold = 20.0;
+static FILE *far_file;
+static FILE *near_file;
+static FILE *out_file;
+
+/*---------------------------------------------------------------------------*
+ *	usage display and exit
+ *---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "\n" "ectest - echo canceller test, compiled %s %s"
+	    "\n" "usage: ectest [-n blocks] [-b bytes] [-d samples] [-m mode] [-u]"
+	    "\n" "              [-e dB] [-f far_file -r near_file [-o out_file]]"
+	    "\n" "       ectest -s [-n blocks]"
+	    "\n" "       -n <blocks>   maximum number of blocks to process (default 10000)"
+	    "\n" "       -b <bytes>    number of samples per block (default 160)"
+	    "\n" "       -d <samples>  pre-delay of the echo canceller (default 0)"
+	    "\n" "       -m <mode>     0: block mode (default), 1: partitioned mode"
+	    "\n" "       -u            use u-law instead of A-law"
+	    "\n" "       -e <dB>       ERLE needed to be converged (default 20)"
+	    "\n" "       -f <file>     raw A-law or u-law samples sent to the far end"
+	    "\n" "       -r <file>     raw A-law or u-law samples from the near end"
+	    "\n" "       -o <file>     store near end samples without echo"
+	    "\n" "       -s            compare the vectorized and the scalar FFT"
+	    "\n"
+	    "\n", __DATE__, __TIME__);
+
+	exit(1);
+}
+
+void
+m_freem(struct mbuf *m __unused)
+{
+	/* not used */
+}
+
+static uint64_t
+ectest_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void
+ectest_stats_init(struct ectest_stats *ps)
+{
+	memset(ps, 0, sizeof(*ps));
+
+	ps->max_calls = blocks;
+	ps->call_ns = malloc(sizeof(ps->call_ns[0]) * blocks);
+	if (ps->call_ns == NULL)
+		errx(1, "Out of memory");
+}
+
+static void
+ectest_stats_update(struct ectest_stats *ps, uint64_t t0, uint16_t len)
+{
+	uint64_t delta = ectest_time_ns() - t0;
+
+	if (delta > 0xFFFFFFFFULL)
+		delta = 0xFFFFFFFFULL;
+
+	ps->sum_ns += delta;
+	ps->samples += len;
+
+	if (ps->calls != ps->max_calls)
+		ps->call_ns[ps->calls++] = delta;
+}
+
+static int
+ectest_compare(const void *pa, const void *pb)
+{
+	uint32_t a = *(const uint32_t *)pa;
+	uint32_t b = *(const uint32_t *)pb;
+
+	return ((a > b) - (a < b));
+}
+
+/*
+ * The worst case is printed together with some percentiles,
+ * because single calls may be delayed by the operating system.
+ */
+static void
+ectest_stats_print(const char *name, struct ectest_stats *ps)
+{
+	uint32_t n = ps->calls;
+
+	if (n == 0)
+		return;
+
+	qsort(ps->call_ns, n, sizeof(ps->call_ns[0]), &ectest_compare);
+
+	printf("%-8s calls=%u avg=%.1fns/sample per call: "
+	    "50%%=%.2fus 99.9%%=%.2fus 99.99%%=%.2fus max=%.2fus\n",
+	    name, n, (double)ps->sum_ns / (double)ps->samples,
+	    ps->call_ns[(n * 5000ULL) / 10000] / 1000.0,
+	    ps->call_ns[(n * 9990ULL) / 10000] / 1000.0,
+	    ps->call_ns[(n * 9999ULL) / 10000] / 1000.0,
+	    ps->call_ns[n - 1] / 1000.0);
+
+	free(ps->call_ns);
+	ps->call_ns = NULL;
+}
+
+/*---------------------------------------------------------------------------*
+ *	accumulate the echo return loss enhancement, ERLE
+ *
+ * The echo canceller is considered converged at the start of the
+ * first window after which the ERLE never drops below the threshold.
+ *---------------------------------------------------------------------------*/
+static void
+ectest_erle_update(struct ectest_erle *pe, const int16_t *convert_fwd,
+    const uint8_t *in, const uint8_t *out, uint16_t len)
+{
+	double a;
+	double b;
+
+	while (len--) {
+		a = convert_fwd[*in++];
+		b = convert_fwd[*out++];
+
+		pe->win_in += a * a;
+		pe->win_out += b * b;
+		pe->samples++;
+
+		if (++(pe->win_samples) != ECTEST_WINDOW)
+			continue;
+
+		/* don't count windows without echo */
+		if (pe->win_in >= (ECTEST_WINDOW * 16.0)) {
+			if (pe->win_in < pe->win_out * pow(10.0, threshold / 10.0))
+				pe->converged = pe->samples;
+		}
+
+		pe->sum_in += pe->win_in;
+		pe->sum_out += pe->win_out;
+		pe->win_in = 0;
+		pe->win_out = 0;
+		pe->win_samples = 0;
+	}
+}
+
+static void
+ectest_erle_print(struct ectest_erle *pe)
+{
+	if (pe->sum_out == 0.0 || pe->sum_in == 0.0) {
+		printf("ERLE     not enough samples\n");
+		return;
+	}
+
+	printf("ERLE     total=%.1fdB", 10.0 * log10(pe->sum_in / pe->sum_out));
+
+	if (pe->converged == pe->samples - pe->win_samples)
+		printf(" not converged (%.1fdB)\n", threshold);
+	else
+		printf(" converged after %.2fs (%.1fdB)\n",
+		    pe->converged / 8000.0, threshold);
+}
+
+/*---------------------------------------------------------------------------*
+ *	simple random number generator, to get the same signal every time
+ *---------------------------------------------------------------------------*/
+static int16_t
+ectest_noise(uint32_t *pseed)
+{
+	*pseed = (*pseed * 1103515245U) + 12345U;
+
+	return ((int16_t)(*pseed >> 16) / 4);
+}
+
+/*---------------------------------------------------------------------------*
+ *	compare the vectorized and the scalar FFT, which must be bit-exact
+ *
+ * Each block is transformed forward or inverse, alternately, using
+ * noise of increasing amplitude as input. Returns non-zero if any
+ * output value differs.
+ *---------------------------------------------------------------------------*/
+static int
+ectest_simd_compare(void)
+{
+#ifdef I4B_ECHO_CANCEL_SIMD
+	static struct i4b_complex a[I4B_ECHO_CANCEL_N_COMPLEX];
+	static struct i4b_complex b[I4B_ECHO_CANCEL_N_COMPLEX];
+	uint32_t seed = 1;
+	uint32_t diff = 0;
+	uint32_t n;
+	uint16_t x;
+
+	if (i4b_echo_cancel_simd_name == NULL) {
+		printf("simd     not supported by this CPU\n");
+		return (0);
+	}
+
+	for (n = 0; n != blocks; n++) {
+		for (x = 0; x != I4B_ECHO_CANCEL_N_COMPLEX; x++) {
+			a[x].x = (int32_t)ectest_noise(&seed) * (1 << (n % 12));
+			a[x].y = (int32_t)ectest_noise(&seed) * (1 << (n % 12));
+		}
+		memcpy(b, a, sizeof(b));
+
+		diff += i4b_echo_cancel_simd_compare(a, b, n & 1);
+	}
+
+	printf("simd     %s N_COMPLEX=%u blocks=%u mismatches=%u\n",
+	    i4b_echo_cancel_simd_name, I4B_ECHO_CANCEL_N_COMPLEX,
+	    blocks, diff);
+
+	return (diff != 0);
+#else
+	errx(1, "Compiled without I4B_ECHO_CANCEL_SIMD");
+#endif
+}
+
+int
+main(int argc, char **argv)
+{
+	struct ectest_stats st_feed;
+	struct ectest_stats st_merge;
+	struct ectest_erle erle;
+	i4b_convert_rev_t *convert_rev;
+	const int16_t *convert_fwd;
+	uint8_t *tx_buf;
+	uint8_t *rx_buf;
+	uint8_t *in_buf;
+	int16_t hist[64];
+	uint32_t seed = 1;
+	uint32_t n;
+	uint16_t x;
+	uint16_t y;
+	uint64_t t0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:b:d:m:ue:f:r:o:s")) != -1) {
+		switch (c) {
+		case 'n':
+			blocks = atoi(optarg);
+			break;
+		case 'b':
+			block_len = atoi(optarg);
+			if (block_len == 0)
+				usage();
+			break;
+		case 'd':
+			pre_delay = atoi(optarg);
+			break;
+		case 'm':
+			ec_mode = atoi(optarg);
+			break;
+		case 'u':
+			use_ulaw = 1;
+			break;
+		case 'e':
+			threshold = atof(optarg);
+			break;
+		case 'f':
+			far_file = fopen(optarg, "rb");
+			if (far_file == NULL)
+				err(1, "Cannot open '%s'", optarg);
+			break;
+		case 'r':
+			near_file = fopen(optarg, "rb");
+			if (near_file == NULL)
+				err(1, "Cannot open '%s'", optarg);
+			break;
+		case 'o':
+			out_file = fopen(optarg, "wb");
+			if (out_file == NULL)
+				err(1, "Cannot open '%s'", optarg);
+			break;
+		case 's':
+			simd_compare = 1;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if ((far_file == NULL) != (near_file == NULL))
+		usage();
+
+	if (simd_compare)
+		return (ectest_simd_compare());
+
+	tx_buf = malloc(block_len);
+	rx_buf = malloc(block_len);
+	in_buf = malloc(block_len);
+
+	if (tx_buf == NULL || rx_buf == NULL || in_buf == NULL)
+		errx(1, "Out of memory");
+
+	convert_rev = use_ulaw ? i4b_signed_to_ulaw : i4b_signed_to_alaw;
+	convert_fwd = use_ulaw ? i4b_ulaw_to_signed : i4b_alaw_to_signed;
+
+	ectest_stats_init(&st_feed);
+	ectest_stats_init(&st_merge);
+	memset(&erle, 0, sizeof(erle));
+	memset(hist, 0, sizeof(hist));
+
+	i4b_echo_cancel_init(&ec, &ec_scratch, pre_delay,
+	    use_ulaw ? BSUBPROT_G711_ULAW : BSUBPROT_G711_ALAW);
+	i4b_echo_cancel_set_mode(&ec, ec_mode, &ec_part);
+
+	printf("ectest   N_COMPLEX=%u N_TAPS=%u mode=%s block=%u\n",
+	    I4B_ECHO_CANCEL_N_COMPLEX, I4B_ECHO_CANCEL_N_TAPS,
+	    (ec.mode == I4B_ECHO_CANCEL_MODE_PART) ? "partitioned" : "block",
+	    block_len);
+
+	for (n = 0; n != blocks; n++) {
+
+		if (far_file != NULL) {
+			/* the files contain samples in normal bit order */
+			if (fread(tx_buf, 1, block_len, far_file) != block_len ||
+			    fread(rx_buf, 1, block_len, near_file) != block_len)
+				break;
+
+			for (x = 0; x != block_len; x++) {
+				tx_buf[x] = i4b_reverse_bits[tx_buf[x]];
+				rx_buf[x] = i4b_reverse_bits[rx_buf[x]];
+			}
+		} else {
+			/*
+			 * The echo is the transmitted signal delayed by 20
+			 * and 25 samples, plus a little noise:
+			 */
+			for (x = 0; x != block_len; x++) {
+				for (y = 63; y != 0; y--)
+					hist[y] = hist[y - 1];
+
+				hist[0] = ectest_noise(&seed);
+
+				tx_buf[x] = convert_rev(hist[0]);
+				rx_buf[x] = convert_rev((hist[20] / 3) -
+				    (hist[25] / 5) + (ectest_noise(&seed) / 256));
+			}
+		}
+
+		memcpy(in_buf, rx_buf, block_len);
+
+		t0 = ectest_time_ns();
+		i4b_echo_cancel_feed(&ec, tx_buf, block_len);
+		i4b_echo_cancel_update_feeder(&ec, block_len);
+		ectest_stats_update(&st_feed, t0, block_len);
+
+		t0 = ectest_time_ns();
+		i4b_echo_cancel_update_merger(&ec, 0);
+		i4b_echo_cancel_merge(&ec, rx_buf, block_len);
+		ectest_stats_update(&st_merge, t0, block_len);
+
+		ectest_erle_update(&erle, convert_fwd, in_buf, rx_buf, block_len);
+
+		if (out_file != NULL) {
+			for (x = 0; x != block_len; x++)
+				rx_buf[x] = i4b_reverse_bits[rx_buf[x]];
+
+			if (fwrite(rx_buf, 1, block_len, out_file) != block_len)
+				err(1, "Cannot write output file");
+		}
+	}
+
+	ectest_stats_print("feed", &st_feed);
+	ectest_stats_print("merge", &st_merge);
+	ectest_erle_print(&erle);
+
+	if (far_file != NULL)
+		fclose(far_file);
+	if (near_file != NULL)
+		fclose(near_file);
+	if (out_file != NULL)
+		fclose(out_file);
+
+	free(tx_buf);
+	free(rx_buf);
+	free(in_buf);
+
+	return (0);
+}
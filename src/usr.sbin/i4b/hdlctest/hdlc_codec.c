@@ -0,0 +1,238 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hdlc_codec - wrappers around the HDLC_ENCODE() and HDLC_DECODE()
+ * macros of the kernel, which keep the state between calls like the
+ * software HDLC filters of the ihfc driver
+ */
+
+#include "hdlctest.h"
+
+#include <errno.h>
+
+#include <i4b/layer1/i4b_hdlc.h>
+
+#include "hdlc_codec.h"
+
+/*---------------------------------------------------------------------------*
+ *	HDLC encoder
+ *---------------------------------------------------------------------------*/
+void
+hdlc_encoder_init(struct hdlc_encoder *enc, uint8_t type,
+    hdlc_codec_get_t *get_frame, void *arg)
+{
+	memset(enc, 0, sizeof(*enc));
+
+	enc->type = type;
+	enc->get_frame = get_frame;
+	enc->arg = arg;
+}
+
+/*
+ * The encoder stops after the final flag sequence when there are no
+ * more frames and sets "idle". The number of bytes written is
+ * returned. The hardware would repeat the last byte.
+ */
+#define	HDLC_CODEC_ENCODE_FUNC(name)					\
+static uint32_t								\
+name(struct hdlc_encoder *enc, uint8_t *dst, uint32_t len)		\
+{									\
+	uint8_t *dst_start = dst;					\
+	uint8_t *dst_end = dst + len;					\
+	const uint8_t *src;						\
+	const uint8_t *ptr;						\
+	uint32_t tmp;							\
+	uint32_t tmp2;							\
+	uint16_t blevel;						\
+	uint16_t crc;							\
+	uint16_t ib;							\
+	uint16_t rem;							\
+	uint16_t n;							\
+									\
+	/* restore HDLC variables */					\
+	tmp = enc->st.tmp;						\
+	blevel = enc->st.blevel;					\
+	crc = enc->st.crc;						\
+	ib = enc->st.ib;						\
+	src = enc->src;							\
+	rem = enc->len;							\
+	enc->idle = 0;							\
+									\
+	while (dst != dst_end) {					\
+		HDLC_ENCODE(*src++, rem, tmp, tmp2, blevel, ib, crc,	\
+		    (enc->st.flag),					\
+		{/* gfr */						\
+			if (enc->get_frame(enc->arg, &ptr, &n)) {	\
+				src = ptr;				\
+				rem = n;				\
+			} else {					\
+				/* exit after final flag sequence */	\
+				dst_end = dst + 1;			\
+				enc->idle = 1;				\
+			}						\
+		},							\
+		{/* nmb */						\
+		},							\
+		{/* wrd */						\
+			*dst++ = (uint8_t)(tmp);			\
+		},							\
+		d);							\
+	}								\
+									\
+	/* suspend HDLC variables */					\
+	enc->st.tmp = tmp;						\
+	enc->st.blevel = blevel;					\
+	enc->st.crc = crc;						\
+	enc->st.ib = ib;						\
+	enc->src = src;							\
+	enc->len = rem;							\
+									\
+	return (dst - dst_start);					\
+}
+
+HDLC_CODEC_ENCODE_FUNC(hdlc_encode_b)
+
+#undef HDLC_ENCODE_TYPE
+#define	HDLC_ENCODE_TYPE(default,dchan) R dchan
+
+HDLC_CODEC_ENCODE_FUNC(hdlc_encode_d)
+
+uint32_t
+hdlc_encode(struct hdlc_encoder *enc, uint8_t *dst, uint32_t len)
+{
+	if (enc->type == HDLC_CODEC_D_CHANNEL)
+		return (hdlc_encode_d(enc, dst, len));
+	else
+		return (hdlc_encode_b(enc, dst, len));
+}
+
+/*
+ * Abort the current frame, if any. The encoder will send two or more
+ * abort bytes before the next frame.
+ */
+void
+hdlc_encode_abort(struct hdlc_encoder *enc)
+{
+	enc->st.flag = -2;
+	enc->len = 0;
+}
+
+/*---------------------------------------------------------------------------*
+ *	HDLC decoder
+ *---------------------------------------------------------------------------*/
+int
+hdlc_decoder_init(struct hdlc_decoder *dec, uint16_t max,
+    hdlc_codec_put_t *put_frame, void *arg)
+{
+	memset(dec, 0, sizeof(*dec));
+
+	dec->buf = malloc(max);
+	if (dec->buf == NULL)
+		return (ENOMEM);
+
+	dec->max = max;
+	dec->put_frame = put_frame;
+	dec->arg = arg;
+	return (0);
+}
+
+void
+hdlc_decoder_free(struct hdlc_decoder *dec)
+{
+	free(dec->buf);
+	dec->buf = NULL;
+}
+
+void
+hdlc_decode(struct hdlc_decoder *dec, const uint8_t *src, uint32_t len)
+{
+	const uint8_t *src_end = src + len;
+	uint8_t *dst;
+	uint16_t tmp;
+	uint16_t tmp2;
+	uint16_t crc;
+	uint16_t ib;
+	uint16_t rem;
+	uint8_t blevel;
+	int n;
+
+	/* restore HDLC variables */
+	tmp = dec->st.tmp;
+	blevel = dec->st.blevel;
+	crc = dec->st.crc;
+	ib = dec->st.ib;
+	rem = dec->len;
+	dst = dec->buf + (dec->max - rem);
+
+	while (src != src_end) {
+		if (dec->st.flag < 2 && dec->no_idle == 0) {
+			/* skip idle bytes between frames */
+			src += i4b_hdlc_idle(src, src_end - src, tmp, blevel,
+			    ib, dec->st.flag);
+
+			if (src == src_end)
+				break;
+		}
+
+		HDLC_DECODE(*dst++, rem, tmp, tmp2, blevel, ib, crc,
+		    (dec->st.flag),
+		{/* rdd */
+			tmp2 = *src++;
+		},
+		{/* nfr */
+			dst = dec->buf;
+			rem = dec->max;
+		},
+		{/* cfr */
+			n = (int)dec->max - (int)rem;
+
+			if (n <= 0)
+				dec->put_frame(dec->arg, HDLC_CODEC_SHORT,
+				    NULL, 0);
+			else if (crc)
+				dec->put_frame(dec->arg, HDLC_CODEC_CRC,
+				    dec->buf, n);
+			else
+				dec->put_frame(dec->arg, HDLC_CODEC_FRAME,
+				    dec->buf, n);
+		},
+		{/* rab */
+			dec->put_frame(dec->arg, HDLC_CODEC_ABORT, NULL, 0);
+		},
+		{/* rdo */
+			dec->put_frame(dec->arg, HDLC_CODEC_OVERFLOW, NULL, 0);
+		},
+		continue,
+		d);
+	}
+
+	/* suspend HDLC variables */
+	dec->st.tmp = tmp;
+	dec->st.blevel = blevel;
+	dec->st.crc = crc;
+	dec->st.ib = ib;
+	dec->len = rem;
+}
@@ -0,0 +1,103 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hdlc_codec - the software HDLC encoder and decoder of the kernel,
+ * packaged as a small userland library
+ */
+
+#ifndef _HDLC_CODEC_H_
+#define	_HDLC_CODEC_H_
+
+/* encoder types, see HDLC_ENCODE_TYPE() */
+#define	HDLC_CODEC_B_CHANNEL	0	/* shared flags between frames */
+#define	HDLC_CODEC_D_CHANNEL	1	/* idle bytes between frames */
+
+/* decoder events */
+#define	HDLC_CODEC_FRAME	0	/* complete frame */
+#define	HDLC_CODEC_CRC		1	/* complete frame with CRC error */
+#define	HDLC_CODEC_SHORT	2	/* frame without any data */
+#define	HDLC_CODEC_ABORT	3	/* abort sequence */
+#define	HDLC_CODEC_OVERFLOW	4	/* frame longer than the buffer */
+#define	HDLC_CODEC_EVENT_MAX	5
+
+/*
+ * The "get" callback should set "*pptr" and "*plen" to the next frame
+ * to encode and return non-zero, or return zero if there is no frame.
+ * The frame must stay valid until the next frame is requested.
+ */
+typedef int (hdlc_codec_get_t)(void *arg, const uint8_t **pptr,
+    uint16_t *plen);
+
+/*
+ * The "put" callback is called for every decoder event. "ptr" and
+ * "len" give the frame data, without the CRC bytes, for the
+ * HDLC_CODEC_FRAME and HDLC_CODEC_CRC events.
+ */
+typedef void (hdlc_codec_put_t)(void *arg, uint8_t event,
+    const uint8_t *ptr, uint16_t len);
+
+/* same as "struct hdlc" of the ihfc driver */
+struct hdlc_codec_state {
+	uint32_t tmp;
+	uint16_t blevel;
+	uint16_t crc;
+	uint16_t ib;
+	uint8_t	flag;
+};
+
+struct hdlc_encoder {
+	struct hdlc_codec_state st;
+	hdlc_codec_get_t *get_frame;
+	void   *arg;
+	const uint8_t *src;
+	uint16_t len;
+	uint8_t	type;
+	uint8_t	idle;			/* no frame at the last call */
+};
+
+struct hdlc_decoder {
+	struct hdlc_codec_state st;
+	hdlc_codec_put_t *put_frame;
+	void   *arg;
+	uint8_t *buf;
+	uint16_t max;
+	uint16_t len;			/* remaining buffer length */
+	uint8_t	no_idle;		/* don't skip idle bytes */
+};
+
+extern void hdlc_encoder_init(struct hdlc_encoder *, uint8_t type,
+    hdlc_codec_get_t *, void *arg);
+extern uint32_t hdlc_encode(struct hdlc_encoder *, uint8_t *dst,
+    uint32_t len);
+extern void hdlc_encode_abort(struct hdlc_encoder *);
+
+extern int hdlc_decoder_init(struct hdlc_decoder *, uint16_t max,
+    hdlc_codec_put_t *, void *arg);
+extern void hdlc_decoder_free(struct hdlc_decoder *);
+extern void hdlc_decode(struct hdlc_decoder *, const uint8_t *src,
+    uint32_t len);
+
+#endif					/* _HDLC_CODEC_H_ */
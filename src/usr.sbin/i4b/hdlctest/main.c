@@ -0,0 +1,666 @@
+/*-
+ * Copyright (c) 2026 agent. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * hdlctest - run the kernel software HDLC encoder and decoder in
+ * userland, verify that skipping idle bytes does not change the
+ * decoder output and measure their throughput
+ */
+
+#include "hdlctest.h"
+
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hdlc_codec.h"
+
+struct hdlctest_frames {
+	uint8_t *data;
+	uint32_t *offset;		/* "num + 1" offsets into "data" */
+	uint32_t *hash;
+	uint32_t num;
+	uint32_t next;			/* next frame to encode */
+	uint32_t seed;
+	double	idle_rate;
+};
+
+struct hdlctest_event {
+	uint32_t hash;
+	uint16_t len;
+	uint8_t	event;
+};
+
+struct hdlctest_log {
+	struct hdlctest_event *ev;
+	uint32_t num;
+	uint32_t max;
+	uint32_t count[HDLC_CODEC_EVENT_MAX];
+};
+
+static const char *event_name[HDLC_CODEC_EVENT_MAX] = {
+	[HDLC_CODEC_FRAME] = "frame",
+	[HDLC_CODEC_CRC] = "crc",
+	[HDLC_CODEC_SHORT] = "short",
+	[HDLC_CODEC_ABORT] = "abort",
+	[HDLC_CODEC_OVERFLOW] = "overflow",
+};
+
+static uint32_t num_frames = 100000;
+static uint16_t max_frame = 260;
+static uint32_t block_len = 32;
+static uint32_t repeat = 10;
+static uint32_t seed = 1;
+static uint8_t channel_type = HDLC_CODEC_B_CHANNEL;
+static double bit_error_rate = 0.00001;
+static double abort_rate = 0.001;
+static double idle_rate = 0.1;
+
+/*---------------------------------------------------------------------------*
+ *	usage display and exit
+ *---------------------------------------------------------------------------*/
+static void
+usage(void)
+{
+	fprintf(stderr,
+	    "\n" "hdlctest - software HDLC test, compiled %s %s"
+	    "\n" "usage: hdlctest [-n frames] [-m bytes] [-b bytes] [-r count]"
+	    "\n" "                [-s seed] [-e rate] [-a rate] [-i rate] [-d]"
+	    "\n" "       -n <frames>   number of random frames (default 100000)"
+	    "\n" "       -m <bytes>    maximum frame length (default 260)"
+	    "\n" "       -b <bytes>    bytes per encoder or decoder call (default 32)"
+	    "\n" "       -r <count>    number of benchmark runs (default 10)"
+	    "\n" "       -s <seed>     seed of the random generator (default 1)"
+	    "\n" "       -e <rate>     bit error rate (default 0.00001)"
+	    "\n" "       -a <rate>     abort rate per encoder call (default 0.001)"
+	    "\n" "       -i <rate>     idle rate between frames (default 0.1)"
+	    "\n" "       -d            use D-channel instead of B-channel encoding"
+	    "\n"
+	    "\n", __DATE__, __TIME__);
+
+	exit(1);
+}
+
+static uint64_t
+hdlctest_time_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+/*---------------------------------------------------------------------------*
+ *	simple random number generator, to get the same stream every time
+ *---------------------------------------------------------------------------*/
+static uint32_t
+hdlctest_random(uint32_t *pseed)
+{
+	*pseed = (*pseed * 1103515245U) + 12345U;
+
+	return (*pseed >> 8);
+}
+
+static double
+hdlctest_random_rate(uint32_t *pseed)
+{
+	return (hdlctest_random(pseed) / 16777216.0);
+}
+
+static uint32_t
+hdlctest_hash(uint32_t hash, const uint8_t *ptr, uint32_t len)
+{
+	while (len--)
+		hash = (hash ^ *ptr++) * 16777619U;
+
+	return (hash);
+}
+
+/*---------------------------------------------------------------------------*
+ *	generate random frames
+ *
+ * Every fourth byte is 0x7e, 0xff, 0x3f or 0x1f, so that there are
+ * enough bits to stuff.
+ *---------------------------------------------------------------------------*/
+static void
+hdlctest_frames_init(struct hdlctest_frames *pf)
+{
+	static const uint8_t special[4] = {0x7e, 0xff, 0x3f, 0x1f};
+	uint32_t size = 0;
+	uint32_t len;
+	uint32_t n;
+	uint32_t x;
+
+	memset(pf, 0, sizeof(*pf));
+
+	pf->num = num_frames;
+	pf->seed = seed;
+	pf->offset = malloc(sizeof(pf->offset[0]) * (pf->num + 1));
+	pf->hash = malloc(sizeof(pf->hash[0]) * pf->num);
+	if (pf->offset == NULL || pf->hash == NULL)
+		errx(1, "Out of memory");
+
+	for (n = 0; n != pf->num; n++) {
+		pf->offset[n] = size;
+
+		/* mostly short frames, like on the D-channel */
+		if (hdlctest_random(&pf->seed) & 1)
+			len = 1 + (hdlctest_random(&pf->seed) % 16);
+		else
+			len = 1 + (hdlctest_random(&pf->seed) % max_frame);
+		size += len;
+	}
+	pf->offset[n] = size;
+
+	pf->data = malloc(size);
+	if (pf->data == NULL)
+		errx(1, "Out of memory");
+
+	for (x = 0; x != size; x++) {
+		n = hdlctest_random(&pf->seed);
+		pf->data[x] = (n & 3) ? (uint8_t)(n >> 8) : special[(n >> 2) & 3];
+	}
+
+	for (n = 0; n != pf->num; n++) {
+		pf->hash[n] = hdlctest_hash(2166136261U,
+		    pf->data + pf->offset[n], pf->offset[n + 1] - pf->offset[n]);
+	}
+}
+
+static int
+hdlctest_get_frame(void *arg, const uint8_t **pptr, uint16_t *plen)
+{
+	struct hdlctest_frames *pf = arg;
+
+	if (pf->next == pf->num)
+		return (0);
+
+	/* pretend that the next frame is not ready yet */
+	if (pf->idle_rate != 0.0 &&
+	    hdlctest_random_rate(&pf->seed) < pf->idle_rate)
+		return (0);
+
+	*pptr = pf->data + pf->offset[pf->next];
+	*plen = pf->offset[pf->next + 1] - pf->offset[pf->next];
+	pf->next++;
+	return (1);
+}
+
+/*---------------------------------------------------------------------------*
+ *	decoder event log
+ *---------------------------------------------------------------------------*/
+static void
+hdlctest_put_frame(void *arg, uint8_t event, const uint8_t *ptr, uint16_t len)
+{
+	struct hdlctest_log *pl = arg;
+	struct hdlctest_event *pe;
+
+	if (pl->num == pl->max) {
+		pl->max = pl->max ? (2 * pl->max) : 1024;
+		pl->ev = realloc(pl->ev, sizeof(pl->ev[0]) * pl->max);
+		if (pl->ev == NULL)
+			errx(1, "Out of memory");
+	}
+
+	pe = pl->ev + pl->num++;
+	pe->event = event;
+	pe->len = len;
+	pe->hash = hdlctest_hash(2166136261U, ptr, len);
+
+	pl->count[event]++;
+}
+
+static void
+hdlctest_put_count(void *arg, uint8_t event, const uint8_t *ptr __unused,
+    uint16_t len __unused)
+{
+	struct hdlctest_log *pl = arg;
+
+	pl->count[event]++;
+}
+
+static void
+hdlctest_log_free(struct hdlctest_log *pl)
+{
+	free(pl->ev);
+	memset(pl, 0, sizeof(*pl));
+}
+
+/*
+ * The digest covers all decoder events, so that the output of two
+ * versions of the decoder can be compared.
+ */
+static uint32_t
+hdlctest_log_digest(struct hdlctest_log *pl)
+{
+	uint32_t hash = 2166136261U;
+	uint32_t n;
+
+	for (n = 0; n != pl->num; n++) {
+		hash = hdlctest_hash(hash, &pl->ev[n].event, 1);
+		hash = hdlctest_hash(hash, (const uint8_t *)&pl->ev[n].len, 2);
+		hash = hdlctest_hash(hash, (const uint8_t *)&pl->ev[n].hash, 4);
+	}
+	return (hash);
+}
+
+static int
+hdlctest_log_compare(const char *name, struct hdlctest_log *pa,
+    struct hdlctest_log *pb)
+{
+	uint32_t n;
+
+	for (n = 0; n != pa->num && n != pb->num; n++) {
+		if (pa->ev[n].event != pb->ev[n].event ||
+		    pa->ev[n].len != pb->ev[n].len ||
+		    pa->ev[n].hash != pb->ev[n].hash)
+			break;
+	}
+
+	if (n == pa->num && n == pb->num)
+		return (0);
+
+	printf("%-8s event %u differs when not skipping idle bytes: ",
+	    name, n);
+
+	if (n != pa->num)
+		printf("%s(%u) ", event_name[pa->ev[n].event], pa->ev[n].len);
+	else
+		printf("none ");
+
+	if (n != pb->num)
+		printf("!= %s(%u)\n", event_name[pb->ev[n].event], pb->ev[n].len);
+	else
+		printf("!= none\n");
+
+	return (1);
+}
+
+/*---------------------------------------------------------------------------*
+ *	encode all frames into a stream of bytes
+ *
+ * "idle" and "abort" select if the encoder should be idle between
+ * frames, like when the transmit queue is empty, and if frames should
+ * be aborted at random. The number of aborts is returned.
+ *---------------------------------------------------------------------------*/
+static uint32_t
+hdlctest_encode(struct hdlctest_frames *pf, uint8_t **pbuf, uint32_t *plen,
+    uint8_t random)
+{
+	struct hdlc_encoder enc;
+	uint8_t *buf = *pbuf;
+	uint32_t max = *plen;
+	uint32_t len = 0;
+	uint32_t aborts = 0;
+	uint32_t chunk;
+	uint32_t x;
+
+	pf->next = 0;
+	pf->idle_rate = random ? idle_rate : 0.0;
+
+	hdlc_encoder_init(&enc, channel_type, &hdlctest_get_frame, pf);
+
+	while (1) {
+		chunk = block_len;
+		if (random) {
+			chunk = 1 + (hdlctest_random(&pf->seed) % block_len);
+
+			if (hdlctest_random_rate(&pf->seed) < abort_rate) {
+				hdlc_encode_abort(&enc);
+				aborts++;
+			}
+		}
+
+		/* the pad bytes below are at most 16 */
+		if ((len + chunk + 16) > max) {
+			max = 2 * (len + chunk + 16);
+			buf = realloc(buf, max);
+			if (buf == NULL)
+				errx(1, "Out of memory");
+		}
+
+		len += hdlc_encode(&enc, buf + len, chunk);
+
+		if (enc.idle == 0)
+			continue;
+
+		/* the hardware repeats the last byte when it runs out of data */
+		x = random ? (1 + (hdlctest_random(&pf->seed) % 16)) : 2;
+		while (x--) {
+			buf[len] = buf[len - 1];
+			len++;
+		}
+
+		if (pf->next == pf->num)
+			break;
+	}
+
+	*pbuf = buf;
+	*plen = len;
+
+	return (aborts);
+}
+
+/*---------------------------------------------------------------------------*
+ *	decode a stream of bytes, in blocks of random size
+ *---------------------------------------------------------------------------*/
+static void
+hdlctest_decode(const uint8_t *buf, uint32_t len, struct hdlctest_log *pl,
+    uint8_t no_idle)
+{
+	struct hdlc_decoder dec;
+	uint32_t chunk;
+
+	if (hdlc_decoder_init(&dec, max_frame, &hdlctest_put_frame, pl))
+		errx(1, "Out of memory");
+
+	dec.no_idle = no_idle;
+
+	while (len != 0) {
+		chunk = 1 + (hdlctest_random(&seed) % block_len);
+		if (chunk > len)
+			chunk = len;
+
+		hdlc_decode(&dec, buf, chunk);
+		buf += chunk;
+		len -= chunk;
+	}
+
+	hdlc_decoder_free(&dec);
+}
+
+/*---------------------------------------------------------------------------*
+ *	decode a stream of bytes, in blocks of fixed size, and return
+ *	the time used
+ *---------------------------------------------------------------------------*/
+static uint64_t
+hdlctest_bench_decode(const uint8_t *buf, uint32_t len,
+    struct hdlctest_log *pl, uint8_t no_idle)
+{
+	struct hdlc_decoder dec;
+	uint64_t t0;
+	uint32_t y;
+
+	if (hdlc_decoder_init(&dec, max_frame, &hdlctest_put_count, pl))
+		errx(1, "Out of memory");
+
+	dec.no_idle = no_idle;
+
+	t0 = hdlctest_time_ns();
+	for (y = 0; y < len; y += block_len) {
+		hdlc_decode(&dec, buf + y, (len - y) < block_len ?
+		    (len - y) : block_len);
+	}
+	t0 = hdlctest_time_ns() - t0;
+
+	hdlc_decoder_free(&dec);
+
+	return (t0);
+}
+
+/*---------------------------------------------------------------------------*
+ *	check that the frames decoded from an error free stream are the
+ *	frames which were sent, except for aborted frames
+ *---------------------------------------------------------------------------*/
+static int
+hdlctest_check_frames(struct hdlctest_frames *pf, struct hdlctest_log *pl,
+    uint32_t aborts)
+{
+	uint32_t missing = 0;
+	uint32_t x = 0;
+	uint32_t n;
+	uint16_t len;
+
+	if (pl->count[HDLC_CODEC_CRC] != 0 ||
+	    pl->count[HDLC_CODEC_SHORT] != 0 ||
+	    pl->count[HDLC_CODEC_OVERFLOW] != 0) {
+		printf("encode   error free stream has bad frames\n");
+		return (1);
+	}
+
+	for (n = 0; n != pl->num; n++) {
+		if (pl->ev[n].event != HDLC_CODEC_FRAME)
+			continue;
+
+		for (; x != pf->num; x++) {
+			len = pf->offset[x + 1] - pf->offset[x];
+			if (pl->ev[n].len == len && pl->ev[n].hash == pf->hash[x])
+				break;
+			missing++;
+		}
+		if (x == pf->num) {
+			printf("encode   decoded frame %u was not sent\n", n);
+			return (1);
+		}
+		x++;
+	}
+
+	missing += pf->num - x;
+
+	if (missing > aborts) {
+		printf("encode   %u frames missing, but only %u aborts\n",
+		    missing, aborts);
+		return (1);
+	}
+	return (0);
+}
+
+/*---------------------------------------------------------------------------*
+ *	flip random bits
+ *---------------------------------------------------------------------------*/
+static uint32_t
+hdlctest_bit_errors(uint8_t *buf, uint32_t len)
+{
+	uint64_t bits = 8ULL * len;
+	uint64_t pos = 0;
+	uint32_t dist;
+	uint32_t num = 0;
+
+	if (bit_error_rate <= 0.0)
+		return (0);
+
+	dist = (bit_error_rate < (1.0 / 0x7fffffff)) ? 0xfffffffeU :
+	    (uint32_t)(2.0 / bit_error_rate);
+	if (dist == 0)
+		dist = 1;
+
+	while (1) {
+		/* the average distance is one over the bit error rate */
+		pos += 1 + (hdlctest_random(&seed) % dist);
+		if (pos >= bits)
+			break;
+		buf[pos / 8] ^= 1 << (pos % 8);
+		num++;
+	}
+	return (num);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct hdlctest_frames frames;
+	struct hdlctest_log log_clean;
+	struct hdlctest_log log_dec;
+	struct hdlctest_log log_noidle;
+	struct hdlctest_log log_bench;
+	struct hdlctest_log log_skip;
+	uint8_t *tx_buf = NULL;
+	uint8_t *rx_buf;
+	uint8_t *idle_buf;
+	uint32_t tx_len = 0;
+	uint32_t tx_max;
+	uint32_t aborts;
+	uint32_t errors;
+	uint32_t x;
+	uint64_t t_enc = 0;
+	uint64_t t_dec = 0;
+	uint64_t t_dec_noidle = 0;
+	uint64_t t_idle = 0;
+	uint64_t t_idle_noidle = 0;
+	uint64_t n_enc = 0;
+	uint64_t n_dec = 0;
+	uint64_t t0;
+	int failed = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "n:m:b:r:s:e:a:i:d")) != -1) {
+		switch (c) {
+		case 'n':
+			num_frames = atoi(optarg);
+			break;
+		case 'm':
+			max_frame = atoi(optarg);
+			if (max_frame == 0 || max_frame > 16384)
+				usage();
+			break;
+		case 'b':
+			block_len = atoi(optarg);
+			if (block_len == 0)
+				usage();
+			break;
+		case 'r':
+			repeat = atoi(optarg);
+			break;
+		case 's':
+			seed = atoi(optarg);
+			break;
+		case 'e':
+			bit_error_rate = atof(optarg);
+			break;
+		case 'a':
+			abort_rate = atof(optarg);
+			break;
+		case 'i':
+			idle_rate = atof(optarg);
+			break;
+		case 'd':
+			channel_type = HDLC_CODEC_D_CHANNEL;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+
+	hdlctest_frames_init(&frames);
+
+	memset(&log_clean, 0, sizeof(log_clean));
+	memset(&log_dec, 0, sizeof(log_dec));
+	memset(&log_noidle, 0, sizeof(log_noidle));
+	memset(&log_bench, 0, sizeof(log_bench));
+	memset(&log_skip, 0, sizeof(log_skip));
+
+	printf("hdlctest frames=%u max=%u block=%u seed=%u type=%s\n",
+	    frames.num, max_frame, block_len, seed,
+	    (channel_type == HDLC_CODEC_D_CHANNEL) ? "D-channel" : "B-channel");
+
+	/*
+	 * Verify the encoder and the decoder on a stream with aborts
+	 * and idle periods, first without and then with bit errors:
+	 */
+	aborts = hdlctest_encode(&frames, &tx_buf, &tx_len, 1);
+
+	hdlctest_decode(tx_buf, tx_len, &log_clean, 0);
+	failed |= hdlctest_check_frames(&frames, &log_clean, aborts);
+
+	rx_buf = malloc(tx_len);
+	if (rx_buf == NULL)
+		errx(1, "Out of memory");
+	memcpy(rx_buf, tx_buf, tx_len);
+	errors = hdlctest_bit_errors(rx_buf, tx_len);
+
+	hdlctest_decode(rx_buf, tx_len, &log_dec, 0);
+	hdlctest_decode(rx_buf, tx_len, &log_noidle, 1);
+
+	failed |= hdlctest_log_compare("decode", &log_dec, &log_noidle);
+
+	printf("verify   bytes=%u aborts=%u bit_errors=%u",
+	    tx_len, aborts, errors);
+	for (x = 0; x != HDLC_CODEC_EVENT_MAX; x++)
+		printf(" %s=%u", event_name[x], log_dec.count[x]);
+	printf(" digest=0x%08x %s\n", hdlctest_log_digest(&log_dec),
+	    failed ? "FAILED" : "OK");
+
+	/*
+	 * Measure the throughput, with a fixed number of bytes per call
+	 * and without aborts or idle periods for the encoder. The
+	 * decoder is measured with and without skipping idle bytes, on
+	 * the stream with bit errors and on an idle line:
+	 */
+	idle_buf = malloc(tx_len);
+	if (idle_buf == NULL)
+		errx(1, "Out of memory");
+	memset(idle_buf, (channel_type == HDLC_CODEC_D_CHANNEL) ?
+	    0xff : 0x7e, tx_len);
+
+	tx_max = tx_len;
+
+	for (x = 0; x != repeat; x++) {
+		t0 = hdlctest_time_ns();
+		hdlctest_encode(&frames, &tx_buf, &tx_max, 0);
+		t_enc += hdlctest_time_ns() - t0;
+		n_enc += tx_max;
+
+		t_dec += hdlctest_bench_decode(rx_buf, tx_len, &log_bench, 0);
+		t_dec_noidle += hdlctest_bench_decode(rx_buf, tx_len,
+		    &log_skip, 1);
+		n_dec += tx_len;
+
+		t_idle += hdlctest_bench_decode(idle_buf, tx_len,
+		    &log_skip, 0);
+		t_idle_noidle += hdlctest_bench_decode(idle_buf, tx_len,
+		    &log_skip, 1);
+	}
+
+	if (t_enc != 0 && t_dec != 0 && t_dec_noidle != 0 &&
+	    t_idle != 0 && t_idle_noidle != 0) {
+		printf("encode   %.1f MB/s %.0f frames/s\n",
+		    (n_enc * 1000.0) / t_enc,
+		    (repeat * (double)frames.num * 1e9) / t_enc);
+		printf("decode   %.1f MB/s %.0f frames/s, "
+		    "without skipping idle bytes %.1f MB/s\n",
+		    (n_dec * 1000.0) / t_dec,
+		    (log_bench.count[HDLC_CODEC_FRAME] * 1e9) / t_dec,
+		    (n_dec * 1000.0) / t_dec_noidle);
+		printf("idle     %.1f MB/s, "
+		    "without skipping idle bytes %.1f MB/s\n",
+		    (n_dec * 1000.0) / t_idle,
+		    (n_dec * 1000.0) / t_idle_noidle);
+	}
+
+	hdlctest_log_free(&log_clean);
+	hdlctest_log_free(&log_dec);
+	hdlctest_log_free(&log_noidle);
+
+	free(tx_buf);
+	free(rx_buf);
+	free(idle_buf);
+	free(frames.data);
+	free(frames.offset);
+	free(frames.hash);
+
+	return (failed);
+}
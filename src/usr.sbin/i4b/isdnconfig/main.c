@@ -65,6 +65,12 @@ struct options {
 
     u_int8_t  got_any : 1;
     u_int8_t  got_dump_ec : 1;
+    u_int8_t  got_poll_stat : 1;
+    u_int8_t  got_poll_stat_clear : 1;
+    u_int8_t  got_fifo_stat : 1;
+    u_int8_t  got_fifo_stat_clear : 1;
+    u_int8_t  got_mbuf_stat : 1;
+    u_int8_t  got_mbuf_stat_clear : 1;
     u_int8_t  got_c : 1;
     u_int8_t  got_u : 1;
     u_int8_t  got_i : 1;
@@ -300,6 +306,155 @@ dump_ec_fir_filter(struct options *opt)
     return;
 }
 
+/*---------------------------------------------------------------------------*
+ *	dump_poll_stat - dump interrupt and poll statistics
+ *---------------------------------------------------------------------------*/
+static void
+dump_poll_stat(struct options *opt)
+{
+    i4b_poll_debug_t poll_dbg;
+    pollstat_t *ps = &poll_dbg.pollstat;
+    uint32_t hz;
+
+    memset(&poll_dbg, 0, sizeof(poll_dbg));
+
+    poll_dbg.unit = opt->unit;
+
+    if (ioctl(isdnfd, I4B_CTL_GET_POLLSTAT, &poll_dbg) < 0)
+    {
+        warn("cannot get poll statistics for unit %u", opt->unit);
+	return;
+    }
+
+    hz = poll_dbg.hz ? poll_dbg.hz : 1;
+
+    printf("poll statistics %u = {\n", opt->unit);
+    printf("  poll_delay     : %u.%03u s (max %u.%03u s)\n",
+	   poll_dbg.poll_delay / hz,
+	   ((poll_dbg.poll_delay % hz) * 1000) / hz,
+	   poll_dbg.poll_delay_max / hz,
+	   ((poll_dbg.poll_delay_max % hz) * 1000) / hz);
+    printf("  interrupts     : %llu\n",
+	   (unsigned long long)ps->interrupts);
+    printf("  polls          : %llu\n",
+	   (unsigned long long)ps->polls);
+    printf("  wakeups        : %llu\n",
+	   (unsigned long long)ps->wakeups);
+    printf("  fifo_runs      : %llu\n",
+	   (unsigned long long)ps->fifo_runs);
+    printf("  fifo_loops     : %llu\n",
+	   (unsigned long long)ps->fifo_loops);
+    printf("  quota_exceeded : %llu\n",
+	   (unsigned long long)ps->quota_exceeded);
+    printf("  work_per_wakeup: %.2f\n",
+	   ps->wakeups ? ((double)ps->fifo_runs / 
+			  (double)ps->wakeups) : 0.0);
+    printf("}\n");
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ *	dump_fifo_stat_dir - dump FIFO statistics for one direction
+ *---------------------------------------------------------------------------*/
+static void
+dump_fifo_stat_dir(const char *dir, fifostat_t *fs)
+{
+    uint32_t x;
+
+    printf("  %s = {\n", dir);
+    printf("    services       : %u\n", fs->services);
+    printf("    bytes          : %u\n", fs->bytes);
+    printf("    overruns       : %u\n", fs->overruns);
+    printf("    underruns      : %u\n", fs->underruns);
+    printf("    quota_exceeded : %u\n", fs->quota_exceeded);
+    printf("    interval_max   : %u us\n", fs->interval_max);
+    printf("    histogram      : "
+	   "interval >= us, count, bytes >=, count\n");
+
+    for (x = 0; x < I4B_FIFOSTAT_HIST_MAX; x++)
+    {
+        if ((fs->interval_hist[x] == 0) &&
+	    (fs->bytes_hist[x] == 0))
+	{
+	    continue;
+	}
+
+	printf("      %10u %10u %10u %10u\n",
+	       (x == 0) ? 0 : (125U << (x - 1)),
+	       fs->interval_hist[x],
+	       (x == 0) ? 0 : (1U << (x - 1)),
+	       fs->bytes_hist[x]);
+    }
+    printf("  }\n");
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ *	dump_fifo_stat - dump FIFO statistics
+ *---------------------------------------------------------------------------*/
+static void
+dump_fifo_stat(struct options *opt)
+{
+    i4b_fifo_debug_t fifo_dbg;
+
+    memset(&fifo_dbg, 0, sizeof(fifo_dbg));
+
+    fifo_dbg.unit = opt->unit;
+    fifo_dbg.chan = opt->channel;
+
+    if (ioctl(isdnfd, I4B_CTL_GET_FIFOSTAT, &fifo_dbg) < 0)
+    {
+        warn("cannot get FIFO statistics for unit %u, "
+	     "channel %u", opt->unit, opt->channel);
+	return;
+    }
+
+    printf("FIFO statistics %u.%u = {\n", opt->unit, opt->channel);
+    dump_fifo_stat_dir("receive", &fifo_dbg.rx);
+    dump_fifo_stat_dir("transmit", &fifo_dbg.tx);
+    printf("}\n");
+    return;
+}
+
+/*---------------------------------------------------------------------------*
+ *	dump_mbuf_stat - dump mbuf pool statistics
+ *---------------------------------------------------------------------------*/
+static void
+dump_mbuf_stat(struct options *opt)
+{
+    i4b_mbuf_debug_t mbuf_dbg;
+    uint64_t total;
+
+    memset(&mbuf_dbg, 0, sizeof(mbuf_dbg));
+
+    mbuf_dbg.unit = opt->unit;
+
+    if (ioctl(isdnfd, I4B_CTL_GET_MBUFSTAT, &mbuf_dbg) < 0)
+    {
+        warn("cannot get mbuf pool statistics for unit %u", opt->unit);
+	return;
+    }
+
+    total = mbuf_dbg.hits + mbuf_dbg.misses;
+
+    printf("mbuf pool statistics %u = {\n", opt->unit);
+    printf("  count          : %u (max %u)\n",
+	   mbuf_dbg.count, mbuf_dbg.count_max);
+    printf("  hits           : %llu\n",
+	   (unsigned long long)mbuf_dbg.hits);
+    printf("  misses         : %llu\n",
+	   (unsigned long long)mbuf_dbg.misses);
+    printf("  recycled       : %llu\n",
+	   (unsigned long long)mbuf_dbg.recycled);
+    printf("  dropped        : %llu\n",
+	   (unsigned long long)mbuf_dbg.dropped);
+    printf("  hit_rate       : %.1f%%\n",
+	   total ? ((100.0 * (double)mbuf_dbg.hits) /
+		    (double)total) : 0.0);
+    printf("}\n");
+    return;
+}
+
 /*---------------------------------------------------------------------------*
  *	flush_command - flush a command
  *---------------------------------------------------------------------------*/
@@ -559,6 +714,77 @@ flush_command(struct options *opt)
 	}
     }
 
+    if (opt->got_poll_stat ||
+	opt->got_poll_stat_clear)
+    {
+        if (opt->got_u == 0)
+	{
+	    err(1, "'poll_stat' option requires '-u' option!");
+	}
+
+	if (opt->got_poll_stat)
+	{
+	    dump_poll_stat(opt);
+	}
+
+	if (opt->got_poll_stat_clear)
+	{
+	    i4b_poll_debug_t poll_dbg;
+
+	    memset(&poll_dbg, 0, sizeof(poll_dbg));
+	    poll_dbg.unit = opt->unit;
+	    i4b_ioctl(I4B_CTL_CLR_POLLSTAT, "poll_stat_clear", &poll_dbg);
+	}
+    }
+
+    if (opt->got_fifo_stat ||
+	opt->got_fifo_stat_clear)
+    {
+        if ((opt->got_u == 0) ||
+	    (opt->got_c == 0))
+	{
+	    err(1, "'fifo_stat' option requires '-u' and '-c' option!");
+	}
+
+	if (opt->got_fifo_stat)
+	{
+	    dump_fifo_stat(opt);
+	}
+
+	if (opt->got_fifo_stat_clear)
+	{
+	    i4b_fifo_debug_t fifo_dbg;
+
+	    memset(&fifo_dbg, 0, sizeof(fifo_dbg));
+	    fifo_dbg.unit = opt->unit;
+	    fifo_dbg.chan = opt->channel;
+	    i4b_ioctl(I4B_CTL_CLR_FIFOSTAT, "fifo_stat_clear", &fifo_dbg);
+	}
+    }
+
+    if (opt->got_mbuf_stat ||
+	opt->got_mbuf_stat_clear)
+    {
+        if (opt->got_u == 0)
+	{
+	    err(1, "'mbuf_stat' option requires '-u' option!");
+	}
+
+	if (opt->got_mbuf_stat)
+	{
+	    dump_mbuf_stat(opt);
+	}
+
+	if (opt->got_mbuf_stat_clear)
+	{
+	    i4b_mbuf_debug_t mbuf_dbg;
+
+	    memset(&mbuf_dbg, 0, sizeof(mbuf_dbg));
+	    mbuf_dbg.unit = opt->unit;
+	    i4b_ioctl(I4B_CTL_CLR_MBUFSTAT, "mbuf_stat_clear", &mbuf_dbg);
+	}
+    }
+
     reset_options(opt);
     return;
 }
@@ -724,6 +950,24 @@ main(int argc, char **argv)
 	  if(strcmp(ptr, "dump_ec") == 0) {
 	    opt->got_dump_ec = 1;
 	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "poll_stat") == 0) {
+	    opt->got_poll_stat = 1;
+	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "poll_stat_clear") == 0) {
+	    opt->got_poll_stat_clear = 1;
+	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "fifo_stat") == 0) {
+	    opt->got_fifo_stat = 1;
+	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "fifo_stat_clear") == 0) {
+	    opt->got_fifo_stat_clear = 1;
+	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "mbuf_stat") == 0) {
+	    opt->got_mbuf_stat = 1;
+	    opt->got_any = 1;
+	  } else if(strcmp(ptr, "mbuf_stat_clear") == 0) {
+	    opt->got_mbuf_stat_clear = 1;
+	    opt->got_any = 1;
 	  } else if(strcmp(ptr, "nt_mode") == 0) {
 	    opt->got_nt_mode = 1;
 	    opt->got_any = 1;